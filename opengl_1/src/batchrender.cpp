@@ -0,0 +1,228 @@
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QGuiApplication>
+#include <QStringList>
+#include <QSurfaceFormat>
+
+#include <algorithm>
+#include <cfloat>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "boundedqueue.h"
+#include "bounds.h"
+#include "jobsystem.h"
+#include "model.h"
+#include "simdmath.h"
+#include "thumbnailrenderer.h"
+
+namespace {
+
+/**
+ * @brief A model loaded by the loader thread, ready to be uploaded.
+ */
+struct LoadedModel {
+  QString path;
+  std::unique_ptr<Model> model;
+  Bounds bounds;
+};
+
+using ImageBatch = std::vector<std::pair<QString, QImage>>;
+
+LoadedModel load(const QString &path) {
+  LoadedModel loaded;
+  loaded.path = path;
+  loaded.model = std::make_unique<Model>(path, Model::Indexed);
+
+  Span<const QVector3D> coords = loaded.model->getCoords();
+  PositionsSoA positions;
+  positions.fromInterleaved(reinterpret_cast<const float *>(coords.data()), coords.size());
+  float min[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+  float max[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+  simd::computeBounds(positions, min, max);
+  loaded.bounds.min = QVector3D(min[0], min[1], min[2]);
+  loaded.bounds.max = QVector3D(max[0], max[1], max[2]);
+  return loaded;
+}
+
+QString imagePath(const QDir &outputDir, const QString &modelPath, int view, int views) {
+  QString name = QFileInfo(modelPath).completeBaseName();
+  if (views > 1) {
+    name += QString("_%1").arg(view, 3, 10, QChar('0'));
+  }
+  return outputDir.filePath(name + ".png");
+}
+
+}  // namespace
+
+/**
+ * @brief main Renders a thumbnail, or a turntable of several views, of every
+ * .obj, .ply, .stl and .cgmesh file in a directory without opening a window.
+ *
+ * Usage: batchrender inputDir outputDir [size] [views]
+ *
+ * Three stages overlap: a loader thread parses the next models in parallel
+ * on the job system, this thread renders, and a writer thread encodes the
+ * images. The queues between them are bounded, so memory use does not grow
+ * with the number of models.
+ *
+ * Set CG_SOFTWARE_RENDER=1 to render with the software rasterizer instead of
+ * OpenGL; it is also used when no OpenGL 3.3 context can be created. Set
+ * CG_COMPARE_RENDERERS=1 to render every view with both, and report the time
+ * per view of each.
+ *
+ * @param argc Argument count.
+ * @param argv Arguments.
+ * @return Exit code.
+ */
+int main(int argc, char *argv[]) {
+#ifdef Q_OS_LINUX
+  // Without a display, e.g. on a GPU-less server with Mesa, render offscreen
+  if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM") && qEnvironmentVariableIsEmpty("DISPLAY") &&
+      qEnvironmentVariableIsEmpty("WAYLAND_DISPLAY")) {
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+  }
+#endif
+  QGuiApplication app(argc, argv);
+  QStringList args = app.arguments();
+
+  if (args.size() < 3) {
+    qWarning() << "Usage: batchrender inputDir outputDir [size] [views]";
+    return 1;
+  }
+  int size = args.size() > 3 ? std::max(1, args[3].toInt()) : 256;
+  int views = args.size() > 4 ? std::max(1, args[4].toInt()) : 1;
+
+  QDir inputDir(args[1]);
+  QStringList files;
+  for (const QString &name : inputDir.entryList({"*.obj", "*.ply", "*.stl", "*.cgmesh"}, QDir::Files, QDir::Name)) {
+    files.append(inputDir.filePath(name));
+  }
+  QDir outputDir(args[2]);
+  if (!outputDir.mkpath(".")) {
+    qWarning() << "Cannot create" << args[2];
+    return 1;
+  }
+
+  // Request OpenGL 3.3 Core, like the viewer
+  QSurfaceFormat glFormat;
+  glFormat.setProfile(QSurfaceFormat::CoreProfile);
+  glFormat.setVersion(3, 3);
+  glFormat.setDepthBufferSize(24);
+  QSurfaceFormat::setDefaultFormat(glFormat);
+
+  // Render on the CPU when asked to, or when there is no usable OpenGL
+  ThumbnailRenderer renderer;
+  bool software = qEnvironmentVariableIntValue("CG_SOFTWARE_RENDER") != 0;
+  bool openGL = !software && renderer.initialize(QSize(size, size), ThumbnailRenderer::Backend::OpenGL);
+  if (!openGL) {
+    if (!software) qWarning() << "Falling back to the software rasterizer";
+    renderer.initialize(QSize(size, size), ThumbnailRenderer::Backend::Software);
+  }
+  JobSystem &jobs = JobSystem::global();
+  QString rendererName = renderer.rendererName();
+  qInfo().noquote() << ":: Rendering" << files.size() << "models with" << rendererName
+                    << "on" << jobs.threadCount() << "threads";
+
+  // Also render every view with the software rasterizer, to time both on
+  // the same models
+  std::unique_ptr<ThumbnailRenderer> comparison;
+  if (openGL && qEnvironmentVariableIntValue("CG_COMPARE_RENDERERS") != 0) {
+    comparison = std::make_unique<ThumbnailRenderer>();
+    comparison->initialize(QSize(size, size), ThumbnailRenderer::Backend::Software);
+  }
+  double openGLSeconds = 0, softwareSeconds = 0;
+
+  QElapsedTimer timer;
+  timer.start();
+
+  // Load a batch of models in parallel, while the previous ones render
+  BoundedQueue<LoadedModel> loaded(2 * jobs.threadCount());
+  std::thread loader([&] {
+    size_t batchSize = jobs.threadCount();
+    for (size_t first = 0; first < size_t(files.size()); first += batchSize) {
+      std::vector<LoadedModel> batch(std::min(batchSize, size_t(files.size()) - first));
+      jobs.parallelFor(batch.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+          batch[i] = load(files[first + i]);
+        }
+      });
+      for (LoadedModel &model : batch) {
+        if (!loaded.push(std::move(model))) return;
+      }
+    }
+    loaded.close();
+  });
+
+  // Encode and write the images in parallel, off the rendering thread
+  BoundedQueue<ImageBatch> toWrite(4);
+  std::thread writer([&] {
+    ImageBatch batch;
+    while (toWrite.pop(batch)) {
+      jobs.parallelFor(batch.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+          if (!batch[i].second.save(batch[i].first)) {
+            qWarning() << "Cannot write" << batch[i].first;
+          }
+        }
+      });
+    }
+  });
+
+  int rendered = 0, failed = 0, images = 0;
+  LoadedModel item;
+  while (loaded.pop(item)) {
+    if (item.model->getNumTriangles() == 0) {
+      qWarning() << "No triangles in" << item.path;
+      ++failed;
+      continue;
+    }
+
+    QElapsedTimer renderTimer;
+    renderTimer.start();
+    renderer.setMesh(item.model->getCoords(), item.model->getTriangleIndices(), item.bounds);
+    for (int view = 0; view < views; ++view) {
+      renderer.renderView(360.0f * view / views, imagePath(outputDir, item.path, view, views));
+    }
+    ++rendered;
+
+    // When comparing, wait for the readbacks, so the time covers every view
+    ImageBatch batch = renderer.takeImages(comparison != nullptr);
+    images += batch.size();
+    if (!batch.empty()) toWrite.push(std::move(batch));
+
+    if (comparison) {
+      openGLSeconds += renderTimer.nsecsElapsed() / 1e9;
+      renderTimer.restart();
+      comparison->setMesh(item.model->getCoords(), item.model->getTriangleIndices(), item.bounds);
+      for (int view = 0; view < views; ++view) {
+        comparison->renderView(360.0f * view / views, QString());
+      }
+      comparison->takeImages(true);
+      softwareSeconds += renderTimer.nsecsElapsed() / 1e9;
+    }
+  }
+
+  ImageBatch last = renderer.takeImages(true);
+  images += last.size();
+  toWrite.push(std::move(last));
+  toWrite.close();
+  writer.join();
+  loader.join();
+
+  double seconds = timer.nsecsElapsed() / 1e9;
+  qInfo().nospace() << ":: Rendered " << rendered << " models (" << images << " images, "
+                    << failed << " failed) in " << seconds << " s: "
+                    << rendered / std::max(seconds, 1e-9) << " models/s";
+  if (comparison && rendered > 0) {
+    double viewCount = double(rendered) * views;
+    qInfo().nospace().noquote() << ":: " << rendererName << ": " << 1000 * openGLSeconds / viewCount
+                                << " ms per view, software rasterizer: "
+                                << 1000 * softwareSeconds / viewCount << " ms per view";
+  }
+  return rendered > 0 || files.isEmpty() ? 0 : 1;
+}
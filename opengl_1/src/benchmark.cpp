@@ -0,0 +1,659 @@
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMatrix4x4>
+#include <QStringList>
+#include <QTextStream>
+#include <QVector3D>
+#include <QtEndian>
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "frameplanner.h"
+#include "model.h"
+#include "lightgrid.h"
+#include "meshcodec.h"
+#include "scene.h"
+#include "simdmath.h"
+#include "softwarerasterizer.h"
+#include "triangle.h"
+
+#ifndef CG_REVISION
+#define CG_REVISION "unknown"
+#endif
+
+// --- Allocation counting
+//
+// Qt containers allocate with malloc() rather than operator new, so on glibc
+// the C allocator itself is interposed; elsewhere only operator new is seen.
+
+namespace {
+std::atomic<quint64> allocationCount{0};
+std::atomic<quint64> allocatedBytes{0};
+
+inline void countAllocation(size_t size) {
+  allocationCount.fetch_add(1, std::memory_order_relaxed);
+  allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+}
+}  // namespace
+
+#ifdef __GLIBC__
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+
+void *malloc(size_t size) noexcept {
+  countAllocation(size);
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) noexcept {
+  countAllocation(count * size);
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size) noexcept {
+  countAllocation(size);
+  return __libc_realloc(pointer, size);
+}
+}
+#else
+void *operator new(size_t size) {
+  countAllocation(size);
+  if (void *pointer = std::malloc(size ? size : 1)) return pointer;
+  throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+void operator delete[](void *pointer) noexcept { std::free(pointer); }
+void operator delete(void *pointer, size_t) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, size_t) noexcept { std::free(pointer); }
+#endif
+
+/**
+ * @brief Gives the benchmark access to the individual loading stages of a
+ * Model, which the constructors otherwise run back to back.
+ */
+class ModelBenchmark {
+ public:
+  // A deep copy, so the stages never pay for detaching shared data
+  static Model copy(const Model &model) {
+    Model copy = model;
+    copy.coordsIndexed.detach();
+    copy.indices.detach();
+    copy.coords.detach();
+    return copy;
+  }
+  static Model parse(const QByteArray &obj) {
+    Model model;
+    QBuffer buffer;
+    buffer.setData(obj);
+    buffer.open(QIODevice::ReadOnly);
+    model.parse(buffer);
+    return model;
+  }
+  static Model readPly(const QByteArray &ply) {
+    Model model;
+    model.readPly(ply.constData(), ply.size());
+    return model;
+  }
+  static Model readStl(const QByteArray &stl) {
+    Model model;
+    model.readStl(stl.constData(), stl.size());
+    return model;
+  }
+  // The whole constructor: detection, reading, welding
+  static Model load(const QByteArray &data) {
+    QBuffer buffer;
+    buffer.setData(data);
+    buffer.open(QIODevice::ReadOnly);
+    return Model(buffer, Model::Indexed);
+  }
+  static void unpackIndexes(Model &model) { model.unpackIndexes(); }
+  static void alignData(Model &model) { model.alignData(); }
+};
+
+namespace {
+
+/**
+ * @brief A generated indexed triangle mesh.
+ */
+struct Mesh {
+  std::vector<QVector3D> coords;
+  std::vector<unsigned> indices;
+};
+
+/**
+ * @brief tube Sweeps a circle along a closed curve. Like most exported meshes
+ * the seams are stored twice, so the OBJ has duplicate positions to weld.
+ * @param curve Position on the curve for t in [0, 2pi).
+ * @param segments Number of segments along the curve.
+ * @param sides Number of segments around the tube.
+ * @param radius Radius of the tube.
+ * @return The mesh, with 2 * segments * sides triangles.
+ */
+Mesh tube(const std::function<QVector3D(float)> &curve, unsigned segments,
+          unsigned sides, float radius) {
+  Mesh mesh;
+  mesh.coords.reserve((segments + 1) * (sides + 1));
+  for (unsigned i = 0; i <= segments; ++i) {
+    // Wrap around explicitly, so both copies of a seam vertex are bit-equal
+    float t = 2 * float(M_PI) * (i % segments) / segments;
+    float dt = 1e-2f;
+    QVector3D center = curve(t);
+    QVector3D tangent = (curve(t + dt) - curve(t - dt)).normalized();
+    QVector3D normal = QVector3D::crossProduct(tangent, curve(t + dt) + curve(t - dt) - 2 * center);
+    if (normal.lengthSquared() < 1e-12f) {
+      normal = QVector3D::crossProduct(tangent, QVector3D(0, 0, 1));
+    }
+    normal.normalize();
+    QVector3D binormal = QVector3D::crossProduct(tangent, normal);
+
+    for (unsigned j = 0; j <= sides; ++j) {
+      float angle = 2 * float(M_PI) * (j % sides) / sides;
+      mesh.coords.push_back(center + radius * (std::cos(angle) * normal + std::sin(angle) * binormal));
+    }
+  }
+
+  mesh.indices.reserve(6 * segments * sides);
+  for (unsigned i = 0; i < segments; ++i) {
+    for (unsigned j = 0; j < sides; ++j) {
+      unsigned a = i * (sides + 1) + j;
+      unsigned b = a + sides + 1;
+      mesh.indices.insert(mesh.indices.end(), {a, b, b + 1, a, b + 1, a + 1});
+    }
+  }
+  return mesh;
+}
+
+Mesh torus(unsigned segments, unsigned sides) {
+  return tube([](float t) { return QVector3D(std::cos(t), 0, std::sin(t)); }, segments, sides, 0.3f);
+}
+
+// The (2, 3) torus knot, similar to the knot model of the viewer
+Mesh knot(unsigned segments, unsigned sides) {
+  return tube(
+      [](float t) {
+        float r = 2 + std::cos(3 * t);
+        return QVector3D(r * std::cos(2 * t), r * std::sin(2 * t), std::sin(3 * t)) * 0.5f;
+      },
+      segments, sides, 0.2f);
+}
+
+// Writes the mesh as .obj text, the input of Model's parser
+QByteArray toObj(const Mesh &mesh) {
+  QByteArray obj;
+  obj.reserve(mesh.coords.size() * 36 + mesh.indices.size() * 10);
+  char line[96];
+  for (const QVector3D &v : mesh.coords) {
+    int n = std::snprintf(line, sizeof(line), "v %.9g %.9g %.9g\n", v.x(), v.y(), v.z());
+    obj.append(line, n);
+  }
+  for (size_t i = 0; i < mesh.indices.size(); i += 3) {
+    int n = std::snprintf(line, sizeof(line), "f %u %u %u\n", mesh.indices[i] + 1,
+                          mesh.indices[i + 1] + 1, mesh.indices[i + 2] + 1);
+    obj.append(line, n);
+  }
+  return obj;
+}
+
+// Writes the mesh as binary PLY in either byte order, as scanners do
+QByteArray toPly(const Mesh &mesh, bool bigEndian) {
+  QByteArray ply = QString("ply\nformat %1 1.0\nelement vertex %2\n"
+                           "property float x\nproperty float y\nproperty float z\n"
+                           "element face %3\nproperty list uchar int vertex_indices\nend_header\n")
+                       .arg(bigEndian ? "binary_big_endian" : "binary_little_endian")
+                       .arg(mesh.coords.size())
+                       .arg(mesh.indices.size() / 3)
+                       .toLatin1();
+  qsizetype header = ply.size();
+  ply.resize(header + mesh.coords.size() * 12 + mesh.indices.size() / 3 * 13);
+  char *out = ply.data() + header;
+  auto put = [&](quint32 value) {
+    if (bigEndian) {
+      qToBigEndian(value, out);
+    } else {
+      qToLittleEndian(value, out);
+    }
+    out += 4;
+  };
+  for (const QVector3D &v : mesh.coords) {
+    for (int axis = 0; axis < 3; ++axis) {
+      quint32 bits;
+      float value = v[axis];
+      std::memcpy(&bits, &value, sizeof(bits));
+      put(bits);
+    }
+  }
+  for (size_t i = 0; i < mesh.indices.size(); i += 3) {
+    *out++ = 3;
+    for (int corner = 0; corner < 3; ++corner) put(mesh.indices[i + corner]);
+  }
+  return ply;
+}
+
+// Writes the mesh as binary STL, with every corner stored in its triangle
+QByteArray toStl(const Mesh &mesh) {
+  quint32 count = mesh.indices.size() / 3;
+  QByteArray stl(84 + 50 * qsizetype(count), '\0');
+  qToLittleEndian(count, stl.data() + 80);
+  char *out = stl.data() + 84;
+  for (size_t i = 0; i < mesh.indices.size(); i += 3, out += 50) {
+    for (int corner = 0; corner < 3; ++corner) {
+      for (int axis = 0; axis < 3; ++axis) {
+        quint32 bits;
+        float value = mesh.coords[mesh.indices[i + corner]][axis];
+        std::memcpy(&bits, &value, sizeof(bits));
+        qToLittleEndian(bits, out + 12 + 12 * corner + 4 * axis);
+      }
+    }
+  }
+  return stl;
+}
+
+/**
+ * @brief measure Times a stage. Small inputs are repeated until 200 ms have
+ * passed and the best run counts; allocations are those of the first run.
+ * @param work The stage.
+ * @param reset Restores the input of the stage before every run, untimed.
+ * @param items Number of triangles processed, for the throughput.
+ * @return The result of the stage as a JSON object.
+ */
+QJsonObject measure(const std::function<void()> &work, const std::function<void()> &reset,
+                    double items) {
+  double best = DBL_MAX;
+  quint64 allocations = 0, bytes = 0;
+  QElapsedTimer total;
+  total.start();
+  for (int run = 0; run == 0 || (run < 100 && total.elapsed() < 200); ++run) {
+    if (reset) reset();
+    quint64 countBefore = allocationCount.load();
+    quint64 bytesBefore = allocatedBytes.load();
+    QElapsedTimer timer;
+    timer.start();
+    work();
+    best = std::min(best, timer.nsecsElapsed() / 1e6);
+    if (run == 0) {
+      allocations = allocationCount.load() - countBefore;
+      bytes = allocatedBytes.load() - bytesBefore;
+    }
+  }
+
+  QJsonObject result;
+  result["milliseconds"] = best;
+  result["trianglesPerSecond"] = items / std::max(best, 1e-6) * 1000;
+  result["allocations"] = double(allocations);
+  result["allocatedBytes"] = double(bytes);
+  return result;
+}
+
+/**
+ * @brief benchmarkMesh Runs every stage of loading and render preparation on
+ * one mesh.
+ * @param name Name of the generator.
+ * @param mesh The mesh.
+ * @return The results as a JSON object.
+ */
+QJsonObject benchmarkMesh(const char *name, const Mesh &mesh) {
+  QJsonObject stages;
+  const double triangles = mesh.indices.size() / 3;
+  QByteArray obj = toObj(mesh);
+
+  // Loading, as in Model's constructors
+  Model parsed = ModelBenchmark::parse(obj);
+  QJsonObject parse = measure([&] { parsed = ModelBenchmark::parse(obj); }, {}, triangles);
+  parse["megabytesPerSecond"] = obj.size() / 1e3 / parse["milliseconds"].toDouble();
+  stages["parse"] = parse;
+
+  // The binary formats, read straight from memory like a mapped file
+  QByteArray ply = toPly(mesh, false);
+  QByteArray plyBigEndian = toPly(mesh, true);
+  QByteArray stl = toStl(mesh);
+  struct Reader {
+    const char *stage;
+    const QByteArray &data;
+    Model (*read)(const QByteArray &);
+  };
+  for (const Reader &reader : {Reader{"readPly", ply, ModelBenchmark::readPly},
+                               Reader{"readPlyBigEndian", plyBigEndian, ModelBenchmark::readPly},
+                               Reader{"readStl", stl, ModelBenchmark::readStl}}) {
+    QJsonObject read = measure([&] { reader.read(reader.data); }, {}, triangles);
+    read["megabytesPerSecond"] = reader.data.size() / 1e3 / read["milliseconds"].toDouble();
+    stages[reader.stage] = read;
+  }
+
+  // Complete loads of the same mesh, welding included, to compare the formats
+  for (const Reader &reader : {Reader{"loadObj", obj, ModelBenchmark::load},
+                               Reader{"loadPly", ply, ModelBenchmark::load},
+                               Reader{"loadStl", stl, ModelBenchmark::load}}) {
+    QJsonObject load = measure([&] { reader.read(reader.data); }, {}, triangles);
+    load["megabytesPerSecond"] = reader.data.size() / 1e3 / load["milliseconds"].toDouble();
+    stages[reader.stage] = load;
+  }
+
+  Model model = parsed;
+  auto reset = [&] { model = ModelBenchmark::copy(parsed); };
+  stages["unpackIndexes"] = measure([&] { ModelBenchmark::unpackIndexes(model); }, reset, triangles);
+  stages["alignData"] = measure([&] { ModelBenchmark::alignData(model); }, reset, triangles);
+
+  // Render preparation on the welded mesh
+  reset();
+  ModelBenchmark::alignData(model);
+  Span<const QVector3D> coords = model.getCoords();
+  Span<const unsigned> indices = model.getTriangleIndices();
+
+  // Compression to .cgmesh and back, on the calling thread and on all threads
+  std::vector<char> encoded;
+  stages["encode"] = measure([&] { encoded = meshcodec::encode(coords, indices, 16, nullptr); }, {}, triangles);
+  stages["encodeParallel"] = measure([&] { encoded = meshcodec::encode(coords, indices); }, {}, triangles);
+  size_t decodedVertexCount = 0, decodedIndexCount = 0;
+  meshcodec::readCounts(encoded.data(), encoded.size(), decodedVertexCount, decodedIndexCount);
+  std::vector<QVector3D> decodedCoords(decodedVertexCount);
+  std::vector<unsigned> decodedIndices(decodedIndexCount);
+  double decodedBytes =
+      decodedVertexCount * sizeof(QVector3D) + decodedIndexCount * sizeof(unsigned);
+  auto measureDecode = [&](JobSystem *jobs) {
+    QJsonObject decode = measure(
+        [&] {
+          meshcodec::decode(encoded.data(), encoded.size(), decodedCoords.data(),
+                            decodedIndices.data(), jobs);
+        },
+        {}, triangles);
+    decode["gigabytesPerSecond"] = decodedBytes / 1e6 / decode["milliseconds"].toDouble();
+    return decode;
+  };
+  stages["decode"] = measureDecode(nullptr);
+  stages["decodeParallel"] = measureDecode(&JobSystem::global());
+  // The entropy decoder has an AVX2 path; time the scalar one next to it
+  simd::Isa decodeIsa = simd::isa();
+  if (decodeIsa != simd::Isa::Scalar && simd::setIsa(simd::Isa::Scalar)) {
+    stages["decodeScalar"] = measureDecode(nullptr);
+    simd::setIsa(decodeIsa);
+  }
+
+  std::vector<Vertex> meshVertices(indices.size(), Vertex(0, 0, 0, 0, 0, 0));
+  stages["buildMeshVertices"] = measure(
+      [&] {
+        model.buildMeshVertices(meshVertices.data(), [](const QVector3D &v) {
+          return Vertex(v.x(), v.y(), v.z(), std::abs(v.x()), std::abs(v.y()), std::abs(v.z()));
+        });
+      },
+      {}, triangles);
+
+  // The SIMD kernels on every instruction set the CPU supports, next to the
+  // QVector3D/QMatrix4x4 code they replace. The stage without a suffix uses
+  // the instruction set picked at runtime.
+  PositionsSoA positions;
+  positions.fromInterleaved(reinterpret_cast<const float *>(coords.data()), coords.size());
+  std::vector<float> vertices(6 * coords.size());
+  std::vector<QVector3D> reference(coords.size());
+  QMatrix4x4 matrix;
+  matrix.rotate(30, 0, 1, 0);
+  PositionsSoA transformed;
+  PositionsSoA normals;
+
+  struct Kernel {
+    const char *stage;
+    std::function<void()> simd;
+    std::function<void()> qt;
+  };
+  const Kernel kernels[] = {
+      {"writeColouredVertices",
+       [&] { simd::writeColouredVertices(positions, vertices.data()); },
+       [&] {
+         float *out = vertices.data();
+         for (const QVector3D &p : coords) {
+           *out++ = p.x(); *out++ = p.y(); *out++ = p.z();
+           *out++ = std::abs(p.x()); *out++ = std::abs(p.y()); *out++ = std::abs(p.z());
+         }
+       }},
+      {"computeBounds",
+       [&] {
+         float min[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+         float max[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+         simd::computeBounds(positions, min, max);
+       },
+       [&] {
+         QVector3D min(FLT_MAX, FLT_MAX, FLT_MAX), max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+         for (const QVector3D &p : coords) {
+           min = QVector3D(qMin(min.x(), p.x()), qMin(min.y(), p.y()), qMin(min.z(), p.z()));
+           max = QVector3D(qMax(max.x(), p.x()), qMax(max.y(), p.y()), qMax(max.z(), p.z()));
+         }
+         reference[0] = min + max;
+       }},
+      {"transformPoints",
+       [&] { simd::transformPoints(matrix.constData(), positions, transformed); },
+       [&] {
+         for (size_t i = 0; i < coords.size(); ++i) reference[i] = matrix.map(coords[i]);
+       }},
+      {"computeNormals",
+       [&] { simd::computeNormals(positions, indices.data(), indices.size(), normals); },
+       [&] {
+         std::fill(reference.begin(), reference.end(), QVector3D());
+         for (size_t t = 0; t < indices.size(); t += 3) {
+           const QVector3D &a = coords[indices[t]];
+           QVector3D face =
+               QVector3D::crossProduct(coords[indices[t + 1]] - a, coords[indices[t + 2]] - a);
+           reference[indices[t]] += face;
+           reference[indices[t + 1]] += face;
+           reference[indices[t + 2]] += face;
+         }
+         for (QVector3D &v : reference) v.normalize();
+       }},
+  };
+
+  simd::Isa runtimeIsa = simd::isa();
+  for (const Kernel &kernel : kernels) {
+    QString stage = kernel.stage;
+    stages[stage] = measure(kernel.simd, {}, triangles);
+    stages[stage + "Qt"] = measure(kernel.qt, {}, triangles);
+    for (simd::Isa isa : {simd::Isa::Scalar, simd::Isa::SSE2, simd::Isa::AVX2}) {
+      if (!simd::setIsa(isa)) continue;
+      QString name = simd::isaName(isa);
+      stages[stage + name.left(1).toUpper() + name.mid(1)] = measure(kernel.simd, {}, triangles);
+    }
+    simd::setIsa(runtimeIsa);
+  }
+
+  std::vector<Meshlet> meshlets;
+  stages["buildMeshlets"] = measure([&] { meshlets = model.buildMeshlets(); }, {}, triangles);
+
+  // One lit 1024x1024 frame on the software rasterizer, framed like batchrender
+  float min[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+  float max[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+  simd::computeBounds(positions, min, max);
+  QVector3D center = (QVector3D(min[0], min[1], min[2]) + QVector3D(max[0], max[1], max[2])) / 2;
+  float radius = (QVector3D(max[0], max[1], max[2]) - center).length();
+  QMatrix4x4 view;
+  view.translate(0, 0, -2.8f);
+  view.rotate(20, 1, 0, 0);
+  view.scale(1 / std::max(radius, 1e-6f));
+  view.translate(-center);
+  QMatrix4x4 projection;
+  projection.perspective(45, 1, 0.5f, 10);
+
+  SoftwareRasterizer rasterizer;
+  rasterizer.resize(1024, 1024);
+  rasterizer.setProjection(projection.constData());
+  SoftwareRasterizer::DrawCall call;
+  call.positions = reinterpret_cast<const float *>(coords.data());
+  call.vertexCount = coords.size();
+  call.indices = indices.data();
+  call.indexCount = indices.size();
+  std::memcpy(call.modelTransform, view.constData(), sizeof(call.modelTransform));
+  call.lighting = true;
+  call.lightPosition[1] = 3;
+  stages["softwareRaster"] = measure(
+      [&] {
+        rasterizer.clear(0, 0, 0, 0);
+        rasterizer.draw(call);
+        rasterizer.flush();
+      },
+      {}, triangles);
+
+  QJsonObject result;
+  result["mesh"] = name;
+  result["triangles"] = triangles;
+  result["vertices"] = double(coords.size());
+  result["objBytes"] = double(obj.size());
+  result["encodedBytes"] = double(encoded.size());
+  result["plyBytes"] = double(ply.size());
+  result["stlBytes"] = double(stl.size());
+  result["stages"] = stages;
+  return result;
+}
+
+/**
+ * @brief benchmarkLights Times the assignment of point lights to the
+ * clusters of the viewer's frustum, and reports how many lights a fragment
+ * still has to consider.
+ * @param count Number of lights, scattered like CG_LIGHTS does.
+ * @return The results as a JSON object.
+ */
+QJsonObject benchmarkLights(int count) {
+  Bounds volume;
+  volume.min = QVector3D(-5, -3.5f, -18);
+  volume.max = QVector3D(5, 3.5f, -2);
+  std::vector<PointLight> lights = scatterLights(count, volume);
+
+  QMatrix4x4 projection;
+  projection.perspective(60, 16.0f / 9, 0.2f, 20);
+  LightGrid grid;
+  grid.setProjection(projection, 0.2f, 20);
+
+  QJsonObject result = measure([&] { grid.assign(lights); }, {}, 0);
+  result.remove("trianglesPerSecond");
+  result["lights"] = count;
+
+  uint32_t maximum = 0;
+  for (const LightCluster &cluster : grid.clusters()) {
+    maximum = std::max(maximum, cluster.count);
+  }
+  result["lightsPerCluster"] = double(grid.lightIndices().size()) / LightGrid::clusterCount;
+  result["maximumLightsPerCluster"] = double(maximum);
+  return result;
+}
+
+/**
+ * @brief benchmarkPlanner Times the frame planning of the viewer for a grid
+ * of knots, laid out like CG_STRESS_OBJECTS does, on 1 thread up to all
+ * hardware threads.
+ * @param count Number of objects.
+ * @return The results as a JSON object, with the time and the speed-up over
+ * a single thread for every thread count.
+ */
+QJsonObject benchmarkPlanner(int count) {
+  Model knotModel = ModelBenchmark::parse(toObj(knot(256, 16)));
+  ModelBenchmark::alignData(knotModel);
+
+  Scene scene;
+  int mesh = scene.addMesh();
+  scene.indexCounts[mesh] = knotModel.getTriangleIndices().size();
+  scene.vertexCounts[mesh] = knotModel.getCoords().size();
+  for (const QVector3D &v : knotModel.getCoords()) scene.bounds[mesh].extend(v);
+  scene.meshlets[mesh] = knotModel.buildMeshlets();
+
+  int side = std::ceil(std::cbrt(count));
+  for (int i = 0; i < count; i++) {
+    float x = i % side, y = (i / side) % side, z = i / (side * side);
+    scene.addObject(mesh, QVector3D(-3 + 6 * x / side, -3 + 6 * y / side, -7 - 12 * z / side));
+  }
+  scene.rotation = QVector3D(20, 30, 0);
+  scene.scale = 0.2f;
+
+  QMatrix4x4 projection;
+  projection.perspective(60, 16.0f / 9, 0.2f, 20);
+
+  QJsonArray sweep;
+  double single = 0;
+  int hardware = std::max(1u, std::thread::hardware_concurrency());
+  for (int threads = 1;; threads = std::min(2 * threads, hardware)) {
+    JobSystem jobs(threads - 1);
+    FramePlanner planner(jobs);
+    QJsonObject result = measure([&] { planner.plan(scene, projection, 1080); }, {}, 0);
+    result.remove("trianglesPerSecond");
+    double milliseconds = result["milliseconds"].toDouble();
+    if (threads == 1) single = milliseconds;
+    result["threads"] = threads;
+    result["objectsPerSecond"] = count / std::max(milliseconds, 1e-6) * 1000;
+    result["speedup"] = single / std::max(milliseconds, 1e-6);
+    result["drawn"] = int(planner.commands().size());
+    sweep.append(result);
+    if (threads == hardware) break;
+  }
+
+  QJsonObject result;
+  result["objects"] = count;
+  result["threads"] = sweep;
+  return result;
+}
+
+}  // namespace
+
+/**
+ * @brief main Benchmarks model loading and compression, render preparation
+ * and software rendering on generated tori and knots of 1k up to 10M
+ * triangles, and the light cluster assignment for 1, 100 and 10k lights,
+ * and the frame planning of 10k and 100k objects on 1 up to all threads,
+ * without an OpenGL context. The results are written to stdout as JSON, progress to stderr.
+ *
+ * Usage: benchmark [maxTriangles] > results.json
+ *
+ * @param argc Argument count.
+ * @param argv Arguments.
+ * @return Exit code.
+ */
+int main(int argc, char *argv[]) {
+  QCoreApplication app(argc, argv);
+  QStringList args = app.arguments();
+  double maxTriangles = args.size() > 1 ? args[1].toDouble() : 1e7;
+
+  QJsonArray results;
+  for (double triangles = 1e3; triangles <= maxTriangles; triangles *= 10) {
+    unsigned sides = std::max(3u, unsigned(std::lround(std::sqrt(triangles / 16))));
+    unsigned segments = std::max(3u, unsigned(std::lround(triangles / (2 * sides))));
+
+    qInfo() << ":: Benchmarking" << 2 * segments * sides << "triangles";
+    results.append(benchmarkMesh("torus", torus(segments, sides)));
+    results.append(benchmarkMesh("knot", knot(segments, sides)));
+  }
+
+  QJsonArray lights;
+  for (int count : {1, 100, 10000}) {
+    qInfo() << ":: Benchmarking" << count << "lights";
+    lights.append(benchmarkLights(count));
+  }
+
+  QJsonArray planner;
+  for (int count : {10000, 100000}) {
+    qInfo() << ":: Benchmarking frame planning of" << count << "objects";
+    planner.append(benchmarkPlanner(count));
+  }
+
+  QJsonObject report;
+  report["revision"] = CG_REVISION;
+  report["qt"] = qVersion();
+  report["isa"] = simd::isaName(simd::isa());
+  report["threads"] = int(JobSystem::global().threadCount());
+  report["results"] = results;
+  report["lights"] = lights;
+  report["planner"] = planner;
+
+  QTextStream(stdout) << QJsonDocument(report).toJson();
+  return 0;
+}
@@ -0,0 +1,59 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+/**
+ * @brief First-in first-out queue between threads with a fixed capacity.
+ *
+ * A producer that gets ahead blocks in push() until the consumer catches up,
+ * which bounds the memory held by the items in flight.
+ */
+template <typename T>
+class BoundedQueue {
+ public:
+  explicit BoundedQueue(size_t capacity) : capacity(capacity > 0 ? capacity : 1) {}
+
+  // Blocks while the queue is full; returns false if it was closed
+  bool push(T item) {
+    std::unique_lock<std::mutex> lock(mutex);
+    notFull.wait(lock, [this] { return closed || items.size() < capacity; });
+    if (closed) return false;
+    items.push_back(std::move(item));
+    notEmpty.notify_one();
+    return true;
+  }
+
+  // Blocks while the queue is empty; returns false once it is closed and
+  // drained
+  bool pop(T &item) {
+    std::unique_lock<std::mutex> lock(mutex);
+    notEmpty.wait(lock, [this] { return closed || !items.empty(); });
+    if (items.empty()) return false;
+    item = std::move(items.front());
+    items.pop_front();
+    notFull.notify_one();
+    return true;
+  }
+
+  // No more items will be pushed; wakes up all waiting threads
+  void close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = true;
+    notFull.notify_all();
+    notEmpty.notify_all();
+  }
+
+ private:
+  std::mutex mutex;
+  std::condition_variable notFull;
+  std::condition_variable notEmpty;
+  std::deque<T> items;
+  size_t capacity;
+  bool closed = false;
+};
+
+#endif  // BOUNDEDQUEUE_H
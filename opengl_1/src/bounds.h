@@ -0,0 +1,25 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <QVector3D>
+
+#include <cfloat>
+
+/**
+ * @brief Axis-aligned bounding box of an object in model space.
+ */
+struct Bounds {
+    QVector3D min{FLT_MAX, FLT_MAX, FLT_MAX};
+    QVector3D max{-FLT_MAX, -FLT_MAX, -FLT_MAX};
+
+    void extend(const QVector3D &p) {
+        min = QVector3D(qMin(min.x(), p.x()), qMin(min.y(), p.y()), qMin(min.z(), p.z()));
+        max = QVector3D(qMax(max.x(), p.x()), qMax(max.y(), p.y()), qMax(max.z(), p.z()));
+    }
+
+    QVector3D center() const { return (min + max) * 0.5f; }
+    QVector3D extents() const { return (max - min) * 0.5f; }
+    float radius() const { return extents().length(); }
+};
+
+#endif // BOUNDS_H
@@ -0,0 +1,424 @@
+#include "chunkfile.h"
+
+#include <QDataStream>
+#include <QDebug>
+#include <QFileInfo>
+#include <QTemporaryFile>
+#include <QtEndian>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+namespace {
+const char magic[8] = {'C', 'G', 'C', 'H', 'U', 'N', 'K', '2'};
+// The first version only has the leaves, without errors or children
+const char magicVersion1[8] = {'C', 'G', 'C', 'H', 'U', 'N', 'K', '1'};
+
+// Recursion limit for meshes whose triangles cannot be separated spatially
+const int maxDepth = 24;
+
+// Sizes of the header and of one chunk table entry
+const qint64 headerSize = sizeof(magic) + 4 + 4 + 4 + 24;
+const qint64 entrySize = 24 + 8 + 4 + 4 + 4 + 4 + 4;
+const qint64 entrySizeVersion1 = 24 + 8 + 4 + 4;
+
+QDataStream &operator<<(QDataStream &out, const Bounds &bounds) {
+  return out << bounds.min.x() << bounds.min.y() << bounds.min.z()
+             << bounds.max.x() << bounds.max.y() << bounds.max.z();
+}
+
+QDataStream &operator>>(QDataStream &in, Bounds &bounds) {
+  float v[6];
+  for (float &f : v) in >> f;
+  bounds.min = QVector3D(v[0], v[1], v[2]);
+  bounds.max = QVector3D(v[3], v[4], v[5]);
+  return in;
+}
+
+void prepareStream(QDataStream &stream) {
+  stream.setByteOrder(QDataStream::LittleEndian);
+  stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+}
+
+/**
+ * @brief An array in a temporary file, mapped into memory, so that the
+ * operating system can page it out like the mapped input mesh. The file is
+ * created zero-filled and removed with the array.
+ */
+template <typename T>
+class ScratchArray {
+ public:
+  bool allocate(const QString &directory, size_t count) {
+    file.setFileTemplate(directory + "/.meshchunker-XXXXXX");
+    if (!file.open() || !file.resize(qint64(count * sizeof(T)))) return false;
+    if (count == 0) return true;
+    data = reinterpret_cast<T *>(file.map(0, file.size()));
+    return data != nullptr;
+  }
+
+  T &operator[](size_t i) { return data[i]; }
+
+ private:
+  QTemporaryFile file;
+  T *data = nullptr;
+};
+
+/**
+ * @brief A chunk payload while the file is written.
+ */
+struct ChunkMesh {
+  std::vector<QVector3D> positions;
+  std::vector<quint32> indices;
+};
+
+/**
+ * @brief simplify Merges all vertices that fall in the same cell of a grid
+ * over the bounds, and drops the triangles that collapse. The grid is made
+ * coarser until at most maxTriangles triangles are left.
+ * @param mesh The mesh to simplify in place.
+ * @param bounds Bounds of the mesh.
+ * @param maxTriangles Maximum number of triangles of the result.
+ * @return The largest distance a vertex was moved, the diagonal of a cell.
+ */
+float simplify(ChunkMesh &mesh, const Bounds &bounds, unsigned maxTriangles) {
+  QVector3D size = bounds.max - bounds.min;
+  float extent = std::max({size.x(), size.y(), size.z(), 1e-20f});
+  int resolution = std::max(2, int(2 * std::sqrt(float(maxTriangles))));
+
+  std::unordered_map<quint64, quint32> cells;
+  std::vector<quint32> clusterOf(mesh.positions.size());
+  std::vector<quint32> indices;
+  float cellSize;
+  while (true) {
+    cellSize = extent / resolution;
+    cells.clear();
+    for (size_t v = 0; v < mesh.positions.size(); ++v) {
+      QVector3D cell = (mesh.positions[v] - bounds.min) / cellSize;
+      quint64 key = 0;
+      for (int axis = 0; axis < 3; ++axis) {
+        key |= quint64(qBound(0, int(cell[axis]), resolution - 1)) << (21 * axis);
+      }
+      clusterOf[v] = cells.emplace(key, quint32(cells.size())).first->second;
+    }
+
+    indices.clear();
+    for (size_t i = 0; i < mesh.indices.size(); i += 3) {
+      quint32 a = clusterOf[mesh.indices[i]];
+      quint32 b = clusterOf[mesh.indices[i + 1]];
+      quint32 c = clusterOf[mesh.indices[i + 2]];
+      if (a != b && b != c && c != a) indices.insert(indices.end(), {a, b, c});
+    }
+    if (indices.size() / 3 <= maxTriangles || resolution == 1) break;
+    resolution = std::max(1, resolution * 7 / 10);
+  }
+
+  // Every cluster that is still used becomes the average of its vertices
+  std::vector<QVector3D> sums(cells.size());
+  std::vector<float> counts(cells.size());
+  for (size_t v = 0; v < mesh.positions.size(); ++v) {
+    sums[clusterOf[v]] += mesh.positions[v];
+    counts[clusterOf[v]] += 1;
+  }
+  std::vector<quint32> renumbered(cells.size(), UINT32_MAX);
+  mesh.positions.clear();
+  for (quint32 &index : indices) {
+    if (renumbered[index] == UINT32_MAX) {
+      renumbered[index] = mesh.positions.size();
+      mesh.positions.push_back(sums[index] / counts[index]);
+    }
+    index = renumbered[index];
+  }
+  mesh.indices = std::move(indices);
+  return cellSize * std::sqrt(3.0f);
+}
+}  // namespace
+
+/**
+ * @brief ChunkFile::write Splits an indexed triangle mesh into an octree,
+ * and writes the original triangles of every leaf and a simplified mesh of
+ * every inner node as a chunk file.
+ *
+ * Only the tree itself, one entry per chunk, is kept in memory. The order of
+ * the triangles and the renumbering of the vertices live in temporary files
+ * next to the output, and the payloads are written as soon as they are built,
+ * children before their parent. An inner node simplifies the chunks of its
+ * children, so no chunk ever needs more than eight chunks of input.
+ *
+ * @param filename The file to write.
+ * @param coords The unique vertex coordinates.
+ * @param indices Three indices into coords per triangle.
+ * @param maxTriangles Maximum number of triangles per chunk.
+ * @return Whether the file was written.
+ */
+bool ChunkFile::write(const QString &filename, Span<const QVector3D> coords,
+                      Span<const unsigned> indices, unsigned maxTriangles) {
+  size_t triangleCount = indices.size() / 3;
+  maxTriangles = std::max(1u, maxTriangles);
+
+  QString directory = QFileInfo(filename).absolutePath();
+  ScratchArray<quint32> triangles;  // ordered by node
+  ScratchArray<quint32> localIndex;  // index in the current chunk, plus one
+  if (!triangles.allocate(directory, triangleCount) ||
+      !localIndex.allocate(directory, coords.size())) {
+    qWarning() << ":: Cannot create temporary files in" << directory;
+    return false;
+  }
+
+  Bounds meshBounds;
+  for (size_t t = 0; t < triangleCount; ++t) {
+    triangles[t] = t;
+    for (int corner = 0; corner < 3; ++corner) meshBounds.extend(coords[indices[3 * t + corner]]);
+  }
+
+  // Build the tree breadth first, so that the children of every node are
+  // next to each other, and sort the triangles by node along the way
+  struct Node {
+    Bounds cell;
+    size_t begin, end;  // range of triangles
+    int depth;
+    quint32 firstChild = 0;
+    quint32 childCount = 0;
+  };
+  std::vector<Node> nodes;
+  nodes.push_back({meshBounds, 0, triangleCount, 0});
+
+  for (size_t n = 0; n < nodes.size(); ++n) {
+    while (nodes[n].end - nodes[n].begin > maxTriangles) {
+      Node node = nodes[n];
+      std::vector<Node> children;
+      if (node.depth >= maxDepth) {
+        size_t middle = node.begin + (node.end - node.begin) / 2;
+        children.push_back({node.cell, node.begin, middle, node.depth});
+        children.push_back({node.cell, middle, node.end, node.depth});
+      } else {
+        // Sum of the corners, compared with three times the center, is
+        // comparing the centroid with the center
+        QVector3D center3 = 3 * node.cell.center();
+        auto octant = [&](quint32 t) {
+          QVector3D c = coords[indices[3 * t]] + coords[indices[3 * t + 1]] +
+                        coords[indices[3 * t + 2]];
+          return (c.x() > center3.x()) | (c.y() > center3.y()) << 1 | (c.z() > center3.z()) << 2;
+        };
+
+        // Sort the range into the eight octants in place
+        size_t starts[9] = {};
+        for (size_t i = node.begin; i < node.end; ++i) starts[octant(triangles[i]) + 1]++;
+        starts[0] = node.begin;
+        for (int child = 0; child < 8; ++child) starts[child + 1] += starts[child];
+        size_t next[8];
+        std::copy(starts, starts + 8, next);
+        for (int child = 0; child < 8; ++child) {
+          while (next[child] < starts[child + 1]) {
+            int target = octant(triangles[next[child]]);
+            if (target == child) {
+              next[child]++;
+            } else {
+              std::swap(triangles[next[child]], triangles[next[target]++]);
+            }
+          }
+        }
+
+        QVector3D center = node.cell.center();
+        for (int child = 0; child < 8; ++child) {
+          if (starts[child + 1] == starts[child]) continue;
+          Bounds cell;
+          cell.min = QVector3D((child & 1) ? center.x() : node.cell.min.x(),
+                               (child & 2) ? center.y() : node.cell.min.y(),
+                               (child & 4) ? center.z() : node.cell.min.z());
+          cell.max = QVector3D((child & 1) ? node.cell.max.x() : center.x(),
+                               (child & 2) ? node.cell.max.y() : center.y(),
+                               (child & 4) ? node.cell.max.z() : center.z());
+          children.push_back({cell, starts[child], starts[child + 1], node.depth + 1});
+        }
+      }
+
+      // A node with a single child would only repeat it; descend instead
+      if (children.size() == 1) {
+        nodes[n] = children[0];
+        continue;
+      }
+      nodes[n].firstChild = nodes.size();
+      nodes[n].childCount = children.size();
+      nodes.insert(nodes.end(), children.begin(), children.end());
+      break;
+    }
+  }
+
+  QFile file(filename);
+  if (!file.open(QIODevice::WriteOnly)) {
+    qWarning() << ":: Cannot write" << filename;
+    return false;
+  }
+
+  // Write the payloads after the (for now empty) table, children first
+  std::vector<ChunkInfo> table(nodes.size());
+  file.seek(headerSize + table.size() * entrySize);
+  QDataStream out(&file);
+  prepareStream(out);
+
+  std::function<ChunkMesh(size_t)> build = [&](size_t n) {
+    const Node &node = nodes[n];
+    ChunkInfo &chunk = table[n];
+    ChunkMesh mesh;
+
+    if (node.childCount == 0) {
+      // The original triangles, with the vertices renumbered for the chunk
+      for (size_t i = node.begin; i < node.end; ++i) {
+        for (int corner = 0; corner < 3; ++corner) {
+          unsigned index = indices[3 * triangles[i] + corner];
+          if (localIndex[index] == 0) {
+            mesh.positions.push_back(coords[index]);
+            localIndex[index] = mesh.positions.size();
+            chunk.bounds.extend(coords[index]);
+          }
+          mesh.indices.push_back(localIndex[index] - 1);
+        }
+      }
+      for (size_t i = node.begin; i < node.end; ++i) {
+        for (int corner = 0; corner < 3; ++corner) localIndex[indices[3 * triangles[i] + corner]] = 0;
+      }
+      chunk.error = 0;
+    } else {
+      // A simplified copy of the children together
+      for (quint32 child = node.firstChild; child < node.firstChild + node.childCount; ++child) {
+        ChunkMesh part = build(child);
+        chunk.bounds.extend(table[child].bounds.min);
+        chunk.bounds.extend(table[child].bounds.max);
+        quint32 base = mesh.positions.size();
+        mesh.positions.insert(mesh.positions.end(), part.positions.begin(), part.positions.end());
+        for (quint32 index : part.indices) mesh.indices.push_back(base + index);
+      }
+      chunk.error = simplify(mesh, chunk.bounds, maxTriangles);
+    }
+
+    chunk.offset = file.pos();
+    chunk.vertexCount = mesh.positions.size();
+    chunk.indexCount = mesh.indices.size();
+    chunk.firstChild = node.firstChild;
+    chunk.childCount = node.childCount;
+    for (const QVector3D &p : mesh.positions) out << p.x() << p.y() << p.z();
+    for (quint32 index : mesh.indices) out << index;
+    return mesh;
+  };
+  build(0);
+
+  file.seek(0);
+  out.writeRawData(magic, sizeof(magic));
+  out << quint32(table.size()) << quint32(0) << quint32(0) << meshBounds;
+  for (const ChunkInfo &chunk : table) {
+    out << chunk.bounds << chunk.offset << chunk.vertexCount << chunk.indexCount
+        << chunk.error << chunk.firstChild << chunk.childCount;
+  }
+
+  qDebug() << ":: Wrote" << table.size() << "chunks to" << filename;
+  return out.status() == QDataStream::Ok;
+}
+
+/**
+ * @brief ChunkFile::open Reads the header and chunk table of a chunk file,
+ * and checks that every chunk lies within the file and that the chunks form
+ * a tree.
+ * @param filename The file to open.
+ * @return Whether the file is a valid chunk file.
+ */
+bool ChunkFile::open(const QString &filename) {
+  chunkTable.clear();
+  rootChunks.clear();
+
+  QFile file(filename);
+  if (!file.open(QIODevice::ReadOnly)) {
+    qWarning() << ":: Cannot open" << filename;
+    return false;
+  }
+
+  QDataStream in(&file);
+  prepareStream(in);
+
+  char fileMagic[sizeof(magic)];
+  quint32 chunkCount, reserved0, reserved1;
+  in.readRawData(fileMagic, sizeof(fileMagic));
+  in >> chunkCount >> reserved0 >> reserved1 >> meshBounds;
+  bool version1 = std::equal(magicVersion1, magicVersion1 + sizeof(magic), fileMagic);
+  if (in.status() != QDataStream::Ok ||
+      (!version1 && !std::equal(magic, magic + sizeof(magic), fileMagic))) {
+    qWarning() << ":: Not a chunk file:" << filename;
+    return false;
+  }
+
+  // Check the size of the table before allocating it
+  quint64 fileSize = file.size();
+  quint64 payloadStart = headerSize + quint64(chunkCount) * (version1 ? entrySizeVersion1 : entrySize);
+  if (payloadStart > fileSize) {
+    qWarning() << ":: Truncated chunk table in" << filename;
+    return false;
+  }
+
+  std::vector<ChunkInfo> table(chunkCount);
+  for (ChunkInfo &chunk : table) {
+    in >> chunk.bounds >> chunk.offset >> chunk.vertexCount >> chunk.indexCount;
+    if (version1) {
+      chunk.error = 0;
+      chunk.firstChild = chunk.childCount = 0;
+    } else {
+      in >> chunk.error >> chunk.firstChild >> chunk.childCount;
+    }
+  }
+  if (in.status() != QDataStream::Ok) {
+    qWarning() << ":: Truncated chunk table in" << filename;
+    return false;
+  }
+
+  // Every payload must lie after the table and within the file, and every
+  // chunk must have at most one parent that comes before it
+  std::vector<bool> hasParent(chunkCount, false);
+  for (quint32 i = 0; i < chunkCount; ++i) {
+    const ChunkInfo &chunk = table[i];
+    bool valid = chunk.indexCount % 3 == 0 && chunk.offset >= payloadStart &&
+                 chunk.offset <= fileSize && chunk.payloadSize() <= fileSize - chunk.offset;
+    if (chunk.childCount > 0) {
+      valid = valid && chunk.firstChild > i &&
+              quint64(chunk.firstChild) + chunk.childCount <= chunkCount;
+      for (quint32 child = 0; valid && child < chunk.childCount; ++child) {
+        valid = !hasParent[chunk.firstChild + child];
+        hasParent[chunk.firstChild + child] = true;
+      }
+    }
+    if (!valid) {
+      qWarning() << ":: Corrupt chunk" << i << "in" << filename;
+      return false;
+    }
+  }
+
+  chunkTable = std::move(table);
+  maxVertices = maxIndices = 0;
+  for (quint32 i = 0; i < chunkCount; ++i) {
+    maxVertices = std::max(maxVertices, chunkTable[i].vertexCount);
+    maxIndices = std::max(maxIndices, chunkTable[i].indexCount);
+    if (!hasParent[i]) rootChunks.push_back(i);
+  }
+
+  path = filename;
+  return true;
+}
+
+/**
+ * @brief ChunkFile::readChunk Reads the payload of a chunk, and checks that
+ * its indices refer to its own vertices.
+ * @param file The chunk file, opened for reading.
+ * @param chunk The chunk to read.
+ * @param out Destination with room for chunk.payloadSize() bytes.
+ * @return Whether the whole payload was read and is valid.
+ */
+bool ChunkFile::readChunk(QFile &file, const ChunkInfo &chunk, char *out) {
+  qint64 size = chunk.payloadSize();
+  if (!file.seek(chunk.offset) || file.read(out, size) != size) return false;
+
+  const char *indices = out + chunk.vertexCount * 12ull;
+  for (quint32 i = 0; i < chunk.indexCount; ++i) {
+    if (qFromLittleEndian<quint32>(indices + 4 * i) >= chunk.vertexCount) return false;
+  }
+  return true;
+}
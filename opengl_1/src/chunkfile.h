@@ -0,0 +1,81 @@
+#ifndef CHUNKFILE_H
+#define CHUNKFILE_H
+
+#include <QFile>
+#include <QString>
+#include <QVector3D>
+
+#include <vector>
+
+#include "bounds.h"
+#include "span.h"
+
+/**
+ * @brief A piece of a chunked mesh: a self-contained indexed triangle list of
+ * bounded size, covering one octree node.
+ *
+ * A leaf holds the original triangles of its node. An inner node holds a
+ * simplified version of all triangles below it, as a stand-in for children
+ * that are not loaded or too small on screen to be worth loading.
+ */
+struct ChunkInfo {
+  Bounds bounds;   // contains the bounds of all children
+  quint64 offset;  // of the payload in the file
+  quint32 vertexCount;
+  quint32 indexCount;
+  float error;     // how far the simplified surface may be off; 0 for leaves
+  quint32 firstChild;
+  quint32 childCount;  // the children are stored one after the other
+
+  // Payload layout: vertexCount float3 positions, then indexCount uint32
+  quint64 payloadSize() const { return vertexCount * 12ull + indexCount * 4ull; }
+};
+
+/**
+ * @brief The ChunkFile class reads and writes meshes split into chunks along
+ * an octree, so that a viewer can page them in and out independently.
+ *
+ * The file starts with a small header and a table of all chunks, followed by
+ * the chunk payloads. The chunks form a tree: every octree node has a chunk,
+ * and the children of a chunk always come after it in the table. Opening a
+ * file only reads and checks the table; payloads are read on demand with
+ * readChunk(). All values are stored little-endian.
+ *
+ * Files of the first version, which only have the leaves, can still be
+ * opened; every chunk is a root then.
+ */
+class ChunkFile {
+ public:
+  // Splits a mesh into chunks of at most maxTriangles triangles and writes
+  // it, with a simplified chunk for every inner node. coords and indices may
+  // be mapped files: the bookkeeping of the split is kept in temporary files
+  // next to the output, so meshes larger than memory can be chunked.
+  static bool write(const QString &filename, Span<const QVector3D> coords,
+                    Span<const unsigned> indices, unsigned maxTriangles = 32768);
+
+  bool open(const QString &filename);
+
+  QString fileName() const { return path; }
+  const Bounds &bounds() const { return meshBounds; }
+  const std::vector<ChunkInfo> &chunks() const { return chunkTable; }
+  // Chunks that are no other chunk's child
+  const std::vector<int> &roots() const { return rootChunks; }
+
+  // Largest payload of any chunk, so buffers can be sized up front
+  quint32 maxVertexCount() const { return maxVertices; }
+  quint32 maxIndexCount() const { return maxIndices; }
+
+  // Reads the payload of a chunk from an already opened file into out, and
+  // checks its indices
+  static bool readChunk(QFile &file, const ChunkInfo &chunk, char *out);
+
+ private:
+  QString path;
+  Bounds meshBounds;
+  std::vector<ChunkInfo> chunkTable;
+  std::vector<int> rootChunks;
+  quint32 maxVertices = 0;
+  quint32 maxIndices = 0;
+};
+
+#endif  // CHUNKFILE_H
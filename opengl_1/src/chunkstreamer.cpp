@@ -0,0 +1,375 @@
+#include "chunkstreamer.h"
+
+#include <QDebug>
+#include <QtEndian>
+
+#include <algorithm>
+#include <cstring>
+
+/**
+ * @brief ChunkStreamer::ChunkStreamer Constructs a streamer without a file.
+ */
+ChunkStreamer::ChunkStreamer() {}
+
+/**
+ * @brief ChunkStreamer::~ChunkStreamer Stops the loader thread. GPU resources
+ * must have been released with releaseGL().
+ */
+ChunkStreamer::~ChunkStreamer() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    quit = true;
+  }
+  wake.notify_all();
+  if (loader.joinable()) loader.join();
+}
+
+/**
+ * @brief ChunkStreamer::open Reads the chunk table and starts the loader.
+ * @param filename The chunk file, see ChunkFile.
+ * @return Whether the file could be opened.
+ */
+bool ChunkStreamer::open(const QString &filename) {
+  if (!file.open(filename)) return false;
+
+  size_t count = file.chunks().size();
+  chunkSlots.assign(count, -1);
+  requested.assign(count, false);
+  wanted.assign(count, false);
+  broken.assign(count, false);
+  selection.assign(count, Skipped);
+  screenSizes.assign(count, 0);
+
+  size_t stagingSize = file.maxVertexCount() * 12ull + file.maxIndexCount() * 4ull;
+  stagingBuffers.assign(maxInFlight, std::vector<char>(stagingSize));
+
+  qDebug() << ":: Streaming" << count << "chunks in" << file.roots().size()
+           << "trees from" << filename;
+  loader = std::thread(&ChunkStreamer::loaderLoop, this);
+  return true;
+}
+
+/**
+ * @brief ChunkStreamer::initializeGL Allocates the pool of buffer slots, each
+ * large enough for the largest chunk.
+ * @param resources Resources of the current context.
+ * @param poolBytes Budget for all slots together.
+ */
+void ChunkStreamer::initializeGL(GpuResources &resources, size_t poolBytes) {
+  gl = resources.functions();
+
+  GLsizeiptr vertexBytes = file.maxVertexCount() * 8;
+  GLsizeiptr indexBytes = file.maxIndexCount() * 4;
+  size_t slotCount = std::max<size_t>(1, poolBytes / std::max<size_t>(1, vertexBytes + indexBytes));
+  slots.resize(std::min(slotCount, file.chunks().size()));
+
+  for (size_t i = 0; i < slots.size(); ++i) {
+    Slot &slot = slots[i];
+    QString label = QString("chunk slot %1").arg(i);
+    slot.vao = resources.createVertexArray(GpuResources::Streaming, label);
+    slot.vbo = resources.createBuffer(GpuResources::Streaming, label + " vertices");
+    slot.ebo = resources.createBuffer(GpuResources::Streaming, label + " indices");
+
+    gl->glBindVertexArray(slot.vao.id());
+    resources.bufferData(slot.vbo, GL_ARRAY_BUFFER, vertexBytes, nullptr, GL_DYNAMIC_DRAW);
+    resources.bufferData(slot.ebo, GL_ELEMENT_ARRAY_BUFFER, indexBytes, nullptr, GL_DYNAMIC_DRAW);
+    gl->glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, 8, (void *)0);
+    gl->glEnableVertexAttribArray(0);
+  }
+  gl->glBindVertexArray(0);
+
+  qDebug() << ":: Chunk pool:" << slots.size() << "slots of"
+           << (vertexBytes + indexBytes) / 1024 << "KiB";
+}
+
+/**
+ * @brief ChunkStreamer::releaseGL Deletes the buffer slots.
+ */
+void ChunkStreamer::releaseGL() {
+  if (!gl) return;
+  // The handles delete the buffers
+  slots.clear();
+  gl = nullptr;
+}
+
+/**
+ * @brief ChunkStreamer::update Decides which chunks should be resident,
+ * requests the missing ones and uploads those the loader has finished.
+ * Never waits for I/O.
+ * @param projection The projection transformation.
+ * @param modelTransform Transformation of the whole mesh.
+ * @param viewportHeight Height of the viewport in pixels.
+ */
+void ChunkStreamer::update(const QMatrix4x4 &projection,
+                           const QMatrix4x4 &modelTransform,
+                           int viewportHeight) {
+  if (!gl) return;
+  frame++;
+
+  Frustum frustum(projection * modelTransform);
+  float scale = modelTransform.column(0).toVector3D().length();
+  float pixelsPerUnit = 0.5f * viewportHeight * projection(1, 1);
+
+  std::fill(wanted.begin(), wanted.end(), false);
+  std::fill(selection.begin(), selection.end(), Skipped);
+  candidates.clear();
+  for (int root : file.roots()) {
+    select(root, frustum, modelTransform, scale, pixelsPerUnit, viewportHeight);
+  }
+
+  // Rank the chunks by their size on screen: a chunk that is not drawn
+  // leaves a hole of that size, so this is its screen-space error. A chunk
+  // is always larger than its children, so it is requested before them.
+  size_t budget = std::min(candidates.size(), slots.size());
+  std::partial_sort(candidates.begin(), candidates.begin() + budget, candidates.end(),
+                    [this](int a, int b) { return screenSizes[a] > screenSizes[b]; });
+  candidates.resize(budget);
+
+  // Request the most important missing chunks first
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (int chunk : candidates) {
+      wanted[chunk] = true;
+      if (chunkSlots[chunk] < 0 && !requested[chunk] && inFlight < maxInFlight) {
+        requested[chunk] = true;
+        requests.push_back(chunk);
+        inFlight++;
+      }
+    }
+  }
+  wake.notify_one();
+
+  // Upload a bounded number of finished chunks
+  for (int uploads = 0; uploads < maxUploadsPerFrame; ++uploads) {
+    Loaded loaded;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (finished.empty()) break;
+      loaded = std::move(finished.front());
+      finished.pop_front();
+    }
+    upload(loaded);
+    if (!loaded.ok) broken[loaded.chunk] = true;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    requested[loaded.chunk] = false;
+    inFlight--;
+    stagingBuffers.push_back(std::move(loaded.data));
+  }
+
+  drawList.clear();
+  for (int root : file.roots()) {
+    addToDrawList(root);
+  }
+}
+
+/**
+ * @brief ChunkStreamer::select Decides whether a visible chunk is drawn as
+ * it is or refined into its children, and adds it and the chunks below it
+ * that are worth loading to the candidates.
+ * @param chunk The chunk.
+ * @param frustum View frustum in the space of the mesh.
+ * @param modelTransform Transformation of the whole mesh.
+ * @param scale Scale of the model transformation.
+ * @param pixelsPerUnit Pixels per unit of length at a distance of 1.
+ * @param viewportHeight Height of the viewport in pixels.
+ */
+void ChunkStreamer::select(int chunk, const Frustum &frustum,
+                           const QMatrix4x4 &modelTransform, float scale,
+                           float pixelsPerUnit, int viewportHeight) {
+  const ChunkInfo &info = file.chunks()[chunk];
+  float radius = info.bounds.radius();
+  if (!frustum.intersectsSphere(info.bounds.center(), radius)) return;
+
+  float depth = -modelTransform.map(info.bounds.center()).z();
+  float nearest = depth - radius * scale;  // of the bounding sphere
+  bool inside = nearest <= 0;
+  float size = inside ? float(viewportHeight) : 2 * radius * scale * pixelsPerUnit / depth;
+  if (size < minimumPixelSize) return;
+
+  // A broken chunk is still selected, so that its parent stands in for it,
+  // but it takes no place in the pool
+  screenSizes[chunk] = size;
+  if (!broken[chunk]) candidates.push_back(chunk);
+
+  bool refine = info.childCount > 0 &&
+                (inside || info.error * scale * pixelsPerUnit / nearest > maxPixelError);
+  if (!refine) {
+    selection[chunk] = Selected;
+    return;
+  }
+
+  selection[chunk] = Refined;
+  for (quint32 child = info.firstChild; child < info.firstChild + info.childCount; ++child) {
+    select(child, frustum, modelTransform, scale, pixelsPerUnit, viewportHeight);
+  }
+}
+
+/**
+ * @brief ChunkStreamer::addToDrawList Adds the resident chunks that cover a
+ * selected chunk to the draw list. A refined chunk is drawn as its children
+ * only if they cover all of it; otherwise it stands in for them, if it is
+ * resident itself.
+ * @param chunk The chunk.
+ * @return Whether all of the chunk is covered.
+ */
+bool ChunkStreamer::addToDrawList(int chunk) {
+  if (selection[chunk] == Skipped) return true;
+
+  int slot = chunkSlots[chunk];
+  if (selection[chunk] == Refined) {
+    size_t start = drawList.size();
+    bool complete = true;
+    const ChunkInfo &info = file.chunks()[chunk];
+    for (quint32 child = info.firstChild; child < info.firstChild + info.childCount; ++child) {
+      complete = addToDrawList(child) && complete;
+    }
+    if (complete) return true;
+    // Without a stand-in, draw the part of the children that is there
+    if (slot < 0) return false;
+    drawList.resize(start);
+  } else if (slot < 0) {
+    return false;
+  }
+
+  slots[slot].lastUsed = frame;
+  drawList.push_back(slot);
+  return true;
+}
+
+/**
+ * @brief ChunkStreamer::upload Copies a loaded chunk into a buffer slot, if
+ * it is still wanted.
+ * @param loaded The chunk and its payload.
+ */
+void ChunkStreamer::upload(Loaded &loaded) {
+  if (!loaded.ok || !wanted[loaded.chunk]) return;
+
+  int slotIndex = acquireSlot();
+  if (slotIndex < 0) return;
+
+  const ChunkInfo &chunk = file.chunks()[loaded.chunk];
+  Slot &slot = slots[slotIndex];
+  gl->glBindBuffer(GL_ARRAY_BUFFER, slot.vbo.id());
+  gl->glBufferSubData(GL_ARRAY_BUFFER, 0, chunk.vertexCount * 8, loaded.data.data());
+  gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, slot.ebo.id());
+  gl->glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, chunk.indexCount * 4,
+                      loaded.data.data() + chunk.vertexCount * 12);
+
+  slot.chunk = loaded.chunk;
+  slot.lastUsed = frame;
+  chunkSlots[loaded.chunk] = slotIndex;
+  resident++;
+}
+
+/**
+ * @brief ChunkStreamer::acquireSlot Finds a free slot, or evicts the least
+ * recently used chunk that is not wanted this frame.
+ * @return The slot index, or -1 if all slots hold wanted chunks.
+ */
+int ChunkStreamer::acquireSlot() {
+  int best = -1;
+  for (size_t i = 0; i < slots.size(); ++i) {
+    if (slots[i].chunk < 0) return i;
+    if (wanted[slots[i].chunk]) continue;
+    if (best < 0 || slots[i].lastUsed < slots[best].lastUsed) best = i;
+  }
+
+  if (best >= 0) {
+    chunkSlots[slots[best].chunk] = -1;
+    slots[best].chunk = -1;
+    resident--;
+  }
+  return best;
+}
+
+/**
+ * @brief ChunkStreamer::draw Draws the resident chunks selected by the last
+ * update. The caller binds the program and sets the uniforms.
+ */
+void ChunkStreamer::draw() {
+  for (int slotIndex : drawList) {
+    const Slot &slot = slots[slotIndex];
+    gl->glBindVertexArray(slot.vao.id());
+    gl->glDrawElements(GL_TRIANGLES, file.chunks()[slot.chunk].indexCount,
+                       GL_UNSIGNED_INT, nullptr);
+  }
+}
+
+/**
+ * @brief ChunkStreamer::setQuantizationUniforms Sets the uniforms that map
+ * the quantized positions back into the space of the mesh.
+ * @param program A bound QuantizedInput shader variant.
+ */
+void ChunkStreamer::setQuantizationUniforms(QOpenGLShaderProgram *program) const {
+  const Bounds &bounds = file.bounds();
+  program->setUniformValue("quantizationScale", bounds.max - bounds.min);
+  program->setUniformValue("quantizationOffset", bounds.min);
+}
+
+/**
+ * @brief ChunkStreamer::loaderLoop Reads requested chunks into staging
+ * buffers on the loader thread.
+ */
+void ChunkStreamer::loaderLoop() {
+  QFile input(file.fileName());
+  if (!input.open(QIODevice::ReadOnly)) {
+    qWarning() << ":: Loader cannot open" << file.fileName();
+  }
+
+  while (true) {
+    int chunk;
+    std::vector<char> buffer;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [this] { return quit || !requests.empty(); });
+      if (quit) return;
+      chunk = requests.front();
+      requests.pop_front();
+      // There is a staging buffer for every request in flight
+      buffer = std::move(stagingBuffers.back());
+      stagingBuffers.pop_back();
+    }
+
+    const ChunkInfo &info = file.chunks()[chunk];
+    bool ok = ChunkFile::readChunk(input, info, buffer.data());
+    if (ok) {
+      quantize(buffer.data(), info.vertexCount);
+    } else {
+      qWarning() << ":: Failed to read chunk" << chunk;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    finished.push_back({chunk, ok, std::move(buffer)});
+  }
+}
+
+/**
+ * @brief ChunkStreamer::quantize Replaces the float positions at the start of
+ * a payload with four 16-bit integers per vertex, the last one padding. Runs
+ * on the loader thread; the indices after the positions stay where they are.
+ * @param payload The payload as read by ChunkFile::readChunk().
+ * @param vertexCount Number of positions in the payload.
+ */
+void ChunkStreamer::quantize(char *payload, quint32 vertexCount) const {
+  const Bounds &bounds = file.bounds();
+  float min[3] = {bounds.min.x(), bounds.min.y(), bounds.min.z()};
+  float scale[3];
+  for (int axis = 0; axis < 3; ++axis) {
+    float extent = bounds.max[axis] - bounds.min[axis];
+    scale[axis] = extent > 0 ? 65535 / extent : 0;
+  }
+
+  // Vertex i is written to the first 8 of its own 12 bytes or to bytes of
+  // earlier vertices, so it is read before anything overwrites it
+  for (quint32 i = 0; i < vertexCount; ++i) {
+    quint16 quantized[4] = {0, 0, 0, 0};
+    for (int axis = 0; axis < 3; ++axis) {
+      float value = qFromLittleEndian<float>(payload + 12 * i + 4 * axis);
+      // The table is not trusted to bound its chunks; this also maps NaN to 0
+      float q = (value - min[axis]) * scale[axis] + 0.5f;
+      quantized[axis] = quint16(q > 0 ? std::min(q, 65535.0f) : 0);
+    }
+    std::memcpy(payload + 8 * i, quantized, sizeof(quantized));
+  }
+}
@@ -0,0 +1,127 @@
+#ifndef CHUNKSTREAMER_H
+#define CHUNKSTREAMER_H
+
+#include <QMatrix4x4>
+#include <QOpenGLFunctions_3_3_Core>
+#include <QOpenGLShaderProgram>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "chunkfile.h"
+#include "frustum.h"
+#include "gpuresources.h"
+
+/**
+ * @brief The ChunkStreamer class renders a chunk file that may be far larger
+ * than system or video memory.
+ *
+ * Chunks live in a fixed pool of GPU buffer slots. Every frame, the chunk
+ * tree is walked from the roots: a chunk is refined into its children while
+ * its simplification error covers more than maxPixelError pixels on screen.
+ * The chunks on the way are ranked by their size on screen, and the ones that
+ * fit in the pool are requested, so coarse chunks are always loaded before
+ * their children. A loader thread reads them into a fixed number of staging
+ * buffers, and the OpenGL thread uploads a few finished ones per frame,
+ * evicting the least recently used chunks that are no longer wanted.
+ *
+ * A chunk is only drawn as its children once all of them are resident;
+ * until then the coarser chunk stands in for them, and so it does for a
+ * chunk that could not be read, which is not requested again. Memory use
+ * therefore only depends on the pool size, never on the dataset.
+ *
+ * The loader quantizes the positions to normalized 16-bit integers inside
+ * bounds(), padded to 8 bytes per vertex instead of 12. All chunks share that
+ * grid, so vertices on the border of two chunks stay welded. Draw them with
+ * the QuantizedInput shader variant.
+ */
+class ChunkStreamer {
+ public:
+  ChunkStreamer();
+  ~ChunkStreamer();
+
+  bool open(const QString &filename);
+  const Bounds &bounds() const { return file.bounds(); }
+
+  // Requires a current context; poolBytes is the GPU memory budget
+  void initializeGL(GpuResources &resources, size_t poolBytes);
+  void releaseGL();
+
+  // Selects and requests chunks and uploads finished ones
+  void update(const QMatrix4x4 &projection, const QMatrix4x4 &modelTransform,
+              int viewportHeight);
+  // Draws the resident chunks selected by the last update
+  void draw();
+  // Sets the uniforms of the QuantizedInput variant for the streamed mesh
+  void setQuantizationUniforms(QOpenGLShaderProgram *program) const;
+
+  int residentCount() const { return resident; }
+  int pendingCount() const { return inFlight; }
+  int drawnCount() const { return drawList.size(); }
+
+  // Chunks smaller than this on screen are not worth loading
+  float minimumPixelSize = 8.0f;
+  // Chunks whose error is larger than this on screen are refined
+  float maxPixelError = 2.0f;
+  // Limits the time spent in glBufferSubData per frame
+  int maxUploadsPerFrame = 4;
+
+ private:
+  struct Slot {
+    GpuHandle vao;
+    GpuHandle vbo;
+    GpuHandle ebo;
+    int chunk = -1;
+    quint64 lastUsed = 0;
+  };
+
+  struct Loaded {
+    int chunk;
+    bool ok;
+    std::vector<char> data;
+  };
+
+  // How a chunk was handled by the last update
+  enum Selection : unsigned char { Skipped, Selected, Refined };
+
+  void select(int chunk, const Frustum &frustum, const QMatrix4x4 &modelTransform,
+              float scale, float pixelsPerUnit, int viewportHeight);
+  bool addToDrawList(int chunk);
+
+  void loaderLoop();
+  void quantize(char *payload, quint32 vertexCount) const;
+  void upload(Loaded &loaded);
+  int acquireSlot();
+
+  ChunkFile file;
+  QOpenGLFunctions_3_3_Core *gl = nullptr;
+
+  std::vector<Slot> slots;
+  std::vector<int> chunkSlots;  // slot of every chunk, or -1
+  std::vector<bool> requested;  // per chunk, in flight to or from the loader
+  std::vector<bool> wanted;     // per chunk, to be resident after the last update
+  std::vector<bool> broken;     // per chunk, failed to read; never requested again
+  std::vector<Selection> selection;
+  std::vector<float> screenSizes;
+  std::vector<int> candidates;
+  std::vector<int> drawList;  // slots
+  quint64 frame = 0;
+  int resident = 0;
+  int inFlight = 0;
+
+  // Shared with the loader thread
+  std::thread loader;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::deque<int> requests;
+  std::deque<Loaded> finished;
+  std::vector<std::vector<char>> stagingBuffers;
+  bool quit = false;
+
+  static const int maxInFlight = 4;
+};
+
+#endif  // CHUNKSTREAMER_H
@@ -0,0 +1,263 @@
+#include "frameplanner.h"
+
+#include <QElapsedTimer>
+
+#include <algorithm>
+#include <atomic>
+
+#include "frustum.h"
+
+namespace {
+// Number of objects handled by a single job
+const size_t grain = 512;
+}  // namespace
+
+/**
+ * @brief FramePlanner::FramePlanner Constructs a planner.
+ * @param jobs Job system the stages run on.
+ */
+FramePlanner::FramePlanner(JobSystem &jobs) : jobs(jobs) {}
+
+/**
+ * @brief FramePlanner::plan Runs all stages for the current state of the
+ * scene. Afterwards commands() holds the draws of this frame.
+ * @param scene The scene. Its transformations are updated.
+ * @param projection The projection transformation.
+ * @param viewportHeight Height of the viewport in pixels.
+ */
+void FramePlanner::plan(Scene &scene, const QMatrix4x4 &projection,
+                        int viewportHeight) {
+  QElapsedTimer timer;
+  timer.start();
+
+  size_t count = scene.objectCount();
+  depths.resize(count);
+  radii.resize(count);
+  visibility.resize(count);
+
+  updateTransforms(scene);
+  cull(scene, projection);
+  selectLod(scene, projection, viewportHeight);
+  compact();
+  sort();
+  buildCommands(scene);
+  cullMeshlets(scene, projection);
+
+  frustumCulledCount = std::count(visibility.begin(), visibility.end(), FrustumCulled);
+  lodCulledCount = std::count(visibility.begin(), visibility.end(), LodCulled);
+  planMilliseconds = timer.nsecsElapsed() / 1e6;
+}
+
+/**
+ * @brief FramePlanner::updateTransforms Recomputes the transformation matrix
+ * of every object from its position and the shared rotation and scale.
+ * @param scene The scene.
+ */
+void FramePlanner::updateTransforms(Scene &scene) {
+  QMatrix4x4 shared;
+  shared.scale(scene.scale);
+  shared.rotate(scene.rotation.x(), 1, 0, 0);
+  shared.rotate(scene.rotation.y(), 0, 1, 0);
+  shared.rotate(scene.rotation.z(), 0, 0, 1);
+
+  jobs.parallelFor(scene.objectCount(), grain, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      // Translating first only replaces the translation column
+      QMatrix4x4 &transformation = scene.transformations[i];
+      transformation = shared;
+      transformation.setColumn(3, QVector4D(scene.positions[i], 1));
+    }
+  });
+}
+
+/**
+ * @brief FramePlanner::cull Rejects objects whose bounding sphere lies
+ * outside the view frustum, and records the view depth of the others.
+ * @param scene The scene.
+ * @param projection The projection transformation.
+ */
+void FramePlanner::cull(const Scene &scene, const QMatrix4x4 &projection) {
+  // Objects are placed in eye space directly, so the frustum of the
+  // projection alone suffices.
+  Frustum frustum(projection);
+
+  jobs.parallelFor(scene.objectCount(), grain, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      const Bounds &bounds = scene.bounds[scene.meshes[i]];
+      QVector3D center = scene.transformations[i].map(bounds.center());
+      float radius = bounds.radius() * scene.scale;
+
+      radii[i] = radius;
+      // The camera looks down -z, so larger z is closer
+      depths[i] = -center.z();
+      visibility[i] = frustum.intersectsSphere(center, radius) ? Visible : FrustumCulled;
+    }
+  });
+}
+
+/**
+ * @brief FramePlanner::selectLod Selects the level of detail of the visible
+ * objects from their projected size. Meshes currently have a single level, so
+ * this only drops objects that would cover less than minimumPixelSize.
+ * @param scene The scene.
+ * @param projection The projection transformation.
+ * @param viewportHeight Height of the viewport in pixels.
+ */
+void FramePlanner::selectLod(const Scene &scene, const QMatrix4x4 &projection,
+                             int viewportHeight) {
+  float pixelsPerUnit = 0.5f * viewportHeight * projection(1, 1);
+
+  jobs.parallelFor(scene.objectCount(), grain, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      if (visibility[i] != Visible || depths[i] <= radii[i]) continue;
+      float pixels = 2 * radii[i] * pixelsPerUnit / depths[i];
+      if (pixels < minimumPixelSize) {
+        visibility[i] = LodCulled;
+      }
+    }
+  });
+}
+
+/**
+ * @brief FramePlanner::compact Gathers a sort key for every visible object.
+ * Each job counts its visible objects first, so the keys can be written in
+ * parallel at their final offsets.
+ */
+void FramePlanner::compact() {
+  size_t count = visibility.size();
+  chunkCounts.assign((count + grain - 1) / grain, 0);
+
+  jobs.parallelFor(count, grain, [&](size_t begin, size_t end) {
+    chunkCounts[begin / grain] =
+        std::count(visibility.begin() + begin, visibility.begin() + end, Visible);
+  });
+
+  size_t total = 0;
+  for (size_t &chunkCount : chunkCounts) {
+    size_t offset = total;
+    total += chunkCount;
+    chunkCount = offset;
+  }
+  keys.resize(total);
+
+  jobs.parallelFor(count, grain, [&](size_t begin, size_t end) {
+    size_t out = chunkCounts[begin / grain];
+    for (size_t i = begin; i < end; ++i) {
+      if (visibility[i] == Visible) {
+        keys[out++] = {depths[i], int(i)};
+      }
+    }
+  });
+}
+
+/**
+ * @brief FramePlanner::sort Sorts the visible objects front-to-back with a
+ * parallel merge sort: runs are sorted independently, then merged pairwise.
+ */
+void FramePlanner::sort() {
+  size_t count = keys.size();
+  size_t run = std::max(grain, (count + jobs.threadCount() - 1) / jobs.threadCount());
+
+  jobs.parallelFor(count, run, [&](size_t begin, size_t end) {
+    std::sort(keys.begin() + begin, keys.begin() + end);
+  });
+
+  sortScratch.resize(count);
+  for (; run < count; run *= 2) {
+    jobs.parallelFor(count, 2 * run, [&](size_t begin, size_t end) {
+      size_t middle = std::min(begin + run, end);
+      std::merge(keys.begin() + begin, keys.begin() + middle,
+                 keys.begin() + middle, keys.begin() + end,
+                 sortScratch.begin() + begin);
+    });
+    keys.swap(sortScratch);
+  }
+}
+
+/**
+ * @brief FramePlanner::buildCommands Writes the final draw commands in sorted
+ * order.
+ * @param scene The scene.
+ */
+void FramePlanner::buildCommands(const Scene &scene) {
+  drawCommands.resize(keys.size());
+
+  jobs.parallelFor(keys.size(), grain, [&](size_t begin, size_t end) {
+    for (size_t k = begin; k < end; ++k) {
+      int object = keys[k].object;
+      int mesh = scene.meshes[object];
+      drawCommands[k] = {object, mesh, scene.shaderFeatures[mesh],
+                         scene.transformations[object], 0, 0};
+    }
+  });
+}
+
+/**
+ * @brief FramePlanner::cullMeshlets Selects the index ranges to draw for every
+ * command of an indexed mesh. Meshlets outside the frustum or whose triangles
+ * all face away from the camera are left out, and adjacent survivors are
+ * merged into a single range.
+ * @param scene The scene.
+ * @param projection The projection transformation.
+ */
+void FramePlanner::cullMeshlets(const Scene &scene, const QMatrix4x4 &projection) {
+  // Every command gets room for one range per meshlet
+  size_t slots = 0;
+  for (DrawCommand &command : drawCommands) {
+    command.firstRange = slots;
+    if (scene.indexCounts[command.mesh] > 0) {
+      slots += std::max<size_t>(1, scene.meshlets[command.mesh].size());
+    }
+  }
+  indexCounts.resize(slots);
+  indexOffsets.resize(slots);
+
+  std::atomic<int> culled{0};
+
+  jobs.parallelFor(drawCommands.size(), grain / 8, [&](size_t begin, size_t end) {
+    int jobCulled = 0;
+
+    for (size_t k = begin; k < end; ++k) {
+      DrawCommand &command = drawCommands[k];
+      int indexCount = scene.indexCounts[command.mesh];
+      if (indexCount == 0) continue;
+
+      GLsizei *counts = &indexCounts[command.firstRange];
+      const void **offsets = &indexOffsets[command.firstRange];
+      const std::vector<Meshlet> &meshlets = scene.meshlets[command.mesh];
+
+      if (!meshletCulling || meshlets.empty()) {
+        counts[0] = indexCount;
+        offsets[0] = nullptr;
+        command.rangeCount = 1;
+        continue;
+      }
+
+      // Test in model space
+      Frustum frustum(projection * command.modelTransform);
+      QVector3D camera = command.modelTransform.inverted().map(QVector3D(0, 0, 0));
+
+      int ranges = 0;
+      unsigned rangeEnd = 0;
+      for (const Meshlet &meshlet : meshlets) {
+        if (!meshlet.isVisible(frustum, camera)) {
+          jobCulled++;
+          continue;
+        }
+        if (ranges > 0 && rangeEnd == meshlet.firstIndex) {
+          counts[ranges - 1] += meshlet.indexCount;
+        } else {
+          counts[ranges] = meshlet.indexCount;
+          offsets[ranges] = reinterpret_cast<const void *>(size_t(meshlet.firstIndex) * sizeof(GLuint));
+          ranges++;
+        }
+        rangeEnd = meshlet.firstIndex + meshlet.indexCount;
+      }
+      command.rangeCount = ranges;
+    }
+
+    culled += jobCulled;
+  });
+
+  meshletsCulledCount = culled;
+}
@@ -0,0 +1,94 @@
+#ifndef FRAMEPLANNER_H
+#define FRAMEPLANNER_H
+
+#include <QMatrix4x4>
+
+#include <vector>
+
+#include "jobsystem.h"
+#include "scene.h"
+
+/**
+ * @brief A single pre-built draw, replayed as-is on the OpenGL thread.
+ */
+struct DrawCommand {
+  int object;
+  int mesh;
+  unsigned features;
+  QMatrix4x4 modelTransform;
+
+  // Index ranges to draw with glMultiDrawElements(), see
+  // FramePlanner::rangeCounts(). Empty for glDrawArrays() meshes and for
+  // meshes whose meshlets were all culled.
+  int firstRange;
+  int rangeCount;
+};
+
+/**
+ * @brief The FramePlanner class prepares everything paintGL needs to issue a
+ * frame, without touching OpenGL.
+ *
+ * The frame is split in stages that each run in parallel on the job system:
+ * transform update, frustum culling, level of detail selection, sorting and
+ * meshlet culling. The result is a flat list of draw commands, front-to-back.
+ */
+class FramePlanner {
+ public:
+  explicit FramePlanner(JobSystem &jobs = JobSystem::global());
+
+  void plan(Scene &scene, const QMatrix4x4 &projection, int viewportHeight);
+
+  const std::vector<DrawCommand> &commands() const { return drawCommands; }
+  const std::vector<GLsizei> &rangeCounts() const { return indexCounts; }
+  const std::vector<const void *> &rangeOffsets() const { return indexOffsets; }
+  int frustumCulled() const { return frustumCulledCount; }
+  int lodCulled() const { return lodCulledCount; }
+  int meshletsCulled() const { return meshletsCulledCount; }
+  double milliseconds() const { return planMilliseconds; }
+
+  // Objects smaller than this on screen are not drawn
+  float minimumPixelSize = 1.0f;
+
+  // Whether meshlets outside the frustum or facing away are skipped
+  bool meshletCulling = true;
+
+ private:
+  struct SortKey {
+    float depth;
+    int object;
+    bool operator<(const SortKey &other) const { return depth < other.depth; }
+  };
+
+  enum Visibility : unsigned char { Visible, FrustumCulled, LodCulled };
+
+  void updateTransforms(Scene &scene);
+  void cull(const Scene &scene, const QMatrix4x4 &projection);
+  void selectLod(const Scene &scene, const QMatrix4x4 &projection, int viewportHeight);
+  void compact();
+  void sort();
+  void buildCommands(const Scene &scene);
+  void cullMeshlets(const Scene &scene, const QMatrix4x4 &projection);
+
+  JobSystem &jobs;
+
+  // Per object
+  std::vector<float> depths;
+  std::vector<float> radii;
+  std::vector<unsigned char> visibility;
+
+  // Per visible object
+  std::vector<SortKey> keys;
+  std::vector<SortKey> sortScratch;
+  std::vector<size_t> chunkCounts;
+
+  std::vector<DrawCommand> drawCommands;
+  std::vector<GLsizei> indexCounts;
+  std::vector<const void *> indexOffsets;
+
+  int frustumCulledCount = 0;
+  int lodCulledCount = 0;
+  int meshletsCulledCount = 0;
+  double planMilliseconds = 0;
+};
+
+#endif  // FRAMEPLANNER_H
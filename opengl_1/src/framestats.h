@@ -0,0 +1,48 @@
+#ifndef FRAMESTATS_H
+#define FRAMESTATS_H
+
+#include <QString>
+
+/**
+ * @brief Counters collected while rendering a single frame.
+ */
+struct FrameStats {
+    int objects = 0;
+    int drawn = 0;
+    int frustumCulled = 0;
+    int lodCulled = 0;
+    int occlusionCulled = 0;
+    int meshletsCulled = 0;
+    int streamedChunks = 0;
+    int streamPending = 0;
+    double planMilliseconds = 0;
+    double paintMilliseconds = 0;  // CPU time of paintGL
+    double gpuMilliseconds = 0;    // smoothed, a few frames late
+    float renderScale = 1;
+    int lights = 0;
+    double lightMilliseconds = 0;  // CPU time of the cluster assignment
+    bool indirect = false;         // drawn and culled on the GPU
+    qint64 gpuBytes = 0;           // video memory of all live objects
+    qint64 gpuPeakBytes = 0;       // high-water mark of gpuBytes
+
+    QString toString() const {
+        QString summary = QString("objects %1 | drawn %2 | culled: frustum %3, lod %4, occlusion %5, meshlets %6 | plan %7 ms | paint %8 ms")
+            .arg(objects).arg(drawn).arg(frustumCulled).arg(lodCulled).arg(occlusionCulled)
+            .arg(meshletsCulled).arg(planMilliseconds, 0, 'f', 2).arg(paintMilliseconds, 0, 'f', 2);
+        summary += QString(" | gpu %1 ms at %2%").arg(gpuMilliseconds, 0, 'f', 2).arg(qRound(renderScale * 100));
+        if (indirect) {
+            summary += " | indirect";
+        }
+        summary += QString(" | vram %1 MB, peak %2 MB")
+            .arg(gpuBytes / 1048576.0, 0, 'f', 1).arg(gpuPeakBytes / 1048576.0, 0, 'f', 1);
+        if (lights > 0) {
+            summary += QString(" | lights %1 in %2 ms").arg(lights).arg(lightMilliseconds, 0, 'f', 2);
+        }
+        if (streamedChunks > 0 || streamPending > 0) {
+            summary += QString(" | chunks %1, loading %2").arg(streamedChunks).arg(streamPending);
+        }
+        return summary;
+    }
+};
+
+#endif // FRAMESTATS_H
@@ -0,0 +1,39 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <QVector4D>
+
+/**
+ * @brief View frustum as six inward-facing planes, extracted from a
+ * (projection * model) matrix. Tests are done in the space the matrix maps
+ * from.
+ */
+struct Frustum {
+    QVector4D planes[6];
+
+    explicit Frustum(const QMatrix4x4 &m) {
+        QVector4D w = m.row(3);
+        planes[0] = w + m.row(0);  // left
+        planes[1] = w - m.row(0);  // right
+        planes[2] = w + m.row(1);  // bottom
+        planes[3] = w - m.row(1);  // top
+        planes[4] = w + m.row(2);  // near
+        planes[5] = w - m.row(2);  // far
+        for (QVector4D &plane : planes) {
+            plane /= plane.toVector3D().length();
+        }
+    }
+
+    bool intersectsSphere(const QVector3D &center, float radius) const {
+        for (const QVector4D &plane : planes) {
+            if (QVector3D::dotProduct(plane.toVector3D(), center) + plane.w() < -radius) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+#endif // FRUSTUM_H
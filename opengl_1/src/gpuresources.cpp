@@ -0,0 +1,444 @@
+#include "gpuresources.h"
+
+#include <QDebug>
+#include <QOpenGLVersionFunctionsFactory>
+
+#include <algorithm>
+
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+
+namespace {
+
+const char *const categoryNames[GpuResources::categoryCount] = {
+    "geometry", "lighting", "culling", "streaming", "render targets", "programs"};
+
+double megabytes(qint64 bytes) { return bytes / (1024.0 * 1024.0); }
+
+// Drivers pad 24-bit depth to 32 bits, like most other formats
+int bytesPerPixel(GLenum format) {
+  switch (format) {
+    case GL_R8:
+      return 1;
+    case GL_RG8:
+    case GL_R16F:
+    case GL_DEPTH_COMPONENT16:
+      return 2;
+    case GL_RGBA16F:
+    case GL_RG32F:
+      return 8;
+    case GL_RGBA32F:
+      return 16;
+    default:
+      return 4;
+  }
+}
+
+/**
+ * @brief Makes a context current for its lifetime, if it is not already,
+ * and restores the previously current context afterwards.
+ */
+class ScopedCurrent {
+ public:
+  ScopedCurrent(QOpenGLContext *context, QSurface *surface)
+      : context(context), previous(QOpenGLContext::currentContext()) {
+    previousSurface = previous ? previous->surface() : nullptr;
+    ok = previous == context || context->makeCurrent(surface);
+  }
+
+  ~ScopedCurrent() {
+    if (previous == context) return;
+    if (previous) {
+      previous->makeCurrent(previousSurface);
+    } else {
+      context->doneCurrent();
+    }
+  }
+
+  bool ok;
+
+ private:
+  QOpenGLContext *context;
+  QOpenGLContext *previous;
+  QSurface *previousSurface;
+};
+
+}  // namespace
+
+/**
+ * @brief GpuHandle::GpuHandle Takes over the object of another handle.
+ * @param other The handle to move from, empty afterwards.
+ */
+GpuHandle::GpuHandle(GpuHandle &&other) noexcept
+    : owner(other.owner), name(other.name), entry(other.entry), generation(other.generation) {
+  other.owner = nullptr;
+  other.name = 0;
+  other.entry = -1;
+}
+
+/**
+ * @brief GpuHandle::operator= Releases the own object and takes over the
+ * object of another handle.
+ * @param other The handle to move from, empty afterwards.
+ * @return This handle.
+ */
+GpuHandle &GpuHandle::operator=(GpuHandle &&other) noexcept {
+  if (this != &other) {
+    reset();
+    std::swap(owner, other.owner);
+    std::swap(name, other.name);
+    std::swap(entry, other.entry);
+    std::swap(generation, other.generation);
+  }
+  return *this;
+}
+
+/**
+ * @brief GpuHandle::reset Deletes the object, if any, and empties the handle.
+ */
+void GpuHandle::reset() {
+  if (owner) owner->release(*this);
+  owner = nullptr;
+  name = 0;
+  entry = -1;
+}
+
+/**
+ * @brief GpuResources::categoryName Returns the name of a category, as used
+ * in the usage report.
+ * @param category The category.
+ * @return Its name.
+ */
+const char *GpuResources::categoryName(Category category) {
+  return categoryNames[category];
+}
+
+/**
+ * @brief GpuResources::~GpuResources Deletes the objects that are still
+ * alive, if the context still exists.
+ */
+GpuResources::~GpuResources() { releaseGL(); }
+
+/**
+ * @brief GpuResources::initializeGL Starts managing the objects of a
+ * context. The offscreen surface it creates lets objects be deleted while
+ * the context is not current.
+ * @param glContext The current context.
+ */
+void GpuResources::initializeGL(QOpenGLContext *glContext) {
+  context = glContext;
+  gl = QOpenGLVersionFunctionsFactory::get<QOpenGLFunctions_3_3_Core>(glContext);
+  if (gl) gl->initializeOpenGLFunctions();
+
+  surface = std::make_unique<QOffscreenSurface>();
+  surface->setFormat(glContext->format());
+  surface->create();
+
+  // Program sizes are estimated from their binaries, where available
+  programSizes = glContext->format().version() >= qMakePair(4, 1) ||
+                 glContext->hasExtension("GL_ARB_get_program_binary");
+}
+
+/**
+ * @brief GpuResources::releaseGL Deletes every object that is still alive.
+ * Call it while the context still exists, e.g. from its
+ * aboutToBeDestroyed() signal. The high-water mark is kept.
+ */
+void GpuResources::releaseGL() {
+  if (!gl) return;
+
+  if (context) {
+    ScopedCurrent current(context, surface.get());
+    if (current.ok) {
+      for (const Entry &entry : entries) {
+        if (entry.live) deleteObject(entry);
+      }
+    } else {
+      qWarning() << ":: Cannot make the context current to delete"
+                 << liveObjects() << "OpenGL objects";
+    }
+  }
+  qDebug() << ":: Released" << liveObjects() << "OpenGL objects, video memory peak"
+           << megabytes(highWaterMark) << "MB";
+
+  entries.clear();
+  freeEntries.clear();
+  std::fill(std::begin(categoryBytes), std::end(categoryBytes), 0);
+  totalBytes = 0;
+  generation++;
+
+  surface.reset();
+  context = nullptr;
+  gl = nullptr;
+}
+
+/**
+ * @brief GpuResources::create Registers a new object.
+ * @param kind The type of object.
+ * @param category The category it is accounted under.
+ * @param label Its name in the usage report.
+ * @param name Its OpenGL name.
+ * @return The handle that owns it.
+ */
+GpuHandle GpuResources::create(Kind kind, Category category, const QString &label,
+                               GLuint name) {
+  int index;
+  if (freeEntries.empty()) {
+    index = entries.size();
+    entries.emplace_back();
+  } else {
+    index = freeEntries.back();
+    freeEntries.pop_back();
+  }
+
+  Entry &entry = entries[index];
+  entry.kind = kind;
+  entry.category = category;
+  entry.label = label;
+  entry.name = name;
+  entry.bytes = 0;
+  entry.live = true;
+
+  GpuHandle handle;
+  handle.owner = this;
+  handle.name = name;
+  handle.entry = index;
+  handle.generation = generation;
+  return handle;
+}
+
+/**
+ * @brief GpuResources::createBuffer Creates a buffer without storage; see
+ * bufferData().
+ * @param category The category it is accounted under.
+ * @param label Its name in the usage report.
+ * @return The handle that owns it.
+ */
+GpuHandle GpuResources::createBuffer(Category category, const QString &label) {
+  Q_ASSERT(gl);
+  GLuint name = 0;
+  gl->glGenBuffers(1, &name);
+  return create(Buffer, category, label, name);
+}
+
+/**
+ * @brief GpuResources::createVertexArray Creates a vertex array.
+ * @param category The category it is accounted under.
+ * @param label Its name in the usage report.
+ * @return The handle that owns it.
+ */
+GpuHandle GpuResources::createVertexArray(Category category, const QString &label) {
+  Q_ASSERT(gl);
+  GLuint name = 0;
+  gl->glGenVertexArrays(1, &name);
+  return create(VertexArray, category, label, name);
+}
+
+/**
+ * @brief GpuResources::createTexture Creates a texture. Only texture buffers
+ * are used, which have no storage of their own.
+ * @param category The category it is accounted under.
+ * @param label Its name in the usage report.
+ * @return The handle that owns it.
+ */
+GpuHandle GpuResources::createTexture(Category category, const QString &label) {
+  Q_ASSERT(gl);
+  GLuint name = 0;
+  gl->glGenTextures(1, &name);
+  return create(Texture, category, label, name);
+}
+
+/**
+ * @brief GpuResources::createRenderbuffer Creates a renderbuffer without
+ * storage; see renderbufferStorage().
+ * @param category The category it is accounted under.
+ * @param label Its name in the usage report.
+ * @return The handle that owns it.
+ */
+GpuHandle GpuResources::createRenderbuffer(Category category, const QString &label) {
+  Q_ASSERT(gl);
+  GLuint name = 0;
+  gl->glGenRenderbuffers(1, &name);
+  return create(Renderbuffer, category, label, name);
+}
+
+/**
+ * @brief GpuResources::createFramebuffer Creates a framebuffer.
+ * @param category The category it is accounted under.
+ * @param label Its name in the usage report.
+ * @return The handle that owns it.
+ */
+GpuHandle GpuResources::createFramebuffer(Category category, const QString &label) {
+  Q_ASSERT(gl);
+  GLuint name = 0;
+  gl->glGenFramebuffers(1, &name);
+  return create(Framebuffer, category, label, name);
+}
+
+/**
+ * @brief GpuResources::createQuery Creates a query object.
+ * @param category The category it is accounted under.
+ * @param label Its name in the usage report.
+ * @return The handle that owns it.
+ */
+GpuHandle GpuResources::createQuery(Category category, const QString &label) {
+  Q_ASSERT(gl);
+  GLuint name = 0;
+  gl->glGenQueries(1, &name);
+  return create(Query, category, label, name);
+}
+
+/**
+ * @brief GpuResources::trackProgram Accounts for a linked program. Its size
+ * is taken to be that of its binary, which is 0 where that cannot be
+ * queried. Releasing the handle does not delete the program.
+ * @param program The program, owned by a QOpenGLShaderProgram.
+ * @param label Its name in the usage report.
+ * @return The handle that tracks it.
+ */
+GpuHandle GpuResources::trackProgram(GLuint program, const QString &label) {
+  Q_ASSERT(gl);
+  GpuHandle handle = create(Program, Programs, label, program);
+  if (programSizes) {
+    GLint length = 0;
+    gl->glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    setBytes(handle, length);
+  }
+  return handle;
+}
+
+/**
+ * @brief GpuResources::bufferData Binds a buffer and allocates its storage,
+ * like glBufferData(). Orphaning a buffer every frame counts its storage
+ * once.
+ * @param buffer The buffer.
+ * @param target The target to bind it to.
+ * @param size Size of the storage in bytes.
+ * @param data Initial contents, or null.
+ * @param usage Usage hint.
+ */
+void GpuResources::bufferData(const GpuHandle &buffer, GLenum target, GLsizeiptr size,
+                              const void *data, GLenum usage) {
+  gl->glBindBuffer(target, buffer.id());
+  gl->glBufferData(target, size, data, usage);
+  setBytes(buffer, size);
+}
+
+/**
+ * @brief GpuResources::renderbufferStorage Allocates the storage of a
+ * renderbuffer, like glRenderbufferStorage().
+ * @param renderbuffer The renderbuffer.
+ * @param format Internal format.
+ * @param width Width in pixels.
+ * @param height Height in pixels.
+ */
+void GpuResources::renderbufferStorage(const GpuHandle &renderbuffer, GLenum format,
+                                       int width, int height) {
+  gl->glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer.id());
+  gl->glRenderbufferStorage(GL_RENDERBUFFER, format, width, height);
+  gl->glBindRenderbuffer(GL_RENDERBUFFER, 0);
+  setBytes(renderbuffer, qint64(width) * height * bytesPerPixel(format));
+}
+
+/**
+ * @brief GpuResources::setBytes Updates the size of an object, and the
+ * totals and the high-water mark with it.
+ * @param handle The object.
+ * @param bytes Its new size.
+ */
+void GpuResources::setBytes(const GpuHandle &handle, qint64 bytes) {
+  if (handle.owner != this || handle.generation != generation) return;
+
+  Entry &entry = entries[handle.entry];
+  categoryBytes[entry.category] += bytes - entry.bytes;
+  totalBytes += bytes - entry.bytes;
+  entry.bytes = bytes;
+  highWaterMark = std::max(highWaterMark, totalBytes);
+}
+
+/**
+ * @brief GpuResources::release Deletes the object of a handle on this
+ * context, and stops accounting for it.
+ * @param handle The handle, emptied by the caller.
+ */
+void GpuResources::release(GpuHandle &handle) {
+  if (handle.generation != generation || !gl) return;
+
+  Entry &entry = entries[handle.entry];
+  if (context) {
+    ScopedCurrent current(context, surface.get());
+    if (current.ok) {
+      deleteObject(entry);
+    } else {
+      qWarning() << ":: Cannot make the context current to delete" << entry.label;
+    }
+  }
+
+  setBytes(handle, 0);
+  entry.live = false;
+  entry.label.clear();
+  freeEntries.push_back(handle.entry);
+}
+
+/**
+ * @brief GpuResources::deleteObject Deletes an OpenGL object. The context
+ * must be current.
+ * @param entry The object.
+ */
+void GpuResources::deleteObject(const Entry &entry) {
+  switch (entry.kind) {
+    case Buffer:
+      gl->glDeleteBuffers(1, &entry.name);
+      break;
+    case VertexArray:
+      gl->glDeleteVertexArrays(1, &entry.name);
+      break;
+    case Texture:
+      gl->glDeleteTextures(1, &entry.name);
+      break;
+    case Renderbuffer:
+      gl->glDeleteRenderbuffers(1, &entry.name);
+      break;
+    case Framebuffer:
+      gl->glDeleteFramebuffers(1, &entry.name);
+      break;
+    case Query:
+      gl->glDeleteQueries(1, &entry.name);
+      break;
+    case Program:
+      // Deleted by its QOpenGLShaderProgram
+      break;
+  }
+}
+
+/**
+ * @brief GpuResources::usage Lists the live objects.
+ * @return The objects with their category and size, largest first.
+ */
+std::vector<GpuResources::Usage> GpuResources::usage() const {
+  std::vector<Usage> objects;
+  for (const Entry &entry : entries) {
+    if (entry.live) objects.push_back({entry.label, entry.category, entry.bytes});
+  }
+  std::stable_sort(objects.begin(), objects.end(),
+                   [](const Usage &a, const Usage &b) { return a.bytes > b.bytes; });
+  return objects;
+}
+
+/**
+ * @brief GpuResources::logUsage Logs the live and peak video memory, the
+ * live bytes per category and every object that has storage.
+ */
+void GpuResources::logUsage() const {
+  qDebug() << ":: Video memory:" << megabytes(totalBytes) << "MB live,"
+           << megabytes(highWaterMark) << "MB peak," << liveObjects() << "objects";
+  for (int category = 0; category < categoryCount; category++) {
+    qDebug() << "  " << categoryNames[category] << megabytes(categoryBytes[category]) << "MB";
+  }
+  for (const Usage &object : usage()) {
+    if (object.bytes == 0) break;
+    qDebug() << "    " << qPrintable(object.label) << object.bytes << "bytes ("
+             << categoryNames[object.category] << ")";
+  }
+}
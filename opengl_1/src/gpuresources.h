@@ -0,0 +1,141 @@
+#ifndef GPURESOURCES_H
+#define GPURESOURCES_H
+
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions_3_3_Core>
+#include <QPointer>
+#include <QString>
+
+#include <memory>
+#include <vector>
+
+class GpuResources;
+
+/**
+ * @brief Owning handle of one OpenGL object created by GpuResources.
+ *
+ * Handles are move-only. Destroying or resetting one deletes its object on
+ * the context that created it. A handle must not outlive its GpuResources.
+ */
+class GpuHandle {
+ public:
+  GpuHandle() = default;
+  GpuHandle(GpuHandle &&other) noexcept;
+  GpuHandle &operator=(GpuHandle &&other) noexcept;
+  GpuHandle(const GpuHandle &) = delete;
+  GpuHandle &operator=(const GpuHandle &) = delete;
+  ~GpuHandle() { reset(); }
+
+  // The OpenGL name, 0 for an empty handle
+  GLuint id() const { return name; }
+  void reset();
+
+ private:
+  friend class GpuResources;
+
+  GpuResources *owner = nullptr;
+  GLuint name = 0;
+  int entry = -1;
+  int generation = 0;
+};
+
+/**
+ * @brief The GpuResources class creates and owns the OpenGL objects of one
+ * context, and accounts for the video memory they use.
+ *
+ * Objects are handed out as GpuHandles. When a handle is released while
+ * another context, or none, is current, the manager makes its own context
+ * current on an offscreen surface for the delete. releaseGL() deletes every
+ * object that is still alive, right before the context goes away; handles
+ * released after that only forget their object.
+ *
+ * Buffer and renderbuffer storage is allocated through the manager, so it
+ * knows the size of every object. Linked programs are owned by
+ * QOpenGLShaderProgram and only tracked. The live bytes are kept per
+ * category and per object, along with the high-water mark of the total.
+ */
+class GpuResources {
+ public:
+  enum Category { Geometry, Lighting, Culling, Streaming, RenderTargets, Programs };
+  static const int categoryCount = Programs + 1;
+  static const char *categoryName(Category category);
+
+  struct Usage {
+    QString label;
+    Category category;
+    qint64 bytes;
+  };
+
+  GpuResources() = default;
+  GpuResources(const GpuResources &) = delete;
+  GpuResources &operator=(const GpuResources &) = delete;
+  ~GpuResources();
+
+  // Requires the context to be current
+  void initializeGL(QOpenGLContext *context);
+  void releaseGL();
+
+  QOpenGLFunctions_3_3_Core *functions() const { return gl; }
+
+  // Each creates one object; label names it in the usage report
+  GpuHandle createBuffer(Category category, const QString &label);
+  GpuHandle createVertexArray(Category category, const QString &label);
+  GpuHandle createTexture(Category category, const QString &label);
+  GpuHandle createRenderbuffer(Category category, const QString &label);
+  GpuHandle createFramebuffer(Category category, const QString &label);
+  GpuHandle createQuery(Category category, const QString &label);
+  // Accounts for a program that QOpenGLShaderProgram owns and deletes
+  GpuHandle trackProgram(GLuint program, const QString &label);
+
+  // Binds the buffer to target and (re)allocates its storage; the buffer
+  // stays bound
+  void bufferData(const GpuHandle &buffer, GLenum target, GLsizeiptr size,
+                  const void *data, GLenum usage);
+  // Allocates the storage of a renderbuffer; none is bound afterwards
+  void renderbufferStorage(const GpuHandle &renderbuffer, GLenum format,
+                           int width, int height);
+
+  qint64 liveBytes() const { return totalBytes; }
+  qint64 liveBytes(Category category) const { return categoryBytes[category]; }
+  qint64 peakBytes() const { return highWaterMark; }
+  int liveObjects() const { return int(entries.size() - freeEntries.size()); }
+  // Every live object, largest first
+  std::vector<Usage> usage() const;
+  void logUsage() const;
+
+ private:
+  friend class GpuHandle;
+
+  enum Kind { Buffer, VertexArray, Texture, Renderbuffer, Framebuffer, Query, Program };
+
+  struct Entry {
+    Kind kind = Buffer;
+    Category category = Geometry;
+    QString label;
+    GLuint name = 0;
+    qint64 bytes = 0;
+    bool live = false;
+  };
+
+  GpuHandle create(Kind kind, Category category, const QString &label, GLuint name);
+  void release(GpuHandle &handle);
+  void deleteObject(const Entry &entry);
+  void setBytes(const GpuHandle &handle, qint64 bytes);
+
+  QPointer<QOpenGLContext> context;
+  QOpenGLFunctions_3_3_Core *gl = nullptr;
+  std::unique_ptr<QOffscreenSurface> surface;
+  bool programSizes = false;  // GL_PROGRAM_BINARY_LENGTH can be queried
+
+  std::vector<Entry> entries;
+  std::vector<int> freeEntries;
+  // Handles of an earlier context, released after releaseGL(), are ignored
+  int generation = 0;
+
+  qint64 categoryBytes[categoryCount] = {};
+  qint64 totalBytes = 0;
+  qint64 highWaterMark = 0;
+};
+
+#endif  // GPURESOURCES_H
@@ -0,0 +1,288 @@
+#include "indirectrenderer.h"
+
+#include <QDebug>
+#include <QOpenGLVersionFunctionsFactory>
+#include <QSurfaceFormat>
+
+#include <cstddef>
+#include <numeric>
+#include <vector>
+
+#include "frustum.h"
+#include "shaderlibrary.h"
+#include "triangle.h"
+
+namespace {
+
+// Must match the structs in cullshader.comp (std430)
+struct GpuMesh {
+  GLfloat sphere[4];
+  GLuint indexCount;
+  GLuint firstIndex;
+  GLint baseVertex;
+  GLuint padding;
+};
+
+struct GpuObject {
+  GLfloat position[3];
+  GLuint mesh;
+};
+
+const GLuint workGroupSize = 64;
+
+}  // namespace
+
+/**
+ * @brief IndirectRenderer::isSupported Probes for OpenGL 4.3 with a
+ * temporary context. Call it before the widget creates its own context.
+ * @return Whether a 4.3 core context can be created.
+ */
+bool IndirectRenderer::isSupported() {
+  QSurfaceFormat format = QSurfaceFormat::defaultFormat();
+  format.setVersion(4, 3);
+  QOpenGLContext context;
+  context.setFormat(format);
+  return context.create() && context.format().version() >= qMakePair(4, 3);
+}
+
+/**
+ * @brief IndirectRenderer::initializeGL Merges the meshes into shared
+ * buffers, creates the per-object buffers and compiles the compute shader.
+ * @param context The current context.
+ * @param resources Resources of the current context.
+ * @param scene The scene, with its meshes uploaded and objects added.
+ * @return Whether the indirect path can draw this scene.
+ */
+bool IndirectRenderer::initializeGL(QOpenGLContext *context, GpuResources &resources,
+                                    const Scene &scene) {
+  gl = QOpenGLVersionFunctionsFactory::get<QOpenGLFunctions_4_3_Core>(context);
+  if (!gl || !gl->initializeOpenGLFunctions()) {
+    qWarning() << "OpenGL 4.3 core is not available";
+    gl = nullptr;
+    return false;
+  }
+
+  // One draw means one shader variant and one vertex layout for all meshes
+  features = scene.shaderFeatures.empty() ? 0 : scene.shaderFeatures[0];
+  for (unsigned meshFeatures : scene.shaderFeatures) {
+    if (meshFeatures != features || (features & (Instancing | QuantizedInput)) ||
+        !(features & VertexColour)) {
+      qDebug() << ":: Meshes need different shader variants, not drawing indirectly";
+      gl = nullptr;
+      return false;
+    }
+  }
+  features |= Instancing;
+
+  cullProgram = std::make_unique<QOpenGLShaderProgram>();
+  if (!cullProgram->addShaderFromSourceFile(QOpenGLShader::Compute, ":/shaders/cullshader.comp") ||
+      !cullProgram->link()) {
+    qWarning() << "Cannot build the culling compute shader:" << cullProgram->log();
+    cullProgram.reset();
+    gl = nullptr;
+    return false;
+  }
+  cullProgramUsage = resources.trackProgram(cullProgram->programId(), "culling compute shader");
+
+  // Place the meshes one after the other; non-indexed meshes get 0, 1, 2...
+  std::vector<GpuMesh> meshes(scene.meshCount());
+  GLint vertexTotal = 0;
+  GLuint indexTotal = 0;
+  for (int m = 0; m < scene.meshCount(); m++) {
+    const Bounds &bounds = scene.bounds[m];
+    QVector3D center = bounds.center();
+    meshes[m] = {{center.x(), center.y(), center.z(), bounds.radius()},
+                 GLuint(scene.indexCounts[m] > 0 ? scene.indexCounts[m] : scene.vertexCounts[m]),
+                 indexTotal, vertexTotal, 0};
+    vertexTotal += scene.vertexCounts[m];
+    indexTotal += meshes[m].indexCount;
+  }
+
+  vertexBuffer = resources.createBuffer(GpuResources::Geometry, "merged vertices");
+  indexBuffer = resources.createBuffer(GpuResources::Geometry, "merged indices");
+  resources.bufferData(vertexBuffer, GL_COPY_WRITE_BUFFER, vertexTotal * sizeof(Vertex), nullptr, GL_STATIC_DRAW);
+  resources.bufferData(indexBuffer, GL_COPY_WRITE_BUFFER, indexTotal * sizeof(GLuint), nullptr, GL_STATIC_DRAW);
+
+  // Copy the existing buffers on the GPU
+  for (int m = 0; m < scene.meshCount(); m++) {
+    const GpuMesh &mesh = meshes[m];
+    gl->glBindBuffer(GL_COPY_READ_BUFFER, scene.vbos[m].id());
+    gl->glBindBuffer(GL_COPY_WRITE_BUFFER, vertexBuffer.id());
+    gl->glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0,
+                            mesh.baseVertex * sizeof(Vertex), scene.vertexCounts[m] * sizeof(Vertex));
+
+    gl->glBindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer.id());
+    GLintptr indexOffset = mesh.firstIndex * sizeof(GLuint);
+    if (scene.indexCounts[m] > 0) {
+      gl->glBindBuffer(GL_COPY_READ_BUFFER, scene.ebos[m].id());
+      gl->glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, indexOffset,
+                              mesh.indexCount * sizeof(GLuint));
+    } else {
+      std::vector<GLuint> sequence(mesh.indexCount);
+      std::iota(sequence.begin(), sequence.end(), 0u);
+      gl->glBufferSubData(GL_COPY_WRITE_BUFFER, indexOffset, sequence.size() * sizeof(GLuint), sequence.data());
+    }
+  }
+  gl->glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  gl->glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+  // The objects do not change after startup, only their shared transform
+  objectCount = scene.objectCount();
+  std::vector<GpuObject> objects(objectCount);
+  for (int i = 0; i < objectCount; i++) {
+    const QVector3D &position = scene.positions[i];
+    objects[i] = {{position.x(), position.y(), position.z()}, GLuint(scene.meshes[i])};
+  }
+
+  meshBuffer = resources.createBuffer(GpuResources::Culling, "mesh spheres");
+  objectBuffer = resources.createBuffer(GpuResources::Culling, "object positions");
+  transformBuffer = resources.createBuffer(GpuResources::Culling, "object transforms");
+  commandBuffer = resources.createBuffer(GpuResources::Culling, "draw commands");
+  counterBuffer = resources.createBuffer(GpuResources::Culling, "visible counter");
+  resources.bufferData(meshBuffer, GL_SHADER_STORAGE_BUFFER, meshes.size() * sizeof(GpuMesh), meshes.data(), GL_STATIC_DRAW);
+  resources.bufferData(objectBuffer, GL_SHADER_STORAGE_BUFFER, objects.size() * sizeof(GpuObject), objects.data(), GL_STATIC_DRAW);
+  resources.bufferData(transformBuffer, GL_SHADER_STORAGE_BUFFER, objectCount * 16 * sizeof(GLfloat), nullptr, GL_DYNAMIC_COPY);
+  resources.bufferData(commandBuffer, GL_SHADER_STORAGE_BUFFER, objectCount * 5 * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+  resources.bufferData(counterBuffer, GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+  gl->glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  for (Readback &readback : readbacks) {
+    readback.buffer = resources.createBuffer(GpuResources::Culling, "visible count readback");
+    resources.bufferData(readback.buffer, GL_COPY_WRITE_BUFFER, sizeof(GLuint), nullptr, GL_STREAM_READ);
+  }
+  gl->glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+  // Positions and colours as in MainView, the transform per instance
+  vao = resources.createVertexArray(GpuResources::Geometry, "merged meshes");
+  gl->glBindVertexArray(vao.id());
+  gl->glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer.id());
+  gl->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0);
+  gl->glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, red));
+  gl->glEnableVertexAttribArray(0);
+  gl->glEnableVertexAttribArray(1);
+  gl->glBindBuffer(GL_ARRAY_BUFFER, transformBuffer.id());
+  for (int column = 0; column < 4; column++) {
+    gl->glVertexAttribPointer(2 + column, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(GLfloat),
+                              (void *)(column * 4 * sizeof(GLfloat)));
+    gl->glEnableVertexAttribArray(2 + column);
+    gl->glVertexAttribDivisor(2 + column, 1);
+  }
+  gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer.id());
+  gl->glBindVertexArray(0);
+  gl->glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  qDebug() << ":: Indirect drawing:" << objectCount << "objects," << indexTotal / 3 << "triangles";
+  return true;
+}
+
+/**
+ * @brief IndirectRenderer::releaseGL Deletes the buffers and the compute
+ * shader.
+ */
+void IndirectRenderer::releaseGL() {
+  if (!gl) return;
+  cullProgramUsage.reset();
+  cullProgram.reset();
+  vao.reset();
+  for (GpuHandle *buffer : {&vertexBuffer, &indexBuffer, &meshBuffer, &objectBuffer,
+                            &transformBuffer, &commandBuffer, &counterBuffer}) {
+    buffer->reset();
+  }
+  for (Readback &readback : readbacks) {
+    readback.buffer.reset();
+    if (readback.fence) gl->glDeleteSync(readback.fence);
+    readback.fence = nullptr;
+  }
+  gl = nullptr;
+}
+
+/**
+ * @brief IndirectRenderer::update Transforms and culls all objects and
+ * writes their draw commands on the GPU.
+ * @param scene The scene, for the shared rotation and scale.
+ * @param projection The projection transformation.
+ * @param viewportHeight Height of the viewport in pixels.
+ */
+void IndirectRenderer::update(const Scene &scene, const QMatrix4x4 &projection,
+                              int viewportHeight) {
+  if (!gl || objectCount == 0) return;
+
+  QMatrix4x4 shared;
+  shared.scale(scene.scale);
+  shared.rotate(scene.rotation.x(), 1, 0, 0);
+  shared.rotate(scene.rotation.y(), 0, 1, 0);
+  shared.rotate(scene.rotation.z(), 0, 0, 1);
+  // Objects are placed in eye space directly
+  Frustum frustum(projection);
+
+  GLuint zero = 0;
+  gl->glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffer.id());
+  gl->glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &zero);
+  gl->glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  cullProgram->bind();
+  cullProgram->setUniformValue("sharedTransform", shared);
+  cullProgram->setUniformValue("sharedScale", scene.scale);
+  cullProgram->setUniformValueArray("frustumPlanes", frustum.planes, 6);
+  cullProgram->setUniformValue("pixelsPerUnit", 0.5f * viewportHeight * projection(1, 1));
+  cullProgram->setUniformValue("minimumPixelSize", minimumPixelSize);
+  cullProgram->setUniformValue("objectCount", GLuint(objectCount));
+
+  GLuint buffers[] = {meshBuffer.id(), objectBuffer.id(), transformBuffer.id(), commandBuffer.id(),
+                      counterBuffer.id()};
+  for (GLuint binding = 0; binding < 5; binding++) {
+    gl->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buffers[binding]);
+  }
+  gl->glDispatchCompute((objectCount + workGroupSize - 1) / workGroupSize, 1, 1);
+  gl->glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT |
+                      GL_BUFFER_UPDATE_BARRIER_BIT);
+  cullProgram->release();
+
+  // Copy the visible count out, to be read in a later frame
+  Readback &readback = readbacks[nextReadback];
+  if (!readback.fence) {
+    gl->glBindBuffer(GL_COPY_READ_BUFFER, counterBuffer.id());
+    gl->glBindBuffer(GL_COPY_WRITE_BUFFER, readback.buffer.id());
+    gl->glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(GLuint));
+    gl->glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    gl->glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    readback.fence = gl->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    nextReadback = (nextReadback + 1) % readbackCount;
+  }
+  readVisibleCount();
+}
+
+/**
+ * @brief IndirectRenderer::readVisibleCount Reads the newest visible count
+ * whose copy has finished, without waiting for the others.
+ */
+void IndirectRenderer::readVisibleCount() {
+  for (int n = 0; n < readbackCount; n++) {
+    Readback &readback = readbacks[(nextReadback + n) % readbackCount];
+    if (!readback.fence) continue;
+
+    GLenum status = gl->glClientWaitSync(readback.fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+
+    GLuint count = 0;
+    gl->glBindBuffer(GL_COPY_READ_BUFFER, readback.buffer.id());
+    gl->glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(GLuint), &count);
+    gl->glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    gl->glDeleteSync(readback.fence);
+    readback.fence = nullptr;
+    visible = count;
+  }
+}
+
+/**
+ * @brief IndirectRenderer::draw Draws all objects with the commands of the
+ * last update(). The program of shaderFeatures(), or a variant with the
+ * same inputs, must be bound.
+ */
+void IndirectRenderer::draw() {
+  if (!gl || objectCount == 0) return;
+  gl->glBindVertexArray(vao.id());
+  gl->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer.id());
+  gl->glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, objectCount, 0);
+  gl->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
@@ -0,0 +1,80 @@
+#ifndef INDIRECTRENDERER_H
+#define INDIRECTRENDERER_H
+
+#include <QMatrix4x4>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions_4_3_Core>
+#include <QOpenGLShaderProgram>
+
+#include <memory>
+
+#include "gpuresources.h"
+#include "scene.h"
+
+/**
+ * @brief The IndirectRenderer class draws all objects of the scene with a
+ * single glMultiDrawElementsIndirect call. It needs OpenGL 4.3.
+ *
+ * The meshes are copied into one vertex and one index buffer. Every frame, a
+ * compute shader (shaders/cullshader.comp) computes the transform of every
+ * object, culls it against the frustum and the minimum size on screen, and
+ * writes its draw command, so the CPU only uploads the shared rotation and
+ * scale. The transforms are read by the Instancing shader variant as a
+ * per-instance attribute; the command of object i has baseInstance i, so it
+ * reads transform i.
+ */
+class IndirectRenderer {
+ public:
+  // Whether the driver can create an OpenGL 4.3 core context
+  static bool isSupported();
+
+  // Requires a current OpenGL 4.3 context. Fails if the meshes do not share
+  // one shader variant and vertex layout.
+  bool initializeGL(QOpenGLContext *context, GpuResources &resources, const Scene &scene);
+  void releaseGL();
+
+  // Runs the compute pass for this frame
+  void update(const Scene &scene, const QMatrix4x4 &projection, int viewportHeight);
+  // Draws the objects that passed the compute pass
+  void draw();
+
+  // The shader variant to draw with
+  unsigned shaderFeatures() const { return features; }
+  // Objects drawn, as counted on the GPU a few frames ago
+  int visibleCount() const { return visible; }
+
+  // Objects smaller than this on screen are not drawn
+  float minimumPixelSize = 1.0f;
+
+ private:
+  struct Readback {
+    GpuHandle buffer;
+    GLsync fence = nullptr;
+  };
+
+  void readVisibleCount();
+
+  QOpenGLFunctions_4_3_Core *gl = nullptr;
+  std::unique_ptr<QOpenGLShaderProgram> cullProgram;
+  GpuHandle cullProgramUsage;
+  unsigned features = 0;
+  GLsizei objectCount = 0;
+
+  GpuHandle vao;
+  GpuHandle vertexBuffer;
+  GpuHandle indexBuffer;
+  GpuHandle meshBuffer;
+  GpuHandle objectBuffer;
+  GpuHandle transformBuffer;
+  GpuHandle commandBuffer;
+  GpuHandle counterBuffer;
+
+  // The visible count is copied out and read once its fence has passed, so
+  // the CPU never waits for the GPU
+  static const int readbackCount = 3;
+  Readback readbacks[readbackCount];
+  int nextReadback = 0;
+  int visible = 0;
+};
+
+#endif  // INDIRECTRENDERER_H
@@ -0,0 +1,466 @@
+#include "inputrecorder.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTimer>
+
+#include <algorithm>
+
+#include "mainview.h"
+
+namespace {
+const char magic[8] = {'C', 'G', 'I', 'N', 'P', 'U', 'T', '1'};
+
+void prepareStream(QDataStream &stream) {
+  stream.setByteOrder(QDataStream::LittleEndian);
+  stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+}
+
+Qt::KeyboardModifiers toModifiers(quint32 modifiers) {
+  return Qt::KeyboardModifiers(QFlag(int(modifiers)));
+}
+
+Qt::MouseButtons toButtons(quint32 buttons) {
+  return Qt::MouseButtons(QFlag(int(buttons)));
+}
+
+// Value at fraction p of the sorted values
+double percentile(std::vector<double> values, double p) {
+  if (values.empty()) return 0;
+  std::sort(values.begin(), values.end());
+  return values[std::min(values.size() - 1, size_t(p * values.size()))];
+}
+
+QJsonObject summarize(const std::vector<double> &values) {
+  double sum = 0;
+  for (double value : values) sum += value;
+
+  QJsonObject summary;
+  summary["mean"] = values.empty() ? 0 : sum / values.size();
+  summary["median"] = percentile(values, 0.5);
+  summary["p95"] = percentile(values, 0.95);
+  summary["p99"] = percentile(values, 0.99);
+  summary["max"] = percentile(values, 1);
+  return summary;
+}
+
+// Live and peak bytes, per category, and every object that has storage
+QJsonObject gpuMemory(const GpuResources &resources) {
+  QJsonObject categories;
+  for (int category = 0; category < GpuResources::categoryCount; category++) {
+    auto value = GpuResources::Category(category);
+    categories[GpuResources::categoryName(value)] = double(resources.liveBytes(value));
+  }
+
+  QJsonArray objects;
+  for (const GpuResources::Usage &usage : resources.usage()) {
+    if (usage.bytes == 0) break;
+    QJsonObject object;
+    object["label"] = usage.label;
+    object["category"] = GpuResources::categoryName(usage.category);
+    object["bytes"] = double(usage.bytes);
+    objects.append(object);
+  }
+
+  QJsonObject memory;
+  memory["liveBytes"] = double(resources.liveBytes());
+  memory["peakBytes"] = double(resources.peakBytes());
+  memory["liveObjects"] = resources.liveObjects();
+  memory["categories"] = categories;
+  memory["objects"] = objects;
+  return memory;
+}
+}  // namespace
+
+// --- InputEvent
+
+/**
+ * @brief InputEvent::slider Creates an event for a dial or slider of the
+ * main window.
+ * @param type The control.
+ * @param value Its new value.
+ * @return The event.
+ */
+InputEvent InputEvent::slider(Type type, int value) {
+  InputEvent event;
+  event.type = type;
+  event.value = value;
+  return event;
+}
+
+/**
+ * @brief InputEvent::key Creates an event for a key press or release.
+ * @param type KeyPress or KeyRelease.
+ * @param ev The Qt event.
+ * @return The event.
+ */
+InputEvent InputEvent::key(Type type, const QKeyEvent *ev) {
+  InputEvent event;
+  event.type = type;
+  event.value = ev->key();
+  event.modifiers = ev->modifiers().toInt();
+  return event;
+}
+
+/**
+ * @brief InputEvent::mouse Creates an event for a mouse button or move.
+ * @param type One of the Mouse types.
+ * @param ev The Qt event.
+ * @return The event.
+ */
+InputEvent InputEvent::mouse(Type type, const QMouseEvent *ev) {
+  InputEvent event;
+  event.type = type;
+  event.value = ev->button();
+  event.buttons = ev->buttons().toInt();
+  event.modifiers = ev->modifiers().toInt();
+  event.x = ev->position().x();
+  event.y = ev->position().y();
+  return event;
+}
+
+/**
+ * @brief InputEvent::wheel Creates an event for a scroll of the mouse wheel.
+ * @param ev The Qt event.
+ * @return The event.
+ */
+InputEvent InputEvent::wheel(const QWheelEvent *ev) {
+  InputEvent event;
+  event.type = Wheel;
+  event.buttons = ev->buttons().toInt();
+  event.modifiers = ev->modifiers().toInt();
+  event.x = ev->position().x();
+  event.y = ev->position().y();
+  event.deltaX = ev->angleDelta().x();
+  event.deltaY = ev->angleDelta().y();
+  return event;
+}
+
+/**
+ * @brief InputEvent::toQEvent Recreates the Qt event of a keyboard or mouse
+ * event.
+ * @return The Qt event, or nullptr if this is a UI event or a frame.
+ */
+std::unique_ptr<QEvent> InputEvent::toQEvent() const {
+  QPointF position(x, y);
+  switch (type) {
+    case KeyPress:
+    case KeyRelease:
+      return std::make_unique<QKeyEvent>(type == KeyPress ? QEvent::KeyPress : QEvent::KeyRelease,
+                                         value, toModifiers(modifiers));
+    case MousePress:
+    case MouseRelease:
+    case MouseDoubleClick:
+    case MouseMove: {
+      QEvent::Type qtType = type == MousePress     ? QEvent::MouseButtonPress
+                            : type == MouseRelease ? QEvent::MouseButtonRelease
+                            : type == MouseMove    ? QEvent::MouseMove
+                                                   : QEvent::MouseButtonDblClick;
+      return std::make_unique<QMouseEvent>(qtType, position, position, Qt::MouseButton(value),
+                                           toButtons(buttons), toModifiers(modifiers));
+    }
+    case Wheel:
+      return std::make_unique<QWheelEvent>(position, position, QPoint(), QPoint(deltaX, deltaY),
+                                           toButtons(buttons), toModifiers(modifiers),
+                                           Qt::NoScrollPhase, false);
+    default:
+      return nullptr;
+  }
+}
+
+/**
+ * @brief operator << Writes an event with only the fields its type uses.
+ */
+QDataStream &operator<<(QDataStream &out, const InputEvent &event) {
+  out << quint8(event.type) << event.nanoseconds;
+  switch (event.type) {
+    case InputEvent::Frame:
+    case InputEvent::ResetRotation:
+    case InputEvent::ResetScale:
+      break;
+    case InputEvent::KeyPress:
+    case InputEvent::KeyRelease:
+      out << event.value << event.modifiers;
+      break;
+    case InputEvent::Wheel:
+      out << event.buttons << event.modifiers << event.x << event.y << event.deltaX
+          << event.deltaY;
+      break;
+    case InputEvent::MousePress:
+    case InputEvent::MouseRelease:
+    case InputEvent::MouseDoubleClick:
+    case InputEvent::MouseMove:
+      out << event.value << event.buttons << event.modifiers << event.x << event.y;
+      break;
+    default:
+      out << event.value;
+      break;
+  }
+  return out;
+}
+
+/**
+ * @brief operator >> Reads an event written by operator <<.
+ */
+QDataStream &operator>>(QDataStream &in, InputEvent &event) {
+  quint8 type;
+  in >> type >> event.nanoseconds;
+  event.type = InputEvent::Type(type);
+  switch (event.type) {
+    case InputEvent::Frame:
+    case InputEvent::ResetRotation:
+    case InputEvent::ResetScale:
+      break;
+    case InputEvent::KeyPress:
+    case InputEvent::KeyRelease:
+      in >> event.value >> event.modifiers;
+      break;
+    case InputEvent::Wheel:
+      in >> event.buttons >> event.modifiers >> event.x >> event.y >> event.deltaX >>
+          event.deltaY;
+      break;
+    case InputEvent::MousePress:
+    case InputEvent::MouseRelease:
+    case InputEvent::MouseDoubleClick:
+    case InputEvent::MouseMove:
+      in >> event.value >> event.buttons >> event.modifiers >> event.x >> event.y;
+      break;
+    default:
+      in >> event.value;
+      break;
+  }
+  return in;
+}
+
+// --- InputRecorder
+
+/**
+ * @brief InputRecorder::global Returns the recorder shared by the
+ * application. It starts recording to CG_RECORD, unless a recording is being
+ * replayed.
+ * @return The shared recorder.
+ */
+InputRecorder &InputRecorder::global() {
+  static InputRecorder instance;
+  static bool started = [] {
+    QString filename = qEnvironmentVariable("CG_RECORD");
+    if (filename.isEmpty() || !qEnvironmentVariableIsEmpty("CG_REPLAY")) return false;
+    return instance.start(filename);
+  }();
+  Q_UNUSED(started)
+  return instance;
+}
+
+/**
+ * @brief InputRecorder::start Starts a new recording.
+ * @param filename File to write to; it is overwritten.
+ * @return Whether the file could be opened.
+ */
+bool InputRecorder::start(const QString &filename) {
+  stop();
+  file.setFileName(filename);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning() << "Cannot record input to" << filename;
+    return false;
+  }
+  qDebug() << ":: Recording input to" << filename;
+
+  stream.setDevice(&file);
+  prepareStream(stream);
+  stream.writeRawData(magic, sizeof(magic));
+  clock.start();
+  return true;
+}
+
+/**
+ * @brief InputRecorder::stop Finishes the recording, if any.
+ */
+void InputRecorder::stop() {
+  if (!isRecording()) return;
+  stream.setDevice(nullptr);
+  file.close();
+}
+
+/**
+ * @brief InputRecorder::record Appends an event to the recording. Does
+ * nothing when not recording.
+ * @param event The event; its time is set here.
+ */
+void InputRecorder::record(InputEvent event) {
+  if (!isRecording()) return;
+  event.nanoseconds = clock.nsecsElapsed();
+  stream << event;
+}
+
+// --- InputReplayer
+
+/**
+ * @brief InputReplayer::InputReplayer Constructs a replayer without events.
+ * @param view The view that receives the input events and renders frames.
+ * @param parent The parent object.
+ */
+InputReplayer::InputReplayer(MainView *view, QObject *parent)
+    : QObject(parent), view(view) {}
+
+/**
+ * @brief InputReplayer::open Reads a recording.
+ * @param filename File written by InputRecorder.
+ * @return Whether it was a valid recording.
+ */
+bool InputReplayer::open(const QString &filename) {
+  QFile file(filename);
+  if (!file.open(QIODevice::ReadOnly)) {
+    qWarning() << "Cannot open recording" << filename;
+    return false;
+  }
+
+  QDataStream in(&file);
+  prepareStream(in);
+  char fileMagic[sizeof(magic)];
+  in.readRawData(fileMagic, sizeof(fileMagic));
+  if (!std::equal(magic, magic + sizeof(magic), fileMagic)) {
+    qWarning() << filename << "is not an input recording";
+    return false;
+  }
+
+  events.clear();
+  while (!in.atEnd() && in.status() == QDataStream::Ok) {
+    InputEvent event;
+    in >> event;
+    if (in.status() == QDataStream::Ok) events.push_back(event);
+  }
+  qDebug() << ":: Replaying" << events.size() << "input events from" << filename;
+  return true;
+}
+
+/**
+ * @brief InputReplayer::start Starts the replay once control returns to the
+ * event loop.
+ * @param asFastAsPossible Whether to ignore the recorded timestamps.
+ */
+void InputReplayer::start(bool asFastAsPossible) {
+  fast = asFastAsPossible;
+  next = 0;
+  timings.clear();
+  clock.start();
+  lastFrameEnd = 0;
+  QTimer::singleShot(0, this, SLOT(replayNext()));
+}
+
+/**
+ * @brief InputReplayer::replayNext Delivers events up to and including the
+ * next frame, or waits until the next event is due.
+ */
+void InputReplayer::replayNext() {
+  while (next < events.size()) {
+    const InputEvent &event = events[next];
+    if (!fast) {
+      qint64 wait = (event.nanoseconds - clock.nsecsElapsed()) / 1000000;
+      if (wait > 0) {
+        QTimer::singleShot(wait, this, SLOT(replayNext()));
+        return;
+      }
+    }
+    ++next;
+
+    if (event.type == InputEvent::Frame) {
+      renderFrame();
+      // Return to the event loop so the frame is shown before going on
+      QTimer::singleShot(0, this, SLOT(replayNext()));
+      return;
+    }
+
+    std::unique_ptr<QEvent> qtEvent = event.toQEvent();
+    if (qtEvent) {
+      QCoreApplication::sendEvent(view, qtEvent.get());
+    } else {
+      emit eventDue(event);
+    }
+  }
+
+  logSummary();
+  emit finished();
+}
+
+/**
+ * @brief InputReplayer::renderFrame Renders a recorded frame right away and
+ * stores its timings.
+ */
+void InputReplayer::renderFrame() {
+  view->repaint();
+
+  qint64 now = clock.nsecsElapsed();
+  FrameTiming timing;
+  timing.paintMilliseconds = view->frameStats().paintMilliseconds;
+  timing.planMilliseconds = view->frameStats().planMilliseconds;
+  timing.gpuMilliseconds = view->frameStats().gpuMilliseconds;
+  timing.intervalMilliseconds = (now - lastFrameEnd) / 1e6;
+  timing.gpuBytes = view->frameStats().gpuBytes;
+  timings.push_back(timing);
+  lastFrameEnd = now;
+}
+
+/**
+ * @brief InputReplayer::logSummary Logs the frame count and the main
+ * statistics of the frame times.
+ */
+void InputReplayer::logSummary() const {
+  std::vector<double> paint, interval;
+  for (const FrameTiming &timing : timings) {
+    paint.push_back(timing.paintMilliseconds);
+    interval.push_back(timing.intervalMilliseconds);
+  }
+  double seconds = clock.nsecsElapsed() / 1e9;
+  qDebug().nospace() << ":: Replayed " << timings.size() << " frames in " << seconds
+                     << " s: paint median " << percentile(paint, 0.5) << " ms, p95 "
+                     << percentile(paint, 0.95) << " ms, interval median "
+                     << percentile(interval, 0.5) << " ms, p95 " << percentile(interval, 0.95)
+                     << " ms";
+}
+
+/**
+ * @brief InputReplayer::writeTimings Writes the timings of every replayed
+ * frame, and a summary of them, as JSON. The video memory of the view is
+ * written per frame, and at the end per category and per object, with its
+ * high-water mark.
+ * @param filename The file to write.
+ * @return Whether the file could be written.
+ */
+bool InputReplayer::writeTimings(const QString &filename) const {
+  QJsonArray frames;
+  std::vector<double> paint, plan, gpu, interval;
+  for (const FrameTiming &timing : timings) {
+    QJsonObject frame;
+    frame["paint"] = timing.paintMilliseconds;
+    frame["plan"] = timing.planMilliseconds;
+    frame["gpu"] = timing.gpuMilliseconds;
+    frame["interval"] = timing.intervalMilliseconds;
+    frame["gpuBytes"] = timing.gpuBytes;
+    frames.append(frame);
+    paint.push_back(timing.paintMilliseconds);
+    plan.push_back(timing.planMilliseconds);
+    gpu.push_back(timing.gpuMilliseconds);
+    interval.push_back(timing.intervalMilliseconds);
+  }
+
+  QJsonObject report;
+  report["mode"] = fast ? "fast" : "recorded";
+  report["frameCount"] = int(timings.size());
+  report["paint"] = summarize(paint);
+  report["plan"] = summarize(plan);
+  report["gpu"] = summarize(gpu);
+  report["interval"] = summarize(interval);
+  report["gpuMemory"] = gpuMemory(view->gpuResources());
+  report["frames"] = frames;
+
+  QFile file(filename);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning() << "Cannot write frame timings to" << filename;
+    return false;
+  }
+  file.write(QJsonDocument(report).toJson());
+  return true;
+}
@@ -0,0 +1,137 @@
+#ifndef INPUTRECORDER_H
+#define INPUTRECORDER_H
+
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QEvent>
+#include <QFile>
+#include <QKeyEvent>
+#include <QMouseEvent>
+#include <QObject>
+#include <QWheelEvent>
+
+#include <memory>
+#include <vector>
+
+class MainView;
+
+/**
+ * @brief A single recorded UI or input event.
+ *
+ * Frame marks the start of a paintGL, so a replay renders every frame after
+ * exactly the same events as the recorded run did.
+ */
+struct InputEvent {
+  enum Type : quint8 {
+    Frame,
+    RotationX,
+    RotationY,
+    RotationZ,
+    ResetRotation,
+    Scale,
+    ResetScale,
+    KeyPress,
+    KeyRelease,
+    MousePress,
+    MouseRelease,
+    MouseDoubleClick,
+    MouseMove,
+    Wheel,
+  };
+
+  Type type = Frame;
+  qint64 nanoseconds = 0;  // since the recording started
+
+  qint32 value = 0;  // slider value, key or mouse button
+  quint32 buttons = 0;
+  quint32 modifiers = 0;
+  float x = 0;
+  float y = 0;
+  qint32 deltaX = 0;  // wheel angle delta
+  qint32 deltaY = 0;
+
+  static InputEvent slider(Type type, int value);
+  static InputEvent key(Type type, const QKeyEvent *event);
+  static InputEvent mouse(Type type, const QMouseEvent *event);
+  static InputEvent wheel(const QWheelEvent *event);
+
+  // The Qt event to deliver to MainView, or nullptr for UI events
+  std::unique_ptr<QEvent> toQEvent() const;
+};
+
+QDataStream &operator<<(QDataStream &out, const InputEvent &event);
+QDataStream &operator>>(QDataStream &in, InputEvent &event);
+
+/**
+ * @brief The InputRecorder class writes timestamped input events to a compact
+ * binary file.
+ */
+class InputRecorder {
+ public:
+  // Shared instance; records to CG_RECORD when that is set
+  static InputRecorder &global();
+
+  bool start(const QString &filename);
+  void stop();
+  bool isRecording() const { return file.isOpen(); }
+
+  // Stamps the event with the current time and appends it
+  void record(InputEvent event);
+
+ private:
+  QFile file;
+  QDataStream stream;
+  QElapsedTimer clock;
+};
+
+/**
+ * @brief The InputReplayer class plays back a recording, either at the
+ * recorded speed or as fast as possible, and collects per-frame timings.
+ *
+ * UI events are handed out through eventDue() for the window to apply; input
+ * events are sent to the view directly. Every recorded frame is rendered
+ * synchronously, so the timings cover the same frames in every run.
+ */
+class InputReplayer : public QObject {
+  Q_OBJECT
+
+ public:
+  InputReplayer(MainView *view, QObject *parent = nullptr);
+
+  bool open(const QString &filename);
+  void start(bool asFastAsPossible);
+
+  // Writes the per-frame timings and their summary, and the video memory
+  // use of the view, as JSON
+  bool writeTimings(const QString &filename) const;
+
+ signals:
+  void eventDue(const InputEvent &event);
+  void finished();
+
+ private slots:
+  void replayNext();
+
+ private:
+  struct FrameTiming {
+    double paintMilliseconds;
+    double planMilliseconds;
+    double gpuMilliseconds;
+    double intervalMilliseconds;
+    double gpuBytes;
+  };
+
+  void renderFrame();
+  void logSummary() const;
+
+  MainView *view;
+  std::vector<InputEvent> events;
+  size_t next = 0;
+  bool fast = false;
+
+  QElapsedTimer clock;
+  qint64 lastFrameEnd = 0;
+  std::vector<FrameTiming> timings;
+};
+
+#endif  // INPUTRECORDER_H
@@ -0,0 +1,161 @@
+#include "jobsystem.h"
+
+#include <QtGlobal>
+
+#include <algorithm>
+
+namespace {
+// The job system the calling thread works for, and the index of its own
+// queue there; null for threads that are not workers
+thread_local const JobSystem *currentOwner = nullptr;
+thread_local unsigned currentQueue = 0;
+}  // namespace
+
+/**
+ * @brief JobSystem::JobSystem Starts the worker threads.
+ * @param workerCount Number of threads in addition to the caller. When 0,
+ * every parallelFor runs on the calling thread. When negative, one less than
+ * the number of hardware threads is used.
+ */
+JobSystem::JobSystem(int workerCount) {
+  if (workerCount < 0) {
+    workerCount = std::max(1u, std::thread::hardware_concurrency()) - 1;
+  }
+
+  queues.resize(workerCount + 1);
+  for (std::unique_ptr<Queue> &queue : queues) {
+    queue = std::make_unique<Queue>();
+  }
+
+  workers.reserve(workerCount);
+  for (int i = 0; i < workerCount; ++i) {
+    workers.emplace_back(&JobSystem::workerLoop, this, unsigned(i + 1));
+  }
+}
+
+/**
+ * @brief JobSystem::~JobSystem Stops and joins the worker threads.
+ */
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    quit = true;
+  }
+  wake.notify_all();
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+}
+
+/**
+ * @brief JobSystem::global Returns the job system shared by the application.
+ * @return The shared job system.
+ */
+JobSystem &JobSystem::global() {
+  static JobSystem instance([] {
+    bool set = false;
+    int threads = qEnvironmentVariableIntValue("CG_JOB_THREADS", &set);
+    return set && threads > 0 ? threads - 1 : -1;
+  }());
+  return instance;
+}
+
+/**
+ * @brief JobSystem::parallelFor Splits [0, count) into ranges of grain items
+ * and runs body on them in parallel.
+ * @param count Number of items.
+ * @param grain Maximum number of items per job.
+ * @param body Function called with the begin and end of every range.
+ */
+void JobSystem::parallelFor(size_t count, size_t grain,
+                            const std::function<void(size_t, size_t)> &body) {
+  grain = std::max<size_t>(grain, 1);
+  if (count <= grain || workers.empty()) {
+    if (count > 0) body(0, count);
+    return;
+  }
+
+  size_t jobCount = (count + grain - 1) / grain;
+  std::atomic<size_t> remaining{jobCount};
+
+  // Announce the jobs before they are visible, so that a worker which pops
+  // one never sees the counter drop below zero.
+  queued.fetch_add(jobCount);
+
+  // Deal the jobs out round-robin; stealing evens out the rest
+  for (size_t job = 0; job < jobCount; ++job) {
+    size_t begin = job * grain;
+    size_t end = std::min(count, begin + grain);
+    Queue &queue = *queues[job % queues.size()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.jobs.push_back({[&body, begin, end] { body(begin, end); }, &remaining});
+  }
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+  }
+  wake.notify_all();
+
+  // Help out until every job of this call has finished. A worker of another
+  // job system has no queue here and shares queue 0.
+  unsigned home = currentOwner == this ? currentQueue : 0;
+  while (remaining.load(std::memory_order_acquire) > 0) {
+    if (!runOne(home)) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+/**
+ * @brief JobSystem::runOne Runs a single job from the home queue, or steals
+ * one from another queue.
+ * @param home Index of the queue owned by the calling thread.
+ * @return Whether a job was run.
+ */
+bool JobSystem::runOne(unsigned home) {
+  Job job;
+  bool found = false;
+
+  {
+    Queue &own = *queues[home];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.jobs.empty()) {
+      job = std::move(own.jobs.back());
+      own.jobs.pop_back();
+      found = true;
+    }
+  }
+
+  for (size_t offset = 1; !found && offset < queues.size(); ++offset) {
+    Queue &victim = *queues[(home + offset) % queues.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.jobs.empty()) {
+      job = std::move(victim.jobs.front());
+      victim.jobs.pop_front();
+      found = true;
+    }
+  }
+
+  if (!found) return false;
+
+  queued.fetch_sub(1);
+  job.run();
+  job.remaining->fetch_sub(1, std::memory_order_release);
+  return true;
+}
+
+/**
+ * @brief JobSystem::workerLoop Main loop of a worker thread.
+ * @param index Index of the worker's own queue.
+ */
+void JobSystem::workerLoop(unsigned index) {
+  currentOwner = this;
+  currentQueue = index;
+
+  while (true) {
+    if (runOne(index)) continue;
+
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    wake.wait(lock, [this] { return quit || queued.load() > 0; });
+    if (quit) return;
+  }
+}
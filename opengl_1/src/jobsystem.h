@@ -0,0 +1,68 @@
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief The JobSystem class runs data-parallel work on a fixed set of worker
+ * threads.
+ *
+ * Every worker owns a queue. A worker pops jobs from the back of its own
+ * queue and, when that is empty, steals from the front of the others. The
+ * thread that submits work helps out until its jobs are done, so a
+ * parallelFor never blocks a thread that could be working.
+ */
+class JobSystem {
+ public:
+  // A negative workerCount picks one less than the hardware threads
+  explicit JobSystem(int workerCount = -1);
+  ~JobSystem();
+
+  JobSystem(const JobSystem &) = delete;
+  JobSystem &operator=(const JobSystem &) = delete;
+
+  // Shared instance; CG_JOB_THREADS overrides the number of threads, and 1
+  // runs everything on the calling thread
+  static JobSystem &global();
+
+  // Number of threads taking part in a parallelFor, including the caller
+  unsigned threadCount() const { return workers.size() + 1; }
+
+  // Calls body(begin, end) on ranges of at most grain items covering
+  // [0, count), and returns once all of them have finished.
+  void parallelFor(size_t count, size_t grain,
+                   const std::function<void(size_t, size_t)> &body);
+
+ private:
+  struct Job {
+    std::function<void()> run;
+    std::atomic<size_t> *remaining;
+  };
+
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Job> jobs;
+  };
+
+  void workerLoop(unsigned index);
+  bool runOne(unsigned home);
+
+  // Queue 0 is shared by threads that are not workers of this instance
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread> workers;
+
+  std::mutex sleepMutex;
+  std::condition_variable wake;
+  std::atomic<long> queued{0};
+  bool quit = false;
+};
+
+#endif  // JOBSYSTEM_H
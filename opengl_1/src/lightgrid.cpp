@@ -0,0 +1,203 @@
+#include "lightgrid.h"
+
+#include <QColor>
+#include <QElapsedTimer>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+/**
+ * @brief LightGrid::LightGrid Constructs an empty grid; call setProjection()
+ * before assign().
+ * @param jobs Job system the slices are assigned on.
+ */
+LightGrid::LightGrid(JobSystem &jobs)
+    : jobs(jobs), sliceIndices(slices), sliceClusters(slices), ranges(clusterCount) {}
+
+/**
+ * @brief LightGrid::setProjection Recomputes the bounding box of every
+ * cluster when the projection changed.
+ * @param projection The projection transformation.
+ * @param nearDistance Distance of the near plane.
+ * @param farDistance Distance of the far plane.
+ */
+void LightGrid::setProjection(const QMatrix4x4 &projection, float nearDistance,
+                              float farDistance) {
+  if (projection == currentProjection && nearDistance == nearPlane && farDistance == farPlane &&
+      !boxes.empty()) {
+    return;
+  }
+  currentProjection = projection;
+  nearPlane = nearDistance;
+  farPlane = farDistance;
+
+  float logRange = std::log(farPlane / nearPlane);
+  logScale = slices / logRange;
+  logBias = -slices * std::log(nearPlane) / logRange;
+
+  sliceDepths.resize(slices + 1);
+  for (int s = 0; s <= slices; ++s) {
+    sliceDepths[s] = nearPlane * std::pow(farPlane / nearPlane, float(s) / slices);
+  }
+
+  // At depth d, normalized device x = projection(0, 0) * x / d
+  float xScale = 1 / projection(0, 0);
+  float yScale = 1 / projection(1, 1);
+  boxes.resize(clusterCount);
+  for (int s = 0; s < slices; ++s) {
+    float d0 = sliceDepths[s], d1 = sliceDepths[s + 1];
+    for (int y = 0; y < tilesY; ++y) {
+      float ny0 = -1 + 2.0f * y / tilesY, ny1 = -1 + 2.0f * (y + 1) / tilesY;
+      for (int x = 0; x < tilesX; ++x) {
+        float nx0 = -1 + 2.0f * x / tilesX, nx1 = -1 + 2.0f * (x + 1) / tilesX;
+        Box &box = boxes[x + tilesX * (y + tilesY * s)];
+        box.min = QVector3D(std::min(nx0 * d0, nx0 * d1) * xScale,
+                            std::min(ny0 * d0, ny0 * d1) * yScale, -d1);
+        box.max = QVector3D(std::max(nx1 * d0, nx1 * d1) * xScale,
+                            std::max(ny1 * d0, ny1 * d1) * yScale, -d0);
+      }
+    }
+  }
+}
+
+/**
+ * @brief LightGrid::assign Builds the light list of every cluster.
+ * @param lights The lights, in eye space.
+ */
+void LightGrid::assign(const std::vector<PointLight> &lights) {
+  QElapsedTimer timer;
+  timer.start();
+
+  jobs.parallelFor(slices, 1, [&](size_t begin, size_t end) {
+    for (size_t s = begin; s < end; ++s) {
+      assignSlice(lights, s);
+    }
+  });
+
+  // Concatenate the slices; within a slice they are sorted by cluster
+  size_t total = 0;
+  for (int s = 0; s < slices; ++s) {
+    total += sliceIndices[s].size();
+  }
+  indices.resize(total);
+  uint32_t offset = 0;
+  for (int s = 0; s < slices; ++s) {
+    std::copy(sliceIndices[s].begin(), sliceIndices[s].end(), indices.begin() + offset);
+    LightCluster *cluster = &ranges[tilesX * tilesY * s];
+    for (int c = 0; c < tilesX * tilesY; ++c) {
+      cluster[c].offset += offset;
+    }
+    offset += sliceIndices[s].size();
+  }
+
+  assignMilliseconds = timer.nsecsElapsed() / 1e6;
+}
+
+/**
+ * @brief LightGrid::assignSlice Collects the lights of the clusters in one
+ * slice, sorted by cluster. Offsets are relative to the slice.
+ * @param lights The lights.
+ * @param slice The slice.
+ */
+void LightGrid::assignSlice(const std::vector<PointLight> &lights, int slice) {
+  const int tileCount = tilesX * tilesY;
+  const Box *sliceBoxes = &boxes[tileCount * slice];
+  LightCluster *sliceRanges = &ranges[tileCount * slice];
+  float d0 = sliceDepths[slice], d1 = sliceDepths[slice + 1];
+  float xProjection = currentProjection(0, 0);
+  float yProjection = currentProjection(1, 1);
+
+  // Pairs of cluster (relative to the slice) and light
+  std::vector<uint32_t> &clusterOf = sliceClusters[slice];
+  std::vector<uint32_t> &lightOf = sliceIndices[slice];
+  clusterOf.clear();
+  lightOf.clear();
+
+  for (uint32_t i = 0; i < lights.size(); ++i) {
+    const PointLight &light = lights[i];
+    float depth = -light.position.z();
+    float r = light.radius;
+    float nearDepth = std::max(d0, depth - r);
+    float farDepth = std::min(d1, depth + r);
+    if (nearDepth > farDepth) continue;
+
+    // Screen extent of the box around the sphere, within the slice
+    float x0 = light.position.x() - r, x1 = light.position.x() + r;
+    float y0 = light.position.y() - r, y1 = light.position.y() + r;
+    float nx0 = xProjection * x0 / (x0 >= 0 ? farDepth : nearDepth);
+    float nx1 = xProjection * x1 / (x1 >= 0 ? nearDepth : farDepth);
+    float ny0 = yProjection * y0 / (y0 >= 0 ? farDepth : nearDepth);
+    float ny1 = yProjection * y1 / (y1 >= 0 ? nearDepth : farDepth);
+    if (nx1 < -1 || nx0 > 1 || ny1 < -1 || ny0 > 1) continue;
+
+    int tx0 = std::clamp(int(std::floor((nx0 + 1) / 2 * tilesX)), 0, tilesX - 1);
+    int tx1 = std::clamp(int(std::floor((nx1 + 1) / 2 * tilesX)), 0, tilesX - 1);
+    int ty0 = std::clamp(int(std::floor((ny0 + 1) / 2 * tilesY)), 0, tilesY - 1);
+    int ty1 = std::clamp(int(std::floor((ny1 + 1) / 2 * tilesY)), 0, tilesY - 1);
+
+    for (int ty = ty0; ty <= ty1; ++ty) {
+      for (int tx = tx0; tx <= tx1; ++tx) {
+        uint32_t cluster = tx + tilesX * ty;
+        const Box &box = sliceBoxes[cluster];
+        // Distance from the centre to the closest point of the box
+        QVector3D closest(std::clamp(light.position.x(), box.min.x(), box.max.x()),
+                          std::clamp(light.position.y(), box.min.y(), box.max.y()),
+                          std::clamp(light.position.z(), box.min.z(), box.max.z()));
+        if ((closest - light.position).lengthSquared() <= r * r) {
+          clusterOf.push_back(cluster);
+          lightOf.push_back(i);
+        }
+      }
+    }
+  }
+
+  // Counting sort of the pairs by cluster
+  for (int c = 0; c < tileCount; ++c) {
+    sliceRanges[c] = {0, 0};
+  }
+  for (uint32_t cluster : clusterOf) {
+    sliceRanges[cluster].count++;
+  }
+  uint32_t offset = 0;
+  for (int c = 0; c < tileCount; ++c) {
+    sliceRanges[c].offset = offset;
+    offset += sliceRanges[c].count;
+  }
+  std::vector<uint32_t> sorted(lightOf.size());
+  std::vector<uint32_t> next(tileCount);
+  for (int c = 0; c < tileCount; ++c) {
+    next[c] = sliceRanges[c].offset;
+  }
+  for (size_t p = 0; p < lightOf.size(); ++p) {
+    sorted[next[clusterOf[p]]++] = lightOf[p];
+  }
+  lightOf.swap(sorted);
+}
+
+/**
+ * @brief scatterLights Places lights at random in a volume. The same count
+ * always gives the same lights.
+ * @param count Number of lights.
+ * @param volume The volume, in eye space.
+ * @return The lights.
+ */
+std::vector<PointLight> scatterLights(int count, const Bounds &volume) {
+  std::mt19937 random(count);
+  std::uniform_real_distribution<float> unit(0, 1);
+
+  // Every point is within reach of about four lights
+  QVector3D size = volume.max - volume.min;
+  float volumeSize = size.x() * size.y() * size.z();
+  float radius = std::cbrt(3 * volumeSize / (3.14159265f * std::max(count, 1)));
+  radius = std::min(radius, size.length() / 2);
+
+  std::vector<PointLight> lights(std::max(count, 0));
+  for (PointLight &light : lights) {
+    light.position = volume.min + QVector3D(unit(random), unit(random), unit(random)) * size;
+    light.radius = radius;
+    QColor colour = QColor::fromHsvF(unit(random), 0.7f, 1.0f);
+    light.colour = QVector3D(colour.redF(), colour.greenF(), colour.blueF()) * 0.6f;
+  }
+  return lights;
+}
@@ -0,0 +1,96 @@
+#ifndef LIGHTGRID_H
+#define LIGHTGRID_H
+
+#include <QMatrix4x4>
+#include <QVector3D>
+
+#include <cstdint>
+#include <vector>
+
+#include "bounds.h"
+#include "jobsystem.h"
+
+/**
+ * @brief A point light in eye space. Its influence fades to zero at radius.
+ */
+struct PointLight {
+  QVector3D position;
+  float radius;
+  QVector3D colour;
+};
+
+/**
+ * @brief The lights of one cluster: count entries of lightIndices(),
+ * starting at offset.
+ */
+struct LightCluster {
+  uint32_t offset;
+  uint32_t count;
+};
+
+/**
+ * @brief The LightGrid class assigns point lights to the clusters of the
+ * view frustum, so a fragment only has to consider the lights of its own
+ * cluster.
+ *
+ * The frustum is divided into tiles on screen and into slices in depth that
+ * grow exponentially, so clusters stay roughly cube-shaped. Every slice is
+ * assigned on its own job: each light overlapping the slice is projected to
+ * a range of tiles, and is then tested against the bounding box of every
+ * cluster in that range.
+ */
+class LightGrid {
+ public:
+  static const int tilesX = 16;
+  static const int tilesY = 9;
+  static const int slices = 24;
+  static const int clusterCount = tilesX * tilesY * slices;
+
+  explicit LightGrid(JobSystem &jobs = JobSystem::global());
+
+  // The projection must be a symmetric perspective projection
+  void setProjection(const QMatrix4x4 &projection, float nearDistance, float farDistance);
+  void assign(const std::vector<PointLight> &lights);
+
+  // Per cluster, x fastest, then y (upwards), then depth
+  const std::vector<LightCluster> &clusters() const { return ranges; }
+  const std::vector<uint32_t> &lightIndices() const { return indices; }
+
+  // The slice of eye-space depth d is floor(log(d) * sliceScale + sliceBias)
+  float sliceScale() const { return logScale; }
+  float sliceBias() const { return logBias; }
+
+  double milliseconds() const { return assignMilliseconds; }
+
+ private:
+  struct Box {
+    QVector3D min;
+    QVector3D max;
+  };
+
+  void assignSlice(const std::vector<PointLight> &lights, int slice);
+
+  JobSystem &jobs;
+  QMatrix4x4 currentProjection;
+  float nearPlane = 0;
+  float farPlane = 0;
+  float logScale = 0;
+  float logBias = 0;
+
+  std::vector<float> sliceDepths;  // slices + 1 boundaries
+  std::vector<Box> boxes;          // per cluster, in eye space
+
+  // Per slice, reused between frames
+  std::vector<std::vector<uint32_t>> sliceIndices;
+  std::vector<std::vector<uint32_t>> sliceClusters;
+
+  std::vector<LightCluster> ranges;
+  std::vector<uint32_t> indices;
+  double assignMilliseconds = 0;
+};
+
+// Scatters count lights over volume with random colours. Their radius
+// shrinks with their number, so every point is lit by a few lights.
+std::vector<PointLight> scatterLights(int count, const Bounds &volume);
+
+#endif  // LIGHTGRID_H
@@ -1,10 +1,26 @@
 #include "mainview.h"
+#include "inputrecorder.h"
 #include "model.h"
+#include "simdmath.h"
 #include "triangle.h"
 
 #include <QDateTime>
+#include <QElapsedTimer>
+#include <QSurfaceFormat>
+#include <QVector2D>
 
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
 #include <cstddef>
+#include <vector>
+
+namespace {
+// Clipping planes of the projection
+const float nearPlane = 0.2f;
+const float farPlane = 20.0f;
+}  // namespace
+
 /**
  * @brief MainView::MainView Constructs a new main view.
  *
@@ -14,10 +30,50 @@ MainView::MainView(QWidget *parent) : QOpenGLWidget(parent) {
   qDebug() << "MainView constructor";
 
   connect(&timer, SIGNAL(timeout()), this, SLOT(update()));
+
+  // Development mode: load the shaders from disk instead of the resources and
+  // re-link them whenever they are saved.
+  QString shaderDir = qEnvironmentVariable("CG_SHADER_DIR");
+  if (!shaderDir.isEmpty()) {
+    qDebug() << ":: Hot-reloading shaders from" << shaderDir;
+    shaders.setSourceDirectory(shaderDir);
+    connect(&shaders, SIGNAL(sourcesChanged()), this,
+            SLOT(onShaderSourcesChanged()));
+  }
+
+  // GPU time per frame to hold by lowering the resolution; 0 renders at
+  // full resolution always
+  bool budgetSet = false;
+  float budget = qEnvironmentVariable("CG_FRAME_BUDGET_MS").toFloat(&budgetSet);
+  if (budgetSet) {
+    renderScaler.budgetMilliseconds = std::max(budget, 0.0f);
+  }
+
+  // GPU-driven drawing needs OpenGL 4.3. Ask for it when the driver has it
+  // and stay on 3.3 otherwise; CG_INDIRECT=0 forces the 3.3 path.
+  if (qEnvironmentVariable("CG_INDIRECT") != "0" && IndirectRenderer::isSupported()) {
+    QSurfaceFormat glFormat = format();
+    glFormat.setVersion(4, 3);
+    setFormat(glFormat);
+  }
+
+  // Out-of-core rendering of a preprocessed chunk file (see meshchunker)
+  QString streamFile = qEnvironmentVariable("CG_STREAM_FILE");
+  if (!streamFile.isEmpty()) {
+    streamer = std::make_unique<ChunkStreamer>();
+    if (!streamer->open(streamFile)) {
+      streamer.reset();
+    }
+  }
 }
 
 
-void MainView::initializePyramid(GLuint VBO, GLuint VAO, QMatrix4x4 *modelTrans, int *vertexCount) {
+/**
+ * @brief MainView::initializePyramid Fills the per-mesh vectors at the given
+ * index with a colored pyramid.
+ * @param mesh Index of the mesh.
+ */
+void MainView::initializePyramid(int mesh) {
 
   // initialize vertices
   Vertex v1(-1,1,1,1,0,0);
@@ -35,14 +91,18 @@ void MainView::initializePyramid(GLuint VBO, GLuint VAO, QMatrix4x4 *modelTrans,
     v2,v3,v5,
     v4,v5,v3,
   };
-  *vertexCount = vertices.size();
+  scene.vertexCounts[mesh] = vertices.size();
+  for (const Vertex &v : vertices) {
+    scene.bounds[mesh].extend(QVector3D(v.x, v.y, v.z));
+  }
 
   // Create VAO & VBO
-  glBindVertexArray(VAO);
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  scene.vaos[mesh] = resources.createVertexArray(GpuResources::Geometry, "pyramid");
+  scene.vbos[mesh] = resources.createBuffer(GpuResources::Geometry, "pyramid vertices");
+  glBindVertexArray(scene.vaos[mesh].id());
 
   // Initialize buffer data store
-  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+  resources.bufferData(scene.vbos[mesh], GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
 
   // specify and enable vertex attribute pointers
   glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,sizeof(Vertex),(void *)0);
@@ -50,30 +110,63 @@ void MainView::initializePyramid(GLuint VBO, GLuint VAO, QMatrix4x4 *modelTrans,
   glEnableVertexAttribArray(0);
   glEnableVertexAttribArray(1);
 
-  // translate pyramid
-  modelTrans->setToIdentity();
-  modelTrans->translate(-2,0,-6);
-
+  scene.shaderFeatures[mesh] = VertexColour;
 }
 
-void MainView::initializeKnot(GLuint VBO, GLuint VAO, QMatrix4x4 *modelTrans, int *vertexCount) {
-
-  // load model
-  Model knot(":/models/knot.obj");
-
-  // initialize and fill vertices vector
-  std::vector<Vertex> vertices;
-  for (QVector3D i : knot.getMeshCoords()) {
-      vertices.push_back(Vertex(i.x(), i.y(), i.z(), abs(i.x()), abs(i.y()), abs(i.z())));
+/**
+ * @brief MainView::initializeKnot Fills the per-mesh vectors at the given
+ * index with the knot model.
+ * @param mesh Index of the mesh.
+ */
+void MainView::initializeKnot(int mesh) {
+
+  // load model, keeping only the welded data for indexed rendering
+  Model knot(":/models/knot.obj", Model::Indexed);
+  Span<const QVector3D> coords = knot.getCoords();
+  Span<const unsigned> indices = knot.getTriangleIndices();
+
+  scene.vertexCounts[mesh] = coords.size();
+  scene.indexCounts[mesh] = indices.size();
+
+  // Split the positions per component for the SIMD kernels
+  static_assert(sizeof(QVector3D) == 3 * sizeof(float), "QVector3D must be packed");
+  PositionsSoA positions;
+  positions.fromInterleaved(reinterpret_cast<const float *>(coords.data()), coords.size());
+
+  float min[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+  float max[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+  simd::computeBounds(positions, min, max);
+  scene.bounds[mesh].min = QVector3D(min[0], min[1], min[2]);
+  scene.bounds[mesh].max = QVector3D(max[0], max[1], max[2]);
+
+  // Clusters of triangles that are culled individually every frame
+  scene.meshlets[mesh] = knot.buildMeshlets();
+
+  // Create VAO, VBO & EBO
+  scene.vaos[mesh] = resources.createVertexArray(GpuResources::Geometry, "knot");
+  scene.vbos[mesh] = resources.createBuffer(GpuResources::Geometry, "knot vertices");
+  scene.ebos[mesh] = resources.createBuffer(GpuResources::Geometry, "knot indices");
+  glBindVertexArray(scene.vaos[mesh].id());
+
+  // Initialize buffer data store, and build the vertices directly into it
+  GLsizeiptr size = coords.size() * sizeof(Vertex);
+  resources.bufferData(scene.vbos[mesh], GL_ARRAY_BUFFER, size, nullptr, GL_STATIC_DRAW);
+  static_assert(sizeof(Vertex) == 6 * sizeof(float), "Vertex must be packed");
+  auto *vertices = static_cast<float *>(glMapBufferRange(
+      GL_ARRAY_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+  bool mapped = vertices != nullptr;
+  if (mapped) {
+    simd::writeColouredVertices(positions, vertices);
+    // The store can be lost, e.g. on a mode switch; then upload it again
+    mapped = glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE;
   }
-  *vertexCount = vertices.size();
-
-  // Create VAO & VBO
-  glBindVertexArray(VAO);
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
-
-  // Initialize buffer data store
-  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+  if (!mapped) {
+    qWarning() << ":: Cannot map the knot vertex buffer, uploading a copy instead";
+    std::vector<float> copy(6 * coords.size());
+    simd::writeColouredVertices(positions, copy.data());
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, copy.data());
+  }
+  resources.bufferData(scene.ebos[mesh], GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
 
   // specify and enable vertex attribute pointers
   glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,sizeof(Vertex),(void *)0);
@@ -81,9 +174,118 @@ void MainView::initializeKnot(GLuint VBO, GLuint VAO, QMatrix4x4 *modelTrans, in
   glEnableVertexAttribArray(0);
   glEnableVertexAttribArray(1);
 
-  // translate knot
-  modelTrans->setToIdentity();
-  modelTrans->translate(2,0,-6);
+  scene.shaderFeatures[mesh] = VertexColour;
+}
+
+/**
+ * @brief MainView::initializeOcclusionProxy Creates the unit cube that is
+ * scaled to an object's bounds for its occlusion query.
+ */
+void MainView::initializeOcclusionProxy() {
+  const GLfloat corners[8][3] = {
+    {-1,-1,-1}, {1,-1,-1}, {1,1,-1}, {-1,1,-1},
+    {-1,-1,1}, {1,-1,1}, {1,1,1}, {-1,1,1},
+  };
+  const int faces[36] = {
+    0,2,1, 0,3,2,  4,5,6, 4,6,7,
+    0,1,5, 0,5,4,  3,6,2, 3,7,6,
+    0,4,7, 0,7,3,  1,2,6, 1,6,5,
+  };
+
+  std::vector<GLfloat> vertices;
+  for (int corner : faces) {
+    vertices.insert(vertices.end(), corners[corner], corners[corner] + 3);
+  }
+
+  proxyVAO = resources.createVertexArray(GpuResources::Culling, "occlusion proxy");
+  proxyVBO = resources.createBuffer(GpuResources::Culling, "occlusion proxy vertices");
+  glBindVertexArray(proxyVAO.id());
+  resources.bufferData(proxyVBO, GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
+  glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,3 * sizeof(GLfloat),(void *)0);
+  glEnableVertexAttribArray(0);
+}
+
+/**
+ * @brief MainView::initializeLights Scatters point lights through the space
+ * in front of the camera, creates their texture buffers and lights all
+ * meshes with them.
+ * @param count Number of lights.
+ */
+void MainView::initializeLights(int count) {
+  Bounds volume;
+  volume.min = QVector3D(-5, -3.5f, -18);
+  volume.max = QVector3D(5, 3.5f, -2);
+  pointLights = scatterLights(count, volume);
+
+  std::vector<GLfloat> lightData;
+  lightData.reserve(8 * pointLights.size());
+  for (const PointLight &light : pointLights) {
+    lightData.insert(lightData.end(), {light.position.x(), light.position.y(), light.position.z(),
+                                       light.radius, light.colour.x(), light.colour.y(),
+                                       light.colour.z(), 0});
+  }
+
+  const GLenum formats[3] = {GL_RGBA32F, GL_RG32UI, GL_R32UI};
+  const char *const names[3] = {"lights", "light clusters", "light indices"};
+  for (int i = 0; i < 3; i++) {
+    lightBuffers[i] = resources.createBuffer(GpuResources::Lighting, names[i]);
+    lightTextures[i] = resources.createTexture(GpuResources::Lighting, names[i]);
+    if (i == 0) {
+      resources.bufferData(lightBuffers[i], GL_TEXTURE_BUFFER, lightData.size() * sizeof(GLfloat), lightData.data(), GL_STATIC_DRAW);
+    }
+    glBindTexture(GL_TEXTURE_BUFFER, lightTextures[i].id());
+    glTexBuffer(GL_TEXTURE_BUFFER, formats[i], lightBuffers[i].id());
+  }
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+  for (unsigned &features : scene.shaderFeatures) {
+    features |= ClusteredLighting;
+  }
+  qDebug() << ":: Clustered lighting with" << count << "point lights";
+}
+
+/**
+ * @brief MainView::uploadLightClusters Uploads the light lists of this frame
+ * and binds the light texture buffers to the first texture units.
+ */
+void MainView::uploadLightClusters() {
+  static_assert(sizeof(LightCluster) == 2 * sizeof(GLuint), "LightCluster must be packed");
+  const std::vector<LightCluster> &clusters = lightGrid.clusters();
+  const std::vector<uint32_t> &indices = lightGrid.lightIndices();
+
+  // Orphan the previous storage, the GPU may still be reading it
+  resources.bufferData(lightBuffers[1], GL_TEXTURE_BUFFER, clusters.size() * sizeof(LightCluster), clusters.data(), GL_STREAM_DRAW);
+  // An empty buffer is not a valid texture buffer
+  GLuint none = 0;
+  resources.bufferData(lightBuffers[2], GL_TEXTURE_BUFFER, std::max<size_t>(indices.size(), 1) * sizeof(GLuint),
+                       indices.empty() ? &none : indices.data(), GL_STREAM_DRAW);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+  for (int i = 0; i < 3; i++) {
+    glActiveTexture(GL_TEXTURE0 + i);
+    glBindTexture(GL_TEXTURE_BUFFER, lightTextures[i].id());
+  }
+  glActiveTexture(GL_TEXTURE0);
+}
+
+/**
+ * @brief MainView::setLightUniforms Points a clustered lighting program at
+ * the light texture buffers and describes the cluster grid to it.
+ * @param program The bound program.
+ */
+void MainView::setLightUniforms(QOpenGLShaderProgram *program) {
+  program->setUniformValue("lights", 0);
+  program->setUniformValue("lightClusters", 1);
+  program->setUniformValue("lightIndices", 2);
+  program->setUniformValue("clusterTileScale",
+                           QVector2D(float(LightGrid::tilesX) / renderSize.width(),
+                                     float(LightGrid::tilesY) / renderSize.height()));
+  program->setUniformValue("clusterTilesX", LightGrid::tilesX);
+  program->setUniformValue("clusterTilesY", LightGrid::tilesY);
+  program->setUniformValue("clusterSlices", LightGrid::slices);
+  program->setUniformValue("clusterSliceScale", lightGrid.sliceScale());
+  program->setUniformValue("clusterSliceBias", lightGrid.sliceBias());
 }
 
 /**
@@ -96,9 +298,24 @@ void MainView::initializeKnot(GLuint VBO, GLuint VAO, QMatrix4x4 *modelTrans, in
  */
 MainView::~MainView() {
   qDebug() << "MainView destructor";
-  glDeleteBuffers(vbos.size(), vbos.data());
-  glDeleteVertexArrays(vaos.size(), vaos.data());
+  releaseGL();
+}
+
+/**
+ * @brief MainView::releaseGL Deletes all OpenGL objects with the context
+ * current. Runs when the context is about to be destroyed, or else from the
+ * destructor; the second call does nothing.
+ */
+void MainView::releaseGL() {
+  if (!resources.functions()) return;
+
   makeCurrent();
+  if (indirect) indirect->releaseGL();
+  if (streamer) streamer->releaseGL();
+  renderScaler.releaseGL();
+  shaders.releaseGL();
+  resources.releaseGL();
+  doneCurrent();
 }
 
 // --- OpenGL initialization
@@ -119,8 +336,16 @@ void MainView::initializeGL() {
     debugLogger.startLogging(QOpenGLDebugLogger::SynchronousLogging);
   }
 
+  // Every OpenGL object is created through the resource manager, and
+  // deleted before the context goes away
+  resources.initializeGL(context());
+  shaders.setResources(&resources);
+  connect(context(), SIGNAL(aboutToBeDestroyed()), this, SLOT(releaseGL()),
+          Qt::DirectConnection);
+
   QString glVersion{reinterpret_cast<const char *>(glGetString(GL_VERSION))};
   qDebug() << ":: Using OpenGL" << qPrintable(glVersion);
+  qDebug() << ":: Using" << simd::isaName(simd::isa()) << "mesh kernels";
 
   // Enable depth buffer
   glEnable(GL_DEPTH_TEST);
@@ -135,47 +360,92 @@ void MainView::initializeGL() {
   // color.
   glClearColor(0.37f, 0.42f, 0.45f, 0.0f);
 
-  // Each object has his own vao, vbo, transformation matrix and vertex count. All of these are stored in
-  // vectors; vaos, vbos, transformations and vertexCounts.
+  // The scene consists of meshes, each with their own vao, vbo, ebo, counts, bounds, shader features and
+  // meshlets, and objects that place a mesh in the world. See scene.h.
   //
-  // This makes it trivial to add more objects.
-
-  // initialize the vbos vector, and get two vbo names
-  vbos.resize(2);
-  glGenBuffers(2, vbos.data());
+  // This makes it trivial to add more meshes and objects.
+  int pyramid = scene.addMesh();
+  int knot = scene.addMesh();
+
+  // initialize the pyramid and the knot mesh. Since a mesh is represented by the same index
+  // accross all vectors, the functions are passed said index and fill in the vector fields.
+  initializePyramid(pyramid);
+  initializeKnot(knot);
+
+  // place one of each in front of the camera
+  scene.addObject(pyramid, QVector3D(-2, 0, -6));
+  scene.addObject(knot, QVector3D(2, 0, -6));
+
+  // Stress test: fill the view behind them with many more knots
+  int stressObjects = qEnvironmentVariableIntValue("CG_STRESS_OBJECTS");
+  int side = std::ceil(std::cbrt(stressObjects));
+  for (int i = 0; i < stressObjects; i++) {
+    float x = i % side, y = (i / side) % side, z = i / (side * side);
+    scene.addObject(knot, QVector3D(-3 + 6 * x / side, -3 + 6 * y / side, -7 - 12 * z / side));
+  }
 
-  // initialize the vaos vector and get two vao names
-  vaos.resize(2);
-  glGenVertexArrays(2, vaos.data());
+  // initialize the occlusion queries and the bounding box proxy
+  occlusionQueries.reserve(scene.objectCount());
+  for (int i = 0; i < scene.objectCount(); i++) {
+    occlusionQueries.push_back(resources.createQuery(GpuResources::Culling, "occlusion query"));
+  }
+  queryPending.assign(scene.objectCount(), false);
+  occluded.assign(scene.objectCount(), false);
+  initializeOcclusionProxy();
+
+  // allocate the fixed GPU pool of the streamed mesh
+  if (streamer) {
+    int poolMegabytes = qEnvironmentVariableIntValue("CG_STREAM_POOL_MB");
+    streamer->initializeGL(resources, size_t(poolMegabytes > 0 ? poolMegabytes : 256) << 20);
+  }
 
-  // initialize the transformations and vertexCount vectors
-  transformations.resize(2);
-  vertexCounts.resize(2);
+  renderScaler.initializeGL(resources);
 
-  // initialize the pyramid and the knot object
-  initializePyramid(vbos[0], vaos[0], &transformations[0], &vertexCounts[0]);
-  initializeKnot(vbos[1], vaos[1], &transformations[1], &vertexCounts[1]);
+  // Many point lights, each fragment only considers those of its cluster
+  int lightCount = qEnvironmentVariableIntValue("CG_LIGHTS");
+  if (lightCount > 0) {
+    initializeLights(lightCount);
+  }
 
-  // An alternative implementation of the above is: since we assume an object is represented by the same index
-  // accross all vectors (vaos, vbos, transformations and vertexCounts) we could simply
-  // pass said index and let the functions access the vector fields.
+  // Draw and cull all objects on the GPU when the context allows it
+  if (format().version() >= qMakePair(4, 3)) {
+    indirect = std::make_unique<IndirectRenderer>();
+    if (!indirect->initializeGL(context(), resources, scene)) {
+      indirect.reset();
+    }
+  }
+  qDebug() << ":: Drawing objects" << (indirect ? "with glMultiDrawElementsIndirect" : "one by one");
 
   // initialize the projection transformation matrix
   projectionTrans.setToIdentity();
-  projectionTrans.perspective(60, 1, 0.2,20);
+  projectionTrans.perspective(60, 1, nearPlane, farPlane);
+  lightPosition = QVector3D(0, 5, 0);
   createShaderProgram();
 }
 
 /**
- * @brief MainView::createShaderProgram Creates a new shader program with a
- * vertex and fragment shader.
+ * @brief MainView::createShaderProgram Links the shader variants used by the
+ * objects up front, so the first frame does not stall on it.
  */
 void MainView::createShaderProgram() {
-  shaderProgram.addShaderFromSourceFile(QOpenGLShader::Vertex,
-                                        ":/shaders/vertshader.glsl");
-  shaderProgram.addShaderFromSourceFile(QOpenGLShader::Fragment,
-                                        ":/shaders/fragshader.glsl");
-  shaderProgram.link();
+  for (unsigned features : scene.shaderFeatures) {
+    shaders.program(features);
+  }
+  if (indirect) {
+    shaders.program(indirect->shaderFeatures());
+  }
+}
+
+/**
+ * @brief MainView::onShaderSourcesChanged Re-links the shader variants after
+ * a shader source has been modified on disk. This blocks the GUI thread until
+ * every variant in use has been compiled.
+ */
+void MainView::onShaderSourcesChanged() {
+  makeCurrent();
+  shaders.reload();
+  doneCurrent();
+  update();
 }
 
 /**
@@ -183,20 +453,316 @@ void MainView::createShaderProgram() {
  *
  */
 void MainView::paintGL() {
+  InputRecorder::global().record(InputEvent());  // a Frame marker
+  QElapsedTimer paintTimer;
+  paintTimer.start();
+
+  stats = FrameStats();
+  stats.objects = scene.objectCount();
+
+  // Prepare the frame on the job system, then only replay it here. The
+  // indirect path does all of this on the GPU instead.
+  if (!indirect) {
+    planner.plan(scene, projectionTrans, height() * devicePixelRatio());
+    stats.frustumCulled = planner.frustumCulled();
+    stats.lodCulled = planner.lodCulled();
+    stats.meshletsCulled = planner.meshletsCulled();
+    stats.planMilliseconds = planner.milliseconds();
+
+    resolveOcclusionQueries();
+  }
+
+  if (streamer) {
+    streamer->update(projectionTrans, streamTransform(), height() * devicePixelRatio());
+    stats.streamedChunks = streamer->drawnCount();
+    stats.streamPending = streamer->pendingCount();
+  }
+
+  // Render offscreen at the current scale; the overdraw view needs every
+  // fragment of the full resolution to count them
+  renderSize = renderScaler.begin(size() * devicePixelRatio(), !overdrawView);
+
+  if (!pointLights.empty()) {
+    lightGrid.setProjection(projectionTrans, nearPlane, farPlane);
+    lightGrid.assign(pointLights);
+    uploadLightClusters();
+    stats.lights = pointLights.size();
+    stats.lightMilliseconds = lightGrid.milliseconds();
+  }
+
+  if (indirect) {
+    indirect->update(scene, projectionTrans, height() * devicePixelRatio());
+    // Frustum and size culling are a single test on the GPU
+    stats.indirect = true;
+    stats.drawn = indirect->visibleCount();
+    stats.frustumCulled = stats.objects - stats.drawn;
+  }
+
   // Clear the screen before rendering
+  if (overdrawView) {
+    glClearColor(0, 0, 0, 0);
+  } else {
+    glClearColor(0.37f, 0.42f, 0.45f, 0.0f);
+  }
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-  shaderProgram.bind();
-  shaderProgram.setUniformValue("projectionTransform", projectionTrans);
+  if (depthPrepass) {
+    // Lay down depth only, then shade exactly the visible fragments
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthFunc(GL_LESS);
+    drawObjects(Pass::Depth);
+
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDepthFunc(GL_EQUAL);
+    glDepthMask(GL_FALSE);
+  }
+
+  if (overdrawView) {
+    // Every shaded fragment adds one step to the pixel
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    drawObjects(Pass::Overdraw);
+    glDisable(GL_BLEND);
+  } else {
+    drawObjects(Pass::Shade);
+  }
+
+  glDepthMask(GL_TRUE);
+  glDepthFunc(GL_LEQUAL);
+
+  if (overdrawView) {
+    measureOverdraw();
+  }
+
+  if (occlusionCulling && !indirect) {
+    issueOcclusionQueries();
+  }
+
+  renderScaler.end(defaultFramebufferObject());
+  stats.renderScale = renderScaler.scale();
+  stats.gpuMilliseconds = renderScaler.gpuMilliseconds();
+  stats.gpuBytes = resources.liveBytes();
+  stats.gpuPeakBytes = resources.peakBytes();
+
+  stats.paintMilliseconds = paintTimer.nsecsElapsed() / 1e6;
+  emit frameStatsUpdated(stats.toString());
+}
+
+/**
+ * @brief MainView::drawObjects Replays the draw commands of the planner.
+ * @param pass Which pass is drawn. The depth and overdraw passes use the
+ * cheapest variant that still produces the same positions.
+ */
+void MainView::drawObjects(Pass pass) {
+  QOpenGLShaderProgram *bound = nullptr;
+
+  // On the indirect path the planner does not run and has no commands
+  if (indirect) {
+    bound = drawIndirect(pass);
+  }
+
+  for (const DrawCommand &command : planner.commands()) {
+      int i = command.object;
+      if (occluded[i]) continue;
+
+      unsigned features = command.features;
+      if (pass != Pass::Shade) {
+        features &= Instancing | QuantizedInput;
+      }
+
+      QOpenGLShaderProgram *program = shaders.program(features);
+      if (!program) continue;
+
+      if (program != bound) {
+        program->bind();
+        program->setUniformValue("projectionTransform", projectionTrans);
+        program->setUniformValue("lightPosition", lightPosition);
+        // The red channel counts fragments exactly, green makes it visible
+        program->setUniformValue("objectColor", QVector3D(1 / 255.0f, 0.1f, 0));
+        if (features & ClusteredLighting) {
+          setLightUniforms(program);
+        }
+        bound = program;
+      }
+      program->setUniformValue("modelTransform", command.modelTransform);
+      glBindVertexArray(scene.vaos[command.mesh].id());
+
+      // While last frame's result has not reached the CPU yet, let the GPU
+      // skip the draw if it knows the result (and draw it otherwise).
+      bool conditional = occlusionCulling && queryPending[i];
+      if (conditional) {
+        glBeginConditionalRender(occlusionQueries[i].id(), GL_QUERY_NO_WAIT);
+      }
+      if (scene.indexCounts[command.mesh] == 0) {
+        glDrawArrays(GL_TRIANGLES, 0, scene.vertexCounts[command.mesh]);
+      } else if (command.rangeCount > 0) {
+        // Only the meshlets that survived culling
+        glMultiDrawElements(GL_TRIANGLES, &planner.rangeCounts()[command.firstRange], GL_UNSIGNED_INT,
+                            &planner.rangeOffsets()[command.firstRange], command.rangeCount);
+      }
+      if (conditional) {
+        glEndConditionalRender();
+      }
+
+      if (pass != Pass::Depth) stats.drawn++;
+  }
+
+  if (streamer) {
+    // The streamed mesh has no vertex colours; light it instead
+    unsigned features = pass == Pass::Shade ? Lighting | QuantizedInput : unsigned(QuantizedInput);
+    QOpenGLShaderProgram *program = shaders.program(features);
+    if (program) {
+      program->bind();
+      program->setUniformValue("projectionTransform", projectionTrans);
+      program->setUniformValue("modelTransform", streamTransform());
+      streamer->setQuantizationUniforms(program);
+      program->setUniformValue("lightPosition", lightPosition);
+      program->setUniformValue("objectColor", pass == Pass::Overdraw ? QVector3D(1 / 255.0f, 0.1f, 0) : QVector3D(0.8f, 0.8f, 0.8f));
+      streamer->draw();
+      bound = program;
+    }
+  }
+
+  if (bound) bound->release();
+}
+
+/**
+ * @brief MainView::drawIndirect Draws all objects with one indirect call,
+ * using the commands written by the compute pass of this frame.
+ * @param pass Which pass is drawn.
+ * @return The program that was bound, or null.
+ */
+QOpenGLShaderProgram *MainView::drawIndirect(Pass pass) {
+  unsigned features = indirect->shaderFeatures();
+  if (pass != Pass::Shade) {
+    features &= Instancing | QuantizedInput;
+  }
+
+  QOpenGLShaderProgram *program = shaders.program(features);
+  if (!program) return nullptr;
+
+  program->bind();
+  program->setUniformValue("projectionTransform", projectionTrans);
+  program->setUniformValue("lightPosition", lightPosition);
+  program->setUniformValue("objectColor", QVector3D(1 / 255.0f, 0.1f, 0));
+  if (features & ClusteredLighting) {
+    setLightUniforms(program);
+  }
+  indirect->draw();
+  return program;
+}
+
+/**
+ * @brief MainView::streamTransform Places the streamed mesh, whatever its
+ * size, in front of the camera and applies the rotation and scale.
+ * @return The model transformation of the streamed mesh.
+ */
+QMatrix4x4 MainView::streamTransform() const {
+  const Bounds &bounds = streamer->bounds();
+
+  QMatrix4x4 transform;
+  transform.translate(0, 0, -6);
+  transform.scale(scene.scale);
+  transform.rotate(scene.rotation.x(), 1, 0, 0);
+  transform.rotate(scene.rotation.y(), 0, 1, 0);
+  transform.rotate(scene.rotation.z(), 0, 0, 1);
+  transform.scale(2 / std::max(bounds.radius(), 1e-6f));
+  transform.translate(-bounds.center());
+  return transform;
+}
+
+/**
+ * @brief MainView::resolveOcclusionQueries Collects the results of the queries
+ * issued in earlier frames. Results that are not available yet are left
+ * pending instead of waited for; the object keeps its previous visibility.
+ */
+void MainView::resolveOcclusionQueries() {
+  for (size_t i = 0; i < occlusionQueries.size(); i++) {
+    if (!occlusionCulling) {
+      occluded[i] = false;
+      continue;
+    }
+
+    if (queryPending[i]) {
+      GLuint available = GL_FALSE;
+      glGetQueryObjectuiv(occlusionQueries[i].id(), GL_QUERY_RESULT_AVAILABLE, &available);
+      if (available) {
+        GLuint samplesPassed = GL_FALSE;
+        glGetQueryObjectuiv(occlusionQueries[i].id(), GL_QUERY_RESULT, &samplesPassed);
+        occluded[i] = !samplesPassed;
+        queryPending[i] = false;
+      }
+    }
+    if (occluded[i]) stats.occlusionCulled++;
+  }
+}
 
-  // paint all objects
-  for (int i=0; i<vaos.size(); i++) {
-      shaderProgram.setUniformValue("modelTransform", transformations[i]);
-      glBindVertexArray(vaos[i]);
-      glDrawArrays(GL_TRIANGLES, 0, vertexCounts[i]);
+/**
+ * @brief MainView::issueOcclusionQueries Tests the bounding box of every object
+ * without an outstanding query against the finished depth buffer. Culled
+ * objects are tested too, so they reappear once they become visible.
+ */
+void MainView::issueOcclusionQueries() {
+  QOpenGLShaderProgram *program = shaders.program(0);
+  if (!program) return;
+
+  program->bind();
+  program->setUniformValue("projectionTransform", projectionTrans);
+
+  glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+  glDepthMask(GL_FALSE);
+  // The back faces keep the query alive when the front faces are clipped
+  glDisable(GL_CULL_FACE);
+  glBindVertexArray(proxyVAO.id());
+
+  for (size_t i = 0; i < occlusionQueries.size(); i++) {
+    if (queryPending[i]) continue;
+
+    const Bounds &bounds = scene.bounds[scene.meshes[i]];
+    QMatrix4x4 proxyTrans = scene.transformations[i];
+    proxyTrans.translate(bounds.center());
+    proxyTrans.scale(bounds.extents());
+
+    // The camera inside the box would clip it entirely, so never cull then
+    QVector3D camera = proxyTrans.inverted().map(QVector3D(0, 0, 0));
+    if (qAbs(camera.x()) <= 1 && qAbs(camera.y()) <= 1 && qAbs(camera.z()) <= 1) {
+      occluded[i] = false;
+      continue;
+    }
+
+    program->setUniformValue("modelTransform", proxyTrans);
+    glBeginQuery(GL_ANY_SAMPLES_PASSED, occlusionQueries[i].id());
+    glDrawArrays(GL_TRIANGLES, 0, 36);
+    glEndQuery(GL_ANY_SAMPLES_PASSED);
+    queryPending[i] = true;
   }
 
-  shaderProgram.release();
+  glEnable(GL_CULL_FACE);
+  glDepthMask(GL_TRUE);
+  glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+  program->release();
+}
+
+/**
+ * @brief MainView::measureOverdraw Reads back the overdraw buffer and reports
+ * the average number of fragments shaded per covered pixel.
+ */
+void MainView::measureOverdraw() {
+  int w = width() * devicePixelRatio();
+  int h = height() * devicePixelRatio();
+  std::vector<unsigned char> pixels(4 * w * h);
+  glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+  quint64 fragments = 0;
+  quint64 covered = 0;
+  for (size_t i = 0; i < pixels.size(); i += 4) {
+    fragments += pixels[i];
+    covered += pixels[i] > 0;
+  }
+  if (covered > 0) {
+    qDebug() << ":: Overdraw:" << double(fragments) / covered
+             << "fragments per covered pixel," << covered << "pixels";
+  }
 }
 
 /**
@@ -207,7 +773,7 @@ void MainView::paintGL() {
  */
 void MainView::resizeGL(int newWidth, int newHeight) {
   projectionTrans.setToIdentity();
-  projectionTrans.perspective(60, (float)newWidth/(float)newHeight, 0.2, 20);
+  projectionTrans.perspective(60, (float)newWidth/(float)newHeight, nearPlane, farPlane);
 }
 
 /**
@@ -220,21 +786,8 @@ void MainView::setRotation(int rotateX, int rotateY, int rotateZ) {
   qDebug() << "Rotation changed to (" << rotateX << "," << rotateY << ","
            << rotateZ << ")";
 
-  // go over all transformation matrices and modify rotation
-  for (QMatrix4x4 &transformation : transformations) {
-    QVector3D translation = transformation.column(3).toVector3D(); // extract translation
-    float scale = transformation.column(0).length(); // extract scale
-
-    // clear rotation by removing all transformations and re-applying translation and scaling
-    transformation.setToIdentity();
-    transformation.translate(translation);
-    transformation.scale(scale);
-
-    // rotate model by desired amount
-    transformation.rotate(rotateX, 1, 0, 0);
-    transformation.rotate(rotateY, 0, 1, 0);
-    transformation.rotate(rotateZ, 0, 0, 1);
-  }
+  // the transformation matrices are recomputed from this in the next frame
+  scene.rotation = QVector3D(rotateX, rotateY, rotateZ);
 
   update();
 }
@@ -247,12 +800,63 @@ void MainView::setRotation(int rotateX, int rotateY, int rotateZ) {
 void MainView::setScale(float scale) {
   qDebug() << "Scale changed to " << scale;
 
-  // for all transformation matrices update scaling
-  for (QMatrix4x4 &transformation : transformations) {
-      float currentScale = transformation.column(0).length(); //extract current scale
-      transformation.scale(1/currentScale); // reset scale
-      transformation.scale(scale); // apply desired scaling
-  }
+  // the transformation matrices are recomputed from this in the next frame
+  scene.scale = scale;
+  update();
+}
+
+/**
+ * @brief MainView::setDepthPrepass Enables or disables the depth-only
+ * pre-pass. With the pre-pass, the shading pass uses GL_EQUAL and shades every
+ * pixel at most once.
+ * @param enabled Whether to render the pre-pass.
+ */
+void MainView::setDepthPrepass(bool enabled) {
+  qDebug() << "Depth pre-pass" << (enabled ? "enabled" : "disabled");
+  depthPrepass = enabled;
+  update();
+}
+
+/**
+ * @brief MainView::setOverdrawView Enables or disables the overdraw
+ * visualization, which shows how many fragments are shaded per pixel.
+ * @param enabled Whether to visualize overdraw.
+ */
+void MainView::setOverdrawView(bool enabled) {
+  qDebug() << "Overdraw view" << (enabled ? "enabled" : "disabled");
+  overdrawView = enabled;
+  update();
+}
+
+/**
+ * @brief MainView::setOcclusionCulling Enables or disables occlusion culling.
+ * @param enabled Whether objects hidden behind others are skipped.
+ */
+void MainView::setOcclusionCulling(bool enabled) {
+  qDebug() << "Occlusion culling" << (enabled ? "enabled" : "disabled");
+  occlusionCulling = enabled;
+  update();
+}
+
+/**
+ * @brief MainView::setMeshletCulling Enables or disables meshlet culling.
+ * @param enabled Whether meshlets outside the view or facing away are skipped.
+ */
+void MainView::setMeshletCulling(bool enabled) {
+  qDebug() << "Meshlet culling" << (enabled ? "enabled" : "disabled");
+  planner.meshletCulling = enabled;
+  update();
+}
+
+/**
+ * @brief MainView::setDynamicResolution Enables or disables dynamic
+ * resolution scaling.
+ * @param enabled Whether the resolution is lowered to stay within the GPU
+ * frame-time budget.
+ */
+void MainView::setDynamicResolution(bool enabled) {
+  qDebug() << "Dynamic resolution" << (enabled ? "enabled" : "disabled");
+  renderScaler.enabled = enabled;
   update();
 }
 
@@ -10,6 +10,18 @@
 #include <QTimer>
 #include <QVector3D>
 
+#include <memory>
+
+#include "chunkstreamer.h"
+#include "frameplanner.h"
+#include "framestats.h"
+#include "gpuresources.h"
+#include "indirectrenderer.h"
+#include "lightgrid.h"
+#include "renderscaler.h"
+#include "scene.h"
+#include "shaderlibrary.h"
+
 /**
  * @brief The MainView class is resonsible for the actual content of the main
  * window.
@@ -24,10 +36,38 @@ class MainView : public QOpenGLWidget, protected QOpenGLFunctions_3_3_Core {
   // Functions for widget input events
   void setRotation(int rotateX, int rotateY, int rotateZ);
   void setScale(float scale);
+  void setDepthPrepass(bool enabled);
+  void setOverdrawView(bool enabled);
+  void setOcclusionCulling(bool enabled);
+  void setMeshletCulling(bool enabled);
+  void setDynamicResolution(bool enabled);
+
+  // Statistics of the last rendered frame
+  const FrameStats &frameStats() const { return stats; }
+  // The OpenGL objects of the view and their video memory
+  const GpuResources &gpuResources() const { return resources; }
+
+ signals:
+  // Emitted after every frame with a one-line summary of FrameStats
+  void frameStatsUpdated(const QString &summary);
 
  private:
-  void initializePyramid(GLuint VBO, GLuint VAO, QMatrix4x4 *modelTrans, int *vertexCount);
-  void initializeKnot(GLuint VBO, GLuint VAO, QMatrix4x4 *modelTrans, int *vertexCount);
+  enum class Pass { Depth, Shade, Overdraw };
+
+  void initializePyramid(int mesh);
+  void initializeKnot(int mesh);
+  void initializeOcclusionProxy();
+  void initializeLights(int count);
+  void uploadLightClusters();
+  void setLightUniforms(QOpenGLShaderProgram *program);
+  QMatrix4x4 streamTransform() const;
+
+  void resolveOcclusionQueries();
+  void issueOcclusionQueries();
+
+  void drawObjects(Pass pass);
+  QOpenGLShaderProgram *drawIndirect(Pass pass);
+  void measureOverdraw();
 
  protected:
   void initializeGL() override;
@@ -47,17 +87,55 @@ class MainView : public QOpenGLWidget, protected QOpenGLFunctions_3_3_Core {
 
  private slots:
   void onMessageLogged(QOpenGLDebugMessage Message);
+  void onShaderSourcesChanged();
+  void releaseGL();
 
  private:
   QOpenGLDebugLogger debugLogger;
   QTimer timer;  // timer used for animation
-  std::vector<GLuint> vbos;
-  std::vector<GLuint> vaos;
-  std::vector<QMatrix4x4> transformations;
-  std::vector<int> vertexCounts;
+
+  // Owns every OpenGL object below, so it is declared first and destroyed
+  // last
+  GpuResources resources;
+  Scene scene;
+  FramePlanner planner;
+
+  // Draws all objects with one indirect call on OpenGL 4.3, culled on the
+  // GPU; null on the 3.3 path, where the planner prepares every draw
+  std::unique_ptr<IndirectRenderer> indirect;
+
+  // Renders at a lower resolution when the GPU time exceeds its budget
+  RenderScaler renderScaler;
+  QSize renderSize;
+
+  // Point lights (CG_LIGHTS), assigned to the clusters of the frustum every
+  // frame and read by the shaders from texture buffers
+  std::vector<PointLight> pointLights;
+  LightGrid lightGrid;
+  GpuHandle lightBuffers[3];  // lights, clusters, light indices
+  GpuHandle lightTextures[3];
+
+  // Out-of-core mesh streamed from a chunk file (CG_STREAM_FILE), if any
+  std::unique_ptr<ChunkStreamer> streamer;
   QMatrix4x4 projectionTrans;
 
-  QOpenGLShaderProgram shaderProgram;
+  // Occlusion culling: every object has a query that tests its bounding box
+  // against the depth buffer. Results are read one or more frames late, so
+  // the CPU never waits on the GPU.
+  std::vector<GpuHandle> occlusionQueries;
+  std::vector<bool> queryPending;
+  std::vector<bool> occluded;
+  GpuHandle proxyVBO;
+  GpuHandle proxyVAO;
+
+  bool depthPrepass = false;
+  bool overdrawView = false;
+  bool occlusionCulling = true;
+
+  FrameStats stats;
+
+  ShaderLibrary shaders;
+  QVector3D lightPosition;
 
   void createShaderProgram();
 };
@@ -1,5 +1,8 @@
 #include "mainwindow.h"
 
+#include <QCoreApplication>
+#include <QStatusBar>
+
 #include "ui_mainwindow.h"
 
 /**
@@ -9,6 +12,22 @@
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent), ui(new Ui::MainWindow) {
   ui->setupUi(this);
+
+  // Per-frame statistics of the view are shown in the status bar
+  connect(ui->mainView, SIGNAL(frameStatsUpdated(QString)), statusBar(),
+          SLOT(showMessage(QString)));
+
+  // Replay recorded input, at the recorded speed or as fast as possible
+  QString replayFile = qEnvironmentVariable("CG_REPLAY");
+  if (!replayFile.isEmpty()) {
+    replayer = new InputReplayer(ui->mainView, this);
+    if (replayer->open(replayFile)) {
+      connect(replayer, SIGNAL(eventDue(InputEvent)), this,
+              SLOT(applyInputEvent(InputEvent)));
+      connect(replayer, SIGNAL(finished()), this, SLOT(onReplayFinished()));
+      replayer->start(qEnvironmentVariableIntValue("CG_REPLAY_FAST") != 0);
+    }
+  }
 }
 
 /**
@@ -22,6 +41,7 @@ MainWindow::~MainWindow() { delete ui; }
  */
 void MainWindow::on_ResetRotationButton_clicked(bool checked) {
   Q_UNUSED(checked)
+  InputRecorder::global().record(InputEvent::slider(InputEvent::ResetRotation, 0));
   ui->RotationDialX->setValue(0);
   ui->RotationDialY->setValue(0);
   ui->RotationDialZ->setValue(0);
@@ -34,6 +54,7 @@ void MainWindow::on_ResetRotationButton_clicked(bool checked) {
  * @param value Unused.
  */
 void MainWindow::on_RotationDialX_sliderMoved(int value) {
+  InputRecorder::global().record(InputEvent::slider(InputEvent::RotationX, value));
   ui->mainView->setRotation(value, ui->RotationDialY->value(),
                             ui->RotationDialZ->value());
 }
@@ -44,6 +65,7 @@ void MainWindow::on_RotationDialX_sliderMoved(int value) {
  * @param value Unused.
  */
 void MainWindow::on_RotationDialY_sliderMoved(int value) {
+  InputRecorder::global().record(InputEvent::slider(InputEvent::RotationY, value));
   ui->mainView->setRotation(ui->RotationDialX->value(), value,
                             ui->RotationDialZ->value());
 }
@@ -54,6 +76,7 @@ void MainWindow::on_RotationDialY_sliderMoved(int value) {
  * @param value Unused.
  */
 void MainWindow::on_RotationDialZ_sliderMoved(int value) {
+  InputRecorder::global().record(InputEvent::slider(InputEvent::RotationZ, value));
   ui->mainView->setRotation(ui->RotationDialX->value(),
                             ui->RotationDialY->value(), value);
 }
@@ -64,6 +87,7 @@ void MainWindow::on_RotationDialZ_sliderMoved(int value) {
  */
 void MainWindow::on_ResetScaleButton_clicked(bool checked) {
   Q_UNUSED(checked)
+  InputRecorder::global().record(InputEvent::slider(InputEvent::ResetScale, 0));
   ui->ScaleSlider->setValue(100);
   ui->mainView->setScale(1.0);
 }
@@ -73,9 +97,56 @@ void MainWindow::on_ResetScaleButton_clicked(bool checked) {
  * @param value The new scale value.
  */
 void MainWindow::on_ScaleSlider_sliderMoved(int value) {
+  InputRecorder::global().record(InputEvent::slider(InputEvent::Scale, value));
   ui->mainView->setScale(value / 100.0f);
 }
 
+/**
+ * @brief MainWindow::applyInputEvent Applies a replayed UI event as if the
+ * user had moved the control.
+ * @param event The event.
+ */
+void MainWindow::applyInputEvent(const InputEvent &event) {
+  switch (event.type) {
+    case InputEvent::RotationX:
+      ui->RotationDialX->setValue(event.value);
+      on_RotationDialX_sliderMoved(event.value);
+      break;
+    case InputEvent::RotationY:
+      ui->RotationDialY->setValue(event.value);
+      on_RotationDialY_sliderMoved(event.value);
+      break;
+    case InputEvent::RotationZ:
+      ui->RotationDialZ->setValue(event.value);
+      on_RotationDialZ_sliderMoved(event.value);
+      break;
+    case InputEvent::ResetRotation:
+      on_ResetRotationButton_clicked(false);
+      break;
+    case InputEvent::Scale:
+      ui->ScaleSlider->setValue(event.value);
+      on_ScaleSlider_sliderMoved(event.value);
+      break;
+    case InputEvent::ResetScale:
+      on_ResetScaleButton_clicked(false);
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+ * @brief MainWindow::onReplayFinished Writes the frame timings of the replay
+ * to CG_REPLAY_TIMINGS, if set, and quits.
+ */
+void MainWindow::onReplayFinished() {
+  QString timingsFile = qEnvironmentVariable("CG_REPLAY_TIMINGS");
+  if (!timingsFile.isEmpty()) {
+    replayer->writeTimings(timingsFile);
+  }
+  QCoreApplication::quit();
+}
+
 /**
  * @brief MainWindow::renderToFile Used to render the frame buffer to the file.
  * DO NOT REMOVE OR MODIFY!
@@ -3,6 +3,8 @@
 
 #include <QMainWindow>
 
+#include "inputrecorder.h"
+
 namespace Ui {
 class MainWindow;
 }
@@ -29,6 +31,13 @@ class MainWindow : public QMainWindow {
 
   void on_ResetScaleButton_clicked(bool checked);
   void on_ScaleSlider_sliderMoved(int value);
+
+  void applyInputEvent(const InputEvent &event);
+  void onReplayFinished();
+
+ private:
+  // Replays a recording (CG_REPLAY) instead of waiting for the user
+  InputReplayer *replayer = nullptr;
 };
 
 #endif  // MAINWINDOW_H
@@ -0,0 +1,253 @@
+#include <QCoreApplication>
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+#include <QTemporaryFile>
+#include <QtEndian>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "chunkfile.h"
+#include "meshcodec.h"
+#include "model.h"
+
+namespace {
+
+/**
+ * @brief An array in a temporary file next to the output. Elements are
+ * appended through a small buffer, and the file is mapped once it is
+ * complete, so the input mesh never has to fit in memory.
+ */
+template <typename T>
+class SpillFile {
+ public:
+  bool open(const QString &directory) {
+    file.setFileTemplate(directory + "/.meshchunker-XXXXXX");
+    return file.open();
+  }
+
+  void append(const T &value) {
+    buffer.push_back(value);
+    if (buffer.size() == bufferSize) flush();
+  }
+
+  size_t size() const { return written + buffer.size(); }
+  // Whether every write and mapping succeeded
+  bool ok() const { return !failed; }
+
+  // Sizes the file for count elements, to be written through the mapping
+  T *allocate(size_t count) {
+    if (count == 0 || !file.resize(qint64(count * sizeof(T)))) return nullptr;
+    written = count;
+    mapped = reinterpret_cast<T *>(file.map(0, file.size()));
+    failed = failed || !mapped;
+    return mapped;
+  }
+
+  // Everything appended so far, mapped
+  Span<const T> map() {
+    flush();
+    if (!mapped && written > 0) {
+      mapped = file.flush() ? reinterpret_cast<T *>(file.map(0, written * sizeof(T))) : nullptr;
+      failed = failed || !mapped;
+    }
+    if (!mapped) return Span<const T>();
+    return Span<const T>(mapped, written);
+  }
+
+ private:
+  void flush() {
+    qint64 bytes = buffer.size() * sizeof(T);
+    if (file.write(reinterpret_cast<const char *>(buffer.data()), bytes) == bytes) {
+      written += buffer.size();
+    } else {
+      failed = true;
+    }
+    buffer.clear();
+  }
+
+  static const size_t bufferSize = 65536;
+
+  QTemporaryFile file;
+  std::vector<T> buffer;
+  size_t written = 0;
+  T *mapped = nullptr;
+  bool failed = false;
+};
+
+/**
+ * @brief readObj Reads the vertices and faces of an .obj file line by line.
+ * Polygons are split into triangle fans. Negative indices count back from
+ * the last vertex read.
+ * @param input The file, opened for reading.
+ * @param coords Receives the vertices.
+ * @param indices Receives three indices per triangle.
+ * @return Whether every index refers to a vertex.
+ */
+bool readObj(QFile &input, SpillFile<QVector3D> &coords, SpillFile<unsigned> &indices) {
+  std::vector<qint64> polygon;
+  qint64 maxIndex = -1;
+
+  while (!input.atEnd()) {
+    QList<QByteArray> tokens = input.readLine().simplified().split(' ');
+    if (tokens[0] == "v" && tokens.size() >= 4) {
+      coords.append(QVector3D(tokens[1].toFloat(), tokens[2].toFloat(), tokens[3].toFloat()));
+    } else if (tokens[0] == "f") {
+      polygon.clear();
+      for (int i = 1; i < tokens.size(); ++i) {
+        qint64 index = tokens[i].split('/').first().toLongLong();
+        if (index == 0) return false;
+        // .obj counts from 1
+        index = index < 0 ? qint64(coords.size()) + index : index - 1;
+        if (index < 0) return false;
+        maxIndex = std::max(maxIndex, index);
+        polygon.push_back(index);
+      }
+      for (size_t corner = 2; corner < polygon.size(); ++corner) {
+        indices.append(polygon[0]);
+        indices.append(polygon[corner - 1]);
+        indices.append(polygon[corner]);
+      }
+    }
+  }
+  return maxIndex < qint64(coords.size());
+}
+
+/**
+ * @brief readStl Reads binary STL a block of triangles at a time. Every
+ * triangle keeps its own three vertices; the chunks are not welded.
+ * @param input The file, opened for reading.
+ * @param coords Receives the vertices.
+ * @param indices Receives three indices per triangle.
+ * @return Whether all triangles were read.
+ */
+bool readStl(QFile &input, SpillFile<QVector3D> &coords, SpillFile<unsigned> &indices) {
+  QByteArray header = input.read(84);
+  quint32 count = qFromLittleEndian<quint32>(header.constData() + 80);
+
+  // The normal, three corners and a 16-bit attribute per triangle
+  const quint32 blockTriangles = 4096;
+  for (quint32 first = 0; first < count; first += blockTriangles) {
+    quint32 blockCount = std::min(blockTriangles, count - first);
+    QByteArray block = input.read(qint64(blockCount) * 50);
+    if (block.size() != qint64(blockCount) * 50) return false;
+
+    for (quint32 t = 0; t < blockCount; ++t) {
+      const char *triangle = block.constData() + 50 * t;
+      for (int corner = 0; corner < 3; ++corner) {
+        float v[3];
+        for (int axis = 0; axis < 3; ++axis) {
+          quint32 bits = qFromLittleEndian<quint32>(triangle + 12 + 12 * corner + 4 * axis);
+          std::memcpy(&v[axis], &bits, sizeof(float));
+        }
+        indices.append(coords.size());
+        coords.append(QVector3D(v[0], v[1], v[2]));
+      }
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief decodeMesh Decodes a .cgmesh file from its mapping straight into the
+ * mapped temporary files.
+ * @param input The file, opened for reading.
+ * @param coords Receives the vertices.
+ * @param indices Receives the indices.
+ * @return Whether the file could be decoded.
+ */
+bool decodeMesh(QFile &input, SpillFile<QVector3D> &coords, SpillFile<unsigned> &indices) {
+  const char *data = reinterpret_cast<const char *>(input.map(0, input.size()));
+  size_t vertexCount, indexCount;
+  if (!data || !meshcodec::readCounts(data, input.size(), vertexCount, indexCount)) {
+    return false;
+  }
+  QVector3D *decodedCoords = coords.allocate(vertexCount);
+  unsigned *decodedIndices = indices.allocate(indexCount);
+  return decodedCoords && decodedIndices &&
+         meshcodec::decode(data, input.size(), decodedCoords, decodedIndices);
+}
+
+}  // namespace
+
+/**
+ * @brief main Preprocessing tool that splits a mesh into a chunk file for the
+ * streaming renderer.
+ *
+ * The mesh is read into temporary files next to the output and mapped, so
+ * it may be larger than memory: .obj and binary .stl files are read a line
+ * or a block at a time, and .cgmesh files are decoded into the mapping. PLY
+ * files are read whole through Model.
+ *
+ * Usage: meshchunker input.obj output.cgchunks [maxTrianglesPerChunk]
+ *
+ * @param argc Argument count.
+ * @param argv Arguments.
+ * @return Exit code.
+ */
+int main(int argc, char *argv[]) {
+  QCoreApplication app(argc, argv);
+  QStringList args = app.arguments();
+
+  if (args.size() < 3) {
+    qWarning() << "Usage: meshchunker input.obj output.cgchunks [maxTrianglesPerChunk]";
+    return 1;
+  }
+
+  unsigned maxTriangles = args.size() > 3 ? args[3].toUInt() : 32768;
+
+  QFile input(args[1]);
+  if (!input.open(QIODevice::ReadOnly)) {
+    qWarning() << ":: Cannot open" << args[1];
+    return 1;
+  }
+
+  QString directory = QFileInfo(args[2]).absolutePath();
+  SpillFile<QVector3D> coords;
+  SpillFile<unsigned> indices;
+  if (!coords.open(directory) || !indices.open(directory)) {
+    qWarning() << ":: Cannot create temporary files in" << directory;
+    return 1;
+  }
+
+  bool ok = true;
+  switch (Model::detectFormat(input)) {
+    case Model::Obj:
+      ok = readObj(input, coords, indices);
+      break;
+    case Model::Stl:
+      ok = readStl(input, coords, indices);
+      break;
+    case Model::Compressed:
+      ok = decodeMesh(input, coords, indices);
+      break;
+    case Model::Ply: {
+      Model model(args[1], Model::Indexed);
+      for (const QVector3D &v : model.getCoords()) coords.append(v);
+      for (unsigned index : model.getTriangleIndices()) indices.append(index);
+      break;
+    }
+  }
+
+  if (!ok) {
+    qWarning() << ":: Cannot read" << args[1];
+    return 1;
+  }
+
+  Span<const QVector3D> coordsMapped = coords.map();
+  Span<const unsigned> indicesMapped = indices.map();
+  if (!coords.ok() || !indices.ok()) {
+    qWarning() << ":: Cannot write temporary files in" << directory;
+    return 1;
+  }
+  if (indicesMapped.size() < 3) {
+    qWarning() << "No triangles in" << args[1];
+    return 1;
+  }
+
+  ok = ChunkFile::write(args[2], coordsMapped, indicesMapped, maxTriangles);
+  return ok ? 0 : 1;
+}
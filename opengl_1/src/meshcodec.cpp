@@ -0,0 +1,803 @@
+#include "meshcodec.h"
+
+#include <QtEndian>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "simdmath.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+static_assert(sizeof(QVector3D) == 3 * sizeof(float), "QVector3D must be three packed floats");
+
+namespace {
+
+// File layout, all integers little-endian:
+//   magic, vertexCount, indexCount, positionBits, blockCount (u32 each),
+//   quantization box min and max (3 floats each),
+//   block table: blockCount entries of {kind u8, 3 padding bytes,
+//     first u32, count u32, offset u64, size u32},
+//   block payloads.
+// A block payload is a sequence of byte streams, each {symbolCount u32,
+// mode u8, data}: six byte planes for a position block; for an index block
+// the byte counts, the low bytes and the higher bytes of its differences.
+const char magic[8] = {'C', 'G', 'M', 'E', 'S', 'H', '0', '2'};
+const size_t headerSize = sizeof(magic) + 4 * 4 + 6 * 4;
+const size_t blockEntrySize = 24;
+
+const uint32_t verticesPerBlock = 1u << 16;
+const uint32_t indicesPerBlock = 3u << 16;
+
+enum BlockKind : uint8_t { PositionBlock = 0, IndexBlock = 1 };
+enum StreamMode : uint8_t { RawStream = 0, ConstantStream = 1, RansStream = 2 };
+
+// rANS with 32-bit states, 12-bit probabilities and 16-bit
+// renormalization; the state stays in [ransLow, 2^32), so a decoding step
+// reads at most one word and needs no loop. The AVX2 decoder keeps four
+// vectors of eight states in flight, so the latency of one vector's gathers
+// is hidden behind the others.
+const int probabilityBits = 12;
+const uint32_t probabilityScale = 1u << probabilityBits;
+const uint32_t ransLow = 1u << 16;
+const int ransStates = 32;
+
+struct Block {
+  uint8_t kind;
+  uint32_t first;
+  uint32_t count;
+  uint64_t offset;
+  uint32_t size;
+};
+
+void putU32(std::vector<char> &out, uint32_t value) {
+  for (int i = 0; i < 4; ++i) {
+    out.push_back(char(value >> (8 * i)));
+  }
+}
+
+void putU64(std::vector<char> &out, uint64_t value) {
+  putU32(out, uint32_t(value));
+  putU32(out, uint32_t(value >> 32));
+}
+
+void putFloat(std::vector<char> &out, float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  putU32(out, bits);
+}
+
+void putVarint(std::vector<char> &out, uint32_t value) {
+  while (value >= 0x80) {
+    out.push_back(char(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(char(value));
+}
+
+/**
+ * @brief Bounds-checked reader over the encoded bytes. Reading past the end
+ * clears ok and returns zeros.
+ */
+struct Reader {
+  const uint8_t *p;
+  const uint8_t *end;
+  bool ok = true;
+
+  const uint8_t *bytes(size_t n) {
+    if (size_t(end - p) < n) {
+      ok = false;
+      p = end;
+      return nullptr;
+    }
+    const uint8_t *start = p;
+    p += n;
+    return start;
+  }
+
+  uint8_t u8() {
+    const uint8_t *b = bytes(1);
+    return b ? b[0] : 0;
+  }
+
+  uint32_t u32() {
+    const uint8_t *b = bytes(4);
+    return b ? uint32_t(b[0]) | uint32_t(b[1]) << 8 | uint32_t(b[2]) << 16 | uint32_t(b[3]) << 24
+             : 0;
+  }
+
+  uint64_t u64() {
+    uint64_t low = u32();
+    return low | uint64_t(u32()) << 32;
+  }
+
+  float f32() {
+    uint32_t bits = u32();
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+  uint32_t varint() {
+    uint32_t value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+      uint8_t b = u8();
+      value |= uint32_t(b & 0x7f) << shift;
+      if (!(b & 0x80)) return value;
+    }
+    ok = false;
+    return 0;
+  }
+};
+
+inline uint32_t zigzag(int32_t value) { return (uint32_t(value) << 1) ^ uint32_t(value >> 31); }
+inline int32_t unzigzag(uint32_t value) { return int32_t(value >> 1) ^ -int32_t(value & 1); }
+
+inline uint16_t zigzag16(int16_t value) {
+  return uint16_t((uint16_t(value) << 1) ^ uint16_t(value >> 15));
+}
+inline int16_t unzigzag16(uint16_t value) { return int16_t((value >> 1) ^ -(value & 1)); }
+
+// Scales symbol counts to frequencies summing to probabilityScale, keeping
+// every symbol that occurs at a frequency of at least 1
+void normalizeFrequencies(const uint64_t counts[256], uint64_t total, uint32_t freqs[256]) {
+  uint32_t sum = 0;
+  for (int s = 0; s < 256; ++s) {
+    freqs[s] = counts[s] ? std::max<uint32_t>(1, counts[s] * probabilityScale / total) : 0;
+    sum += freqs[s];
+  }
+  while (sum != probabilityScale) {
+    int largest = int(std::max_element(freqs, freqs + 256) - freqs);
+    if (sum < probabilityScale) {
+      freqs[largest] += probabilityScale - sum;
+      sum = probabilityScale;
+    } else {
+      // Take from the largest so rounding up rare symbols costs the least
+      uint32_t take = std::min(sum - probabilityScale, freqs[largest] - 1);
+      take = std::max<uint32_t>(take / 2, 1);
+      freqs[largest] -= take;
+      sum -= take;
+    }
+  }
+}
+
+/**
+ * @brief encodeStream Appends one byte stream: rANS coded, or stored raw or
+ * as a constant. Decoding a raw stream is a copy, while rANS costs a few
+ * cycles per symbol, so streams it barely shrinks are stored raw.
+ */
+void encodeStream(const uint8_t *symbols, size_t count, std::vector<char> &out) {
+  putU32(out, uint32_t(count));
+
+  uint64_t counts[256] = {};
+  for (size_t i = 0; i < count; ++i) {
+    counts[symbols[i]]++;
+  }
+  int distinct = int(std::count_if(counts, counts + 256, [](uint64_t c) { return c > 0; }));
+  if (distinct == 1) {
+    out.push_back(char(ConstantStream));
+    out.push_back(char(symbols[0]));
+    return;
+  }
+
+  std::vector<char> table;
+  std::vector<char> coded;
+  if (distinct > 1) {
+    uint32_t freqs[256];
+    uint32_t starts[256];
+    normalizeFrequencies(counts, count, freqs);
+    uint32_t start = 0;
+    for (int s = 0; s < 256; ++s) {
+      starts[s] = start;
+      start += freqs[s];
+      putVarint(table, freqs[s]);
+    }
+
+    // Symbol i goes to lane i % ransStates. Every lane has its own state and
+    // bytes, so the decoder's lanes do not wait on each other's reads.
+    // Symbols are encoded last to first and the bytes grow downwards, so the
+    // decoder reads forwards.
+    std::vector<uint8_t> lane(count / ransStates * 2 + 16);
+    for (int k = 0; k < ransStates; ++k) {
+      uint8_t *end = lane.data() + lane.size();
+      uint8_t *p = end;
+      uint32_t x = ransLow;
+      size_t laneCount = count / ransStates + (size_t(k) < count % ransStates);
+      for (size_t j = laneCount; j-- > 0;) {
+        uint8_t symbol = symbols[j * ransStates + k];
+        uint32_t freq = freqs[symbol];
+        uint32_t limit = ((ransLow >> probabilityBits) << 16) * freq;
+        if (x >= limit) {
+          p -= 2;
+          p[0] = uint8_t(x);
+          p[1] = uint8_t(x >> 8);
+          x >>= 16;
+        }
+        x = ((x / freq) << probabilityBits) + x % freq + starts[symbol];
+      }
+      p -= 4;
+      for (int b = 0; b < 4; ++b) {
+        p[b] = uint8_t(x >> (8 * b));
+      }
+      putU32(coded, uint32_t(end - p));
+      coded.insert(coded.end(), p, end);
+    }
+  }
+
+  // rANS has to save at least an eighth of the bytes
+  if (distinct == 0 || table.size() + coded.size() > count - count / 8) {
+    out.push_back(char(RawStream));
+    out.insert(out.end(), symbols, symbols + count);
+    return;
+  }
+  out.push_back(char(RansStream));
+  out.insert(out.end(), table.begin(), table.end());
+  out.insert(out.end(), coded.begin(), coded.end());
+}
+
+// A decoding step. The table has one entry per slot: the frequency, the
+// offset of the slot within the symbol's range, and the symbol, so a step
+// needs a single lookup. The caller guarantees two readable bytes at lane.
+inline uint8_t ransStep(const uint32_t *table, uint32_t &state, const uint8_t *&lane) {
+  uint32_t entry = table[state & (probabilityScale - 1)];
+  state = (entry & 0xfff) * (state >> probabilityBits) + ((entry >> 12) & 0xfff);
+  // Written with a mask, as compilers turn a select into an unpredictable
+  // branch here
+  uint32_t refill = state < ransLow;
+  uint32_t word = (uint32_t(lane[0]) | uint32_t(lane[1]) << 8) & (0u - refill);
+  state = state << (16 * refill) | word;
+  lane += 2 * refill;
+  return uint8_t(entry >> 24);
+}
+
+/**
+ * @brief decodeRounds Decodes rounds of one symbol per lane. Lanes are
+ * independent, so four at a time go through all rounds, with their states
+ * and pointers in registers.
+ */
+void decodeRounds(const uint32_t *table, uint32_t x[ransStates], const uint8_t *lanes[ransStates],
+                  size_t rounds, uint8_t *out) {
+  for (int k = 0; k < ransStates; k += 4) {
+    uint32_t x0 = x[k], x1 = x[k + 1], x2 = x[k + 2], x3 = x[k + 3];
+    const uint8_t *in0 = lanes[k], *in1 = lanes[k + 1], *in2 = lanes[k + 2], *in3 = lanes[k + 3];
+    for (size_t r = 0; r < rounds; ++r) {
+      // Stored at once, as byte stores could otherwise alias the table
+      uint32_t symbols = ransStep(table, x0, in0);
+      symbols |= uint32_t(ransStep(table, x1, in1)) << 8;
+      symbols |= uint32_t(ransStep(table, x2, in2)) << 16;
+      symbols |= uint32_t(ransStep(table, x3, in3)) << 24;
+      symbols = qToLittleEndian(symbols);
+      std::memcpy(out + r * ransStates + k, &symbols, sizeof(symbols));
+    }
+    x[k] = x0, x[k + 1] = x1, x[k + 2] = x2, x[k + 3] = x3;
+    lanes[k] = in0, lanes[k + 1] = in1, lanes[k + 2] = in2, lanes[k + 3] = in3;
+  }
+}
+
+#ifdef SIMD_X86
+/**
+ * @brief decodeRoundsAvx2 Decodes rounds of one symbol per lane, eight
+ * lanes per vector. The table entries and the refill words are gathered;
+ * the caller guarantees four readable bytes at every lane.
+ */
+AVX2_TARGET void decodeRoundsAvx2(const uint32_t *table, uint32_t x[ransStates],
+                                  const uint8_t *lanes[ransStates], size_t rounds,
+                                  uint8_t *out) {
+  const int vectors = ransStates / 8;
+  // Lanes are addressed by their offset from the lowest one, as gathers
+  // take 32-bit offsets; they are all in the same block
+  const uint8_t *base = lanes[0];
+  for (int k = 1; k < ransStates; ++k) base = std::min(base, lanes[k]);
+  uint32_t offsets[ransStates];
+  for (int k = 0; k < ransStates; ++k) offsets[k] = uint32_t(lanes[k] - base);
+
+  __m256i state[vectors], offset[vectors];
+  for (int v = 0; v < vectors; ++v) {
+    state[v] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x + 8 * v));
+    offset[v] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(offsets + 8 * v));
+  }
+  const __m256i slotMask = _mm256_set1_epi32(probabilityScale - 1);
+  const __m256i fieldMask = _mm256_set1_epi32(0xfff);
+  const __m256i lowMask = _mm256_set1_epi32(ransLow - 1);
+  const __m256i wordMask = _mm256_set1_epi32(0xffff);
+  const __m256i two = _mm256_set1_epi32(2);
+  // The symbol is the top byte of every entry
+  const __m256i symbolBytes = _mm256_setr_epi8(3, 7, 11, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                               -1, -1, -1, 3, 7, 11, 15, -1, -1, -1, -1, -1, -1,
+                                               -1, -1, -1, -1, -1, -1);
+
+  for (size_t r = 0; r < rounds; ++r) {
+    for (int v = 0; v < vectors; ++v) {
+      __m256i slot = _mm256_and_si256(state[v], slotMask);
+      __m256i entry = _mm256_i32gather_epi32(reinterpret_cast<const int *>(table), slot, 4);
+      __m256i freq = _mm256_and_si256(entry, fieldMask);
+      __m256i bias = _mm256_and_si256(_mm256_srli_epi32(entry, 12), fieldMask);
+      __m256i next = _mm256_add_epi32(
+          _mm256_mullo_epi32(freq, _mm256_srli_epi32(state[v], probabilityBits)), bias);
+
+      // Lanes below ransLow shift in their next word and advance
+      __m256i refill =
+          _mm256_cmpeq_epi32(_mm256_andnot_si256(lowMask, next), _mm256_setzero_si256());
+      __m256i word = _mm256_and_si256(
+          _mm256_i32gather_epi32(reinterpret_cast<const int *>(base), offset[v], 1), wordMask);
+      __m256i refilled = _mm256_or_si256(_mm256_slli_epi32(next, 16), word);
+      state[v] = _mm256_blendv_epi8(next, refilled, refill);
+      offset[v] = _mm256_add_epi32(offset[v], _mm256_and_si256(refill, two));
+
+      __m256i symbols = _mm256_shuffle_epi8(entry, symbolBytes);
+      __m128i packed = _mm_unpacklo_epi32(_mm256_castsi256_si128(symbols),
+                                          _mm256_extracti128_si256(symbols, 1));
+      _mm_storel_epi64(reinterpret_cast<__m128i *>(out + r * ransStates + 8 * v), packed);
+    }
+  }
+
+  for (int v = 0; v < vectors; ++v) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(x + 8 * v), state[v]);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(offsets + 8 * v), offset[v]);
+  }
+  for (int k = 0; k < ransStates; ++k) lanes[k] = base + offsets[k];
+}
+#endif
+
+/**
+ * @brief decodeStream Decodes one byte stream of exactly count symbols.
+ */
+bool decodeStream(Reader &in, uint8_t *out, size_t count) {
+  if (in.u32() != count) return false;
+  uint8_t mode = in.u8();
+  if (mode == RawStream) {
+    const uint8_t *bytes = in.bytes(count);
+    if (bytes) std::memcpy(out, bytes, count);
+    return in.ok;
+  }
+  if (mode == ConstantStream) {
+    std::memset(out, in.u8(), count);
+    return in.ok;
+  }
+  if (mode != RansStream) return false;
+
+  uint32_t table[probabilityScale];
+  uint32_t start = 0;
+  for (uint32_t s = 0; s < 256; ++s) {
+    uint32_t freq = in.varint();
+    if (!in.ok || freq >= probabilityScale || start + freq > probabilityScale) return false;
+    for (uint32_t j = 0; j < freq; ++j) {
+      table[start + j] = freq | j << 12 | s << 24;
+    }
+    start += freq;
+  }
+  if (start != probabilityScale) return false;
+
+  const uint8_t *lanes[ransStates];
+  const uint8_t *ends[ransStates];
+  uint32_t x[ransStates];
+  for (int k = 0; k < ransStates; ++k) {
+    uint32_t size = in.u32();
+    const uint8_t *p = in.bytes(size);
+    if (!p || size < 4) return false;
+    x[k] = uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+    lanes[k] = p + 4;
+    ends[k] = p + size;
+  }
+
+  // A step reads at most two bytes, and the AVX2 gathers read four, so as
+  // many rounds as the shortest lane has words to spare need no checks.
+  // That is repeated until a lane is nearly exhausted.
+  size_t rounds = count / ransStates;
+  size_t round = 0;
+  while (round < rounds) {
+    size_t safe = rounds - round;
+    for (int k = 0; k < ransStates; ++k) {
+      safe = std::min(safe, size_t(std::max<ptrdiff_t>(ends[k] - lanes[k] - 2, 0) / 2));
+    }
+    if (safe == 0) break;
+#ifdef SIMD_X86
+    if (simd::isa() == simd::Isa::AVX2) {
+      decodeRoundsAvx2(table, x, lanes, safe, out + round * ransStates);
+    } else
+#endif
+    {
+      decodeRounds(table, x, lanes, safe, out + round * ransStates);
+    }
+    round += safe;
+  }
+
+  // Near the end of a lane, check before every read
+  for (size_t i = round * ransStates; i < count; ++i) {
+    int k = i % ransStates;
+    uint32_t &state = x[k];
+    uint32_t entry = table[state & (probabilityScale - 1)];
+    out[i] = uint8_t(entry >> 24);
+    state = (entry & 0xfff) * (state >> probabilityBits) + ((entry >> 12) & 0xfff);
+    if (state < ransLow) {
+      if (ends[k] - lanes[k] < 2) return false;
+      state = state << 16 | uint32_t(lanes[k][0]) | uint32_t(lanes[k][1]) << 8;
+      lanes[k] += 2;
+    }
+  }
+  return true;
+}
+
+// Spreads the lower 10 bits of v so there are two zero bits between each
+uint32_t spreadBits(uint32_t v) {
+  v &= 0x3ff;
+  v = (v | v << 16) & 0x030000ff;
+  v = (v | v << 8) & 0x0300f00f;
+  v = (v | v << 4) & 0x030c30c3;
+  v = (v | v << 2) & 0x09249249;
+  return v;
+}
+
+void encodePositions(const uint16_t *quantized, uint32_t count, std::vector<char> &out) {
+  std::vector<uint8_t> planes(6 * size_t(count));
+  uint16_t previous[3] = {0, 0, 0};
+  for (uint32_t i = 0; i < count; ++i) {
+    for (int c = 0; c < 3; ++c) {
+      uint16_t q = quantized[3 * i + c];
+      uint16_t z = zigzag16(int16_t(uint16_t(q - previous[c])));
+      planes[(2 * c) * size_t(count) + i] = uint8_t(z);
+      planes[(2 * c + 1) * size_t(count) + i] = uint8_t(z >> 8);
+      previous[c] = q;
+    }
+  }
+  for (int plane = 0; plane < 6; ++plane) {
+    encodeStream(&planes[plane * size_t(count)], count, out);
+  }
+}
+
+// The differences between consecutive indices are zigzag coded and split in
+// three streams: two bits per index holding its number of bytes beyond the
+// first, four indices per byte; the low byte of every index; and the higher
+// bytes of the indices that have them
+void encodeIndices(const unsigned *indices, uint32_t count, std::vector<char> &out) {
+  std::vector<uint8_t> lengths((count + 3) / 4);
+  std::vector<uint8_t> low(count);
+  std::vector<uint8_t> high;
+  unsigned previous = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t z = zigzag(int32_t(indices[i] - previous));
+    uint32_t extra = (z > 0xff) + (z > 0xffff) + (z > 0xffffff);
+    lengths[i / 4] |= uint8_t(extra << (2 * (i % 4)));
+    low[i] = uint8_t(z);
+    for (uint32_t b = 1; b <= extra; ++b) {
+      high.push_back(uint8_t(z >> (8 * b)));
+    }
+    previous = indices[i];
+  }
+  encodeStream(lengths.data(), lengths.size(), out);
+  encodeStream(low.data(), low.size(), out);
+  encodeStream(high.data(), high.size(), out);
+}
+
+// One pass over the vertices, so the three running sums overlap and every
+// vertex is written at once
+void decodePositions(const uint8_t *planes, uint32_t count, const float minimum[3],
+                     const float scale[3], float *out) {
+  const uint8_t *x0 = planes, *x1 = x0 + count, *y0 = x1 + count, *y1 = y0 + count,
+                *z0 = y1 + count, *z1 = z0 + count;
+  uint16_t x = 0, y = 0, z = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    x = uint16_t(x + unzigzag16(uint16_t(x0[i] | x1[i] << 8)));
+    y = uint16_t(y + unzigzag16(uint16_t(y0[i] | y1[i] << 8)));
+    z = uint16_t(z + unzigzag16(uint16_t(z0[i] | z1[i] << 8)));
+    out[3 * i] = minimum[0] + x * scale[0];
+    out[3 * i + 1] = minimum[1] + y * scale[1];
+    out[3 * i + 2] = minimum[2] + z * scale[2];
+  }
+}
+
+/**
+ * @brief decodeIndices Decodes the three streams of an index block. Every
+ * index reads a word of high bytes and masks off the ones it does not have,
+ * so there is no branch on its length, and the only dependency from one
+ * index to the next is an addition.
+ * @param high The higher bytes, followed by four readable padding bytes.
+ */
+bool decodeIndices(const uint8_t *lengths, const uint8_t *low, const uint8_t *high,
+                   size_t highCount, uint32_t count, uint32_t vertexCount, unsigned *out) {
+  static const uint32_t masks[4] = {0, 0xff00, 0xffff00, 0xffffff00};
+  const uint8_t *p = high;
+  const uint8_t *end = high + highCount;
+  uint32_t bad = 0;
+  unsigned previous = 0;
+
+  // The caller guarantees four readable bytes at p
+  auto step = [&](uint32_t extra, uint8_t first) {
+    uint32_t z = (qFromLittleEndian<quint32>(p) << 8 & masks[extra]) | first;
+    p += extra;
+    previous += unsigned(unzigzag(z));
+    bad |= previous >= vertexCount;
+    return previous;
+  };
+
+  uint32_t i = 0;
+  // With twelve bytes left, four indices cannot read past the padding
+  for (; i + 4 <= count && end - p >= 12; i += 4) {
+    uint32_t packed = lengths[i / 4];
+    out[i] = step(packed & 3, low[i]);
+    out[i + 1] = step((packed >> 2) & 3, low[i + 1]);
+    out[i + 2] = step((packed >> 4) & 3, low[i + 2]);
+    out[i + 3] = step(packed >> 6, low[i + 3]);
+  }
+  for (; i < count; ++i) {
+    uint32_t extra = (lengths[i / 4] >> (2 * (i % 4))) & 3;
+    if (size_t(end - p) < extra) return false;
+    out[i] = step(extra, low[i]);
+  }
+  return !bad && p == end;
+}
+
+bool readHeader(Reader &in, uint32_t &vertexCount, uint32_t &indexCount, uint32_t &bits,
+                float minimum[3], float maximum[3], std::vector<Block> &blocks) {
+  const uint8_t *m = in.bytes(sizeof(magic));
+  if (!m || std::memcmp(m, magic, sizeof(magic)) != 0) return false;
+  vertexCount = in.u32();
+  indexCount = in.u32();
+  bits = in.u32();
+  uint32_t blockCount = in.u32();
+  for (int c = 0; c < 3; ++c) minimum[c] = in.f32();
+  for (int c = 0; c < 3; ++c) maximum[c] = in.f32();
+  if (!in.ok || bits < 1 || bits > 16 || indexCount % 3 != 0 ||
+      blockCount > size_t(in.end - in.p) / blockEntrySize) {
+    return false;
+  }
+
+  blocks.resize(blockCount);
+  std::vector<std::pair<uint32_t, uint32_t>> ranges[2];  // first and count, per kind
+  for (Block &block : blocks) {
+    block.kind = in.u8();
+    in.bytes(3);
+    block.first = in.u32();
+    block.count = in.u32();
+    block.offset = in.u64();
+    block.size = in.u32();
+    if (block.kind > IndexBlock) return false;
+    ranges[block.kind].push_back({block.first, block.count});
+  }
+  if (!in.ok) return false;
+
+  // The blocks are decoded in parallel, so the blocks of a kind must cover
+  // its output exactly once: an overlap would be written by two threads
+  const uint32_t totals[2] = {vertexCount, indexCount};
+  for (int kind = PositionBlock; kind <= IndexBlock; ++kind) {
+    std::sort(ranges[kind].begin(), ranges[kind].end());
+    uint64_t covered = 0;
+    for (const std::pair<uint32_t, uint32_t> &range : ranges[kind]) {
+      if (range.first != covered) return false;
+      covered += range.second;
+    }
+    if (covered != totals[kind]) return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+namespace meshcodec {
+
+bool isEncoded(const char *data, size_t size) {
+  return size >= sizeof(magic) && std::memcmp(data, magic, sizeof(magic)) == 0;
+}
+
+/**
+ * @brief meshcodec::encode Compresses an indexed triangle mesh.
+ * @param coords The vertex positions.
+ * @param indices Three indices per triangle.
+ * @param positionBits Bits per quantized coordinate, at most 16.
+ * @param jobs Job system the blocks are encoded on, or nullptr to encode them
+ * on the calling thread.
+ * @return The encoded file contents.
+ */
+std::vector<char> encode(Span<const QVector3D> coords, Span<const unsigned> indices,
+                         int positionBits, JobSystem *jobs) {
+  positionBits = std::clamp(positionBits, 1, 16);
+  size_t triangleCount = indices.size() / 3;
+
+  float minimum[3] = {0, 0, 0}, maximum[3] = {0, 0, 0};
+  if (!coords.empty()) {
+    for (int c = 0; c < 3; ++c) {
+      minimum[c] = maximum[c] = coords[0][c];
+    }
+    for (const QVector3D &v : coords) {
+      for (int c = 0; c < 3; ++c) {
+        minimum[c] = std::min(minimum[c], v[c]);
+        maximum[c] = std::max(maximum[c], v[c]);
+      }
+    }
+  }
+
+  // Sort the triangles along a Morton curve through their centroids, so
+  // neighbouring triangles share vertices
+  std::vector<std::pair<uint32_t, uint32_t>> order(triangleCount);
+  for (size_t t = 0; t < triangleCount; ++t) {
+    uint32_t code = 0;
+    for (int c = 0; c < 3; ++c) {
+      float centroid =
+          (coords[indices[3 * t]][c] + coords[indices[3 * t + 1]][c] + coords[indices[3 * t + 2]][c]) / 3;
+      float extent = maximum[c] - minimum[c];
+      float unit = extent > 0 ? (centroid - minimum[c]) / extent : 0;
+      code |= spreadBits(uint32_t(std::clamp(unit, 0.0f, 1.0f) * 1023)) << c;
+    }
+    order[t] = {code, uint32_t(t)};
+  }
+  std::sort(order.begin(), order.end());
+
+  // Number the vertices in order of first use; a triangle's new vertex is
+  // then usually one more than the largest index so far
+  std::vector<uint32_t> remap(coords.size(), UINT32_MAX);
+  std::vector<uint32_t> vertexOrder;
+  vertexOrder.reserve(coords.size());
+  std::vector<unsigned> reordered(3 * triangleCount);
+  for (size_t t = 0; t < triangleCount; ++t) {
+    uint32_t corner[3];
+    for (int k = 0; k < 3; ++k) {
+      uint32_t old = indices[3 * order[t].second + k];
+      if (remap[old] == UINT32_MAX) {
+        remap[old] = uint32_t(vertexOrder.size());
+        vertexOrder.push_back(old);
+      }
+      corner[k] = remap[old];
+    }
+    // Start at the smallest index; rotating keeps the winding
+    int first = int(std::min_element(corner, corner + 3) - corner);
+    for (int k = 0; k < 3; ++k) {
+      reordered[3 * t + k] = corner[(first + k) % 3];
+    }
+  }
+
+  uint32_t levels = (1u << positionBits) - 1;
+  std::vector<uint16_t> quantized(3 * vertexOrder.size());
+  for (size_t i = 0; i < vertexOrder.size(); ++i) {
+    for (int c = 0; c < 3; ++c) {
+      float extent = maximum[c] - minimum[c];
+      float unit = extent > 0 ? (coords[vertexOrder[i]][c] - minimum[c]) / extent : 0;
+      quantized[3 * i + c] = uint16_t(std::lround(std::clamp(unit, 0.0f, 1.0f) * levels));
+    }
+  }
+
+  std::vector<Block> blocks;
+  for (uint32_t first = 0; first < vertexOrder.size(); first += verticesPerBlock) {
+    blocks.push_back({PositionBlock, first,
+                      std::min<uint32_t>(verticesPerBlock, uint32_t(vertexOrder.size()) - first), 0, 0});
+  }
+  for (uint32_t first = 0; first < reordered.size(); first += indicesPerBlock) {
+    blocks.push_back({IndexBlock, first,
+                      std::min<uint32_t>(indicesPerBlock, uint32_t(reordered.size()) - first), 0, 0});
+  }
+
+  std::vector<std::vector<char>> payloads(blocks.size());
+  auto encodeBlocks = [&](size_t begin, size_t end) {
+    for (size_t b = begin; b < end; ++b) {
+      const Block &block = blocks[b];
+      if (block.kind == PositionBlock) {
+        encodePositions(&quantized[3 * size_t(block.first)], block.count, payloads[b]);
+      } else {
+        encodeIndices(&reordered[block.first], block.count, payloads[b]);
+      }
+    }
+  };
+  if (jobs) {
+    jobs->parallelFor(blocks.size(), 1, encodeBlocks);
+  } else {
+    encodeBlocks(0, blocks.size());
+  }
+
+  std::vector<char> out(magic, magic + sizeof(magic));
+  putU32(out, uint32_t(vertexOrder.size()));
+  putU32(out, uint32_t(reordered.size()));
+  putU32(out, uint32_t(positionBits));
+  putU32(out, uint32_t(blocks.size()));
+  for (int c = 0; c < 3; ++c) putFloat(out, minimum[c]);
+  for (int c = 0; c < 3; ++c) putFloat(out, maximum[c]);
+
+  uint64_t offset = headerSize + blocks.size() * blockEntrySize;
+  for (size_t b = 0; b < blocks.size(); ++b) {
+    out.push_back(char(blocks[b].kind));
+    out.insert(out.end(), 3, 0);
+    putU32(out, blocks[b].first);
+    putU32(out, blocks[b].count);
+    putU64(out, offset);
+    putU32(out, uint32_t(payloads[b].size()));
+    offset += payloads[b].size();
+  }
+  for (const std::vector<char> &payload : payloads) {
+    out.insert(out.end(), payload.begin(), payload.end());
+  }
+  return out;
+}
+
+bool readCounts(const char *data, size_t size, size_t &vertexCount, size_t &indexCount) {
+  Reader in{reinterpret_cast<const uint8_t *>(data), reinterpret_cast<const uint8_t *>(data) + size};
+  uint32_t vertices, indices, bits;
+  float minimum[3], maximum[3];
+  std::vector<Block> blocks;
+  if (!readHeader(in, vertices, indices, bits, minimum, maximum, blocks)) return false;
+  vertexCount = vertices;
+  indexCount = indices;
+  return true;
+}
+
+/**
+ * @brief meshcodec::decode Decompresses a mesh, one job per block.
+ * @param data The encoded file contents.
+ * @param size Size of data in bytes.
+ * @param coords Receives readCounts() vertex positions.
+ * @param indices Receives readCounts() indices.
+ * @param jobs Job system the blocks are decoded on, or nullptr to decode them
+ * on the calling thread.
+ * @return Whether the data was valid. If not, the output is incomplete.
+ */
+bool decode(const char *data, size_t size, QVector3D *coords, unsigned *indices, JobSystem *jobs) {
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+  Reader header{bytes, bytes + size};
+  uint32_t vertexCount, indexCount, bits;
+  float minimum[3], maximum[3];
+  std::vector<Block> blocks;
+  if (!readHeader(header, vertexCount, indexCount, bits, minimum, maximum, blocks)) return false;
+
+  float scale[3];
+  for (int c = 0; c < 3; ++c) {
+    scale[c] = (maximum[c] - minimum[c]) / float((1u << bits) - 1);
+  }
+
+  std::atomic<bool> valid{true};
+  auto decodeBlocks = [&](size_t begin, size_t end) {
+    // Decoded byte streams, reused across the blocks of this thread
+    static thread_local std::vector<uint8_t> scratch;
+    for (size_t b = begin; b < end; ++b) {
+      const Block &block = blocks[b];
+      if (block.offset > size || block.size > size - block.offset) {
+        valid = false;
+        continue;
+      }
+      Reader in{bytes + block.offset, bytes + block.offset + block.size};
+      uint32_t n = block.count;
+
+      bool ok;
+      if (block.kind == PositionBlock) {
+        scratch.resize(6 * size_t(n));
+        ok = true;
+        for (int plane = 0; plane < 6 && ok; ++plane) {
+          ok = decodeStream(in, &scratch[plane * size_t(n)], n);
+        }
+        if (ok) {
+          decodePositions(scratch.data(), n, minimum, scale,
+                          reinterpret_cast<float *>(coords + block.first));
+        }
+      } else {
+        size_t lengthCount = (size_t(n) + 3) / 4;
+        scratch.resize(lengthCount + n);
+        ok = decodeStream(in, scratch.data(), lengthCount) &&
+             decodeStream(in, scratch.data() + lengthCount, n);
+        // Peek at the number of higher bytes, at most three per index
+        Reader peek = in;
+        uint32_t highCount = peek.u32();
+        ok = ok && peek.ok && highCount <= 3 * size_t(n);
+        if (ok) {
+          scratch.resize(lengthCount + n + highCount + 4);
+          uint8_t *high = scratch.data() + lengthCount + n;
+          std::memset(high + highCount, 0, 4);
+          ok = decodeStream(in, high, highCount) &&
+               decodeIndices(scratch.data(), scratch.data() + lengthCount, high, highCount, n,
+                             vertexCount, indices + block.first);
+        }
+      }
+      if (!ok) valid = false;
+    }
+  };
+  if (jobs) {
+    jobs->parallelFor(blocks.size(), 1, decodeBlocks);
+  } else {
+    decodeBlocks(0, blocks.size());
+  }
+  return valid;
+}
+
+}  // namespace meshcodec
@@ -0,0 +1,53 @@
+#ifndef MESHCODEC_H
+#define MESHCODEC_H
+
+#include <QVector3D>
+
+#include <cstddef>
+#include <vector>
+
+#include "jobsystem.h"
+#include "span.h"
+
+/**
+ * @brief Compressed file format for indexed triangle meshes (.cgmesh).
+ *
+ * Encoding reorders the mesh for compressibility: triangles are sorted along
+ * a Morton curve through their centroids, and vertices are renumbered in
+ * order of first use, so consecutive indices are close. Positions are
+ * quantized to at most 16 bits per axis within the mesh bounds. Both streams
+ * are split into blocks that are coded independently:
+ *
+ * - a position block stores the per-axis differences between consecutive
+ *   vertices, zigzag coded, as separate low and high byte planes;
+ * - an index block stores the differences between consecutive indices,
+ *   zigzag coded, as the low byte of every index, the higher bytes of the
+ *   indices that have them, and two bits per index counting those.
+ *
+ * Every byte stream then goes through a static rANS entropy coder with 32
+ * interleaved states, unless that saves less than an eighth of its size; it
+ * is then stored raw. The states are decoded eight at a time with AVX2 where
+ * available (see simd::isa()). Decoding runs one job per block.
+ */
+namespace meshcodec {
+
+// Whether data starts with the magic of an encoded mesh
+bool isEncoded(const char *data, size_t size);
+
+// Encodes a mesh. The vertices and triangles are reordered; the winding of
+// every triangle is kept, unused vertices are dropped. Without a job system,
+// the blocks are encoded on the calling thread.
+std::vector<char> encode(Span<const QVector3D> coords, Span<const unsigned> indices,
+                         int positionBits = 16, JobSystem *jobs = &JobSystem::global());
+
+// Reads the number of vertices and indices; false if the header is invalid
+bool readCounts(const char *data, size_t size, size_t &vertexCount, size_t &indexCount);
+
+// Decodes into arrays sized as given by readCounts(); false if the data is
+// corrupt. Without a job system, the blocks are decoded on the calling thread.
+bool decode(const char *data, size_t size, QVector3D *coords, unsigned *indices,
+            JobSystem *jobs = &JobSystem::global());
+
+}  // namespace meshcodec
+
+#endif  // MESHCODEC_H
@@ -0,0 +1,109 @@
+#include "meshlet.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "bounds.h"
+
+namespace {
+/**
+ * @brief finishMeshlet Computes the bounding sphere and normal cone of the
+ * triangles in the meshlet's index range.
+ */
+void finishMeshlet(Meshlet &meshlet, Span<const QVector3D> coords,
+                   Span<const unsigned> indices) {
+  unsigned first = meshlet.firstIndex;
+  unsigned last = first + meshlet.indexCount;
+
+  Bounds bounds;
+  for (unsigned i = first; i < last; ++i) {
+    bounds.extend(coords[indices[i]]);
+  }
+  meshlet.center = bounds.center();
+  meshlet.radius = 0;
+  for (unsigned i = first; i < last; ++i) {
+    meshlet.radius = std::max(meshlet.radius, (coords[indices[i]] - meshlet.center).length());
+  }
+
+  std::vector<QVector3D> normals;
+  normals.reserve(meshlet.indexCount / 3);
+  QVector3D axis;
+  for (unsigned i = first; i + 2 < last; i += 3) {
+    const QVector3D &a = coords[indices[i]];
+    const QVector3D &b = coords[indices[i + 1]];
+    const QVector3D &c = coords[indices[i + 2]];
+    QVector3D normal = QVector3D::crossProduct(b - a, c - a);
+    if (normal.lengthSquared() == 0) continue;  // degenerate
+    normal.normalize();
+    normals.push_back(normal);
+    axis += normal;
+  }
+
+  // By default the meshlet can never be rejected on its normals
+  meshlet.coneAxis = QVector3D(0, 0, 1);
+  meshlet.coneCutoff = 1;
+  if (normals.empty() || axis.lengthSquared() == 0) return;
+
+  axis.normalize();
+  float minDot = 1;
+  for (const QVector3D &normal : normals) {
+    minDot = std::min(minDot, QVector3D::dotProduct(normal, axis));
+  }
+  // Normals spanning a hemisphere or more always face the camera somewhere
+  if (minDot <= 0) return;
+
+  meshlet.coneAxis = axis;
+  meshlet.coneCutoff = std::sqrt(1 - minDot * minDot);
+}
+}  // namespace
+
+/**
+ * @brief Meshlet::build Partitions an indexed triangle mesh into meshlets.
+ * The triangles keep their order, so every meshlet is a contiguous range of
+ * the index buffer.
+ * @param coords The unique vertex coordinates.
+ * @param indices Three indices into coords per triangle.
+ * @return The meshlets, covering all triangles.
+ */
+std::vector<Meshlet> Meshlet::build(Span<const QVector3D> coords,
+                                    Span<const unsigned> indices) {
+  std::vector<Meshlet> meshlets;
+
+  // The meshlet a vertex was last counted in
+  std::vector<unsigned> lastMeshlet(coords.size(), unsigned(-1));
+
+  Meshlet current{0, 0, QVector3D(), 0, QVector3D(), 1};
+  unsigned vertexCount = 0;
+
+  for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+    unsigned id = meshlets.size();
+    unsigned added = 0;
+    for (int corner = 0; corner < 3; ++corner) {
+      added += lastMeshlet[indices[i + corner]] != id;
+    }
+
+    if (vertexCount + added > maxVertices ||
+        current.indexCount / 3 + 1 > maxTriangles) {
+      finishMeshlet(current, coords, indices);
+      meshlets.push_back(current);
+      current = Meshlet{unsigned(i), 0, QVector3D(), 0, QVector3D(), 1};
+      vertexCount = 0;
+      id = meshlets.size();
+    }
+
+    for (int corner = 0; corner < 3; ++corner) {
+      unsigned &last = lastMeshlet[indices[i + corner]];
+      if (last != id) {
+        last = id;
+        ++vertexCount;
+      }
+    }
+    current.indexCount += 3;
+  }
+
+  if (current.indexCount > 0) {
+    finishMeshlet(current, coords, indices);
+    meshlets.push_back(current);
+  }
+  return meshlets;
+}
@@ -0,0 +1,49 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <QVector3D>
+
+#include <vector>
+
+#include "frustum.h"
+#include "span.h"
+
+/**
+ * @brief A small cluster of neighbouring triangles that is culled as a whole.
+ *
+ * A meshlet covers a contiguous range of the mesh's index buffer. Besides a
+ * bounding sphere it has a normal cone: the triangles' normals all lie within
+ * coneCutoff of coneAxis, which makes it possible to reject a meshlet whose
+ * triangles all face away from the camera before any of its vertices are
+ * shaded.
+ */
+struct Meshlet {
+  unsigned firstIndex;
+  unsigned indexCount;
+
+  QVector3D center;
+  float radius;
+
+  QVector3D coneAxis;
+  float coneCutoff;  // sine of the cone's half angle; 1 if it cannot be culled
+
+  static const unsigned maxVertices = 64;
+  static const unsigned maxTriangles = 124;
+
+  // Splits the triangles, in order, into meshlets of at most maxVertices
+  // unique vertices and maxTriangles triangles.
+  static std::vector<Meshlet> build(Span<const QVector3D> coords,
+                                    Span<const unsigned> indices);
+
+  // Tests in model space, i.e. with the frustum of (projection * model) and
+  // the camera position transformed into the model.
+  bool isVisible(const Frustum &frustum, const QVector3D &camera) const {
+    if (!frustum.intersectsSphere(center, radius)) return false;
+
+    QVector3D toCenter = center - camera;
+    return QVector3D::dotProduct(toCenter, coneAxis) <
+           coneCutoff * toCenter.length() + radius;
+  }
+};
+
+#endif  // MESHLET_H
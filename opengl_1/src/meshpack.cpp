@@ -0,0 +1,57 @@
+#include <QCoreApplication>
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+
+#include "meshcodec.h"
+#include "model.h"
+
+/**
+ * @brief main Converter tool that compresses a mesh into a .cgmesh file,
+ * which Model opens directly.
+ *
+ * Usage: meshpack input.obj output.cgmesh [positionBits]
+ *
+ * @param argc Argument count.
+ * @param argv Arguments.
+ * @return Exit code.
+ */
+int main(int argc, char *argv[]) {
+  QCoreApplication app(argc, argv);
+  QStringList args = app.arguments();
+
+  if (args.size() < 3) {
+    qWarning() << "Usage: meshpack input.obj output.cgmesh [positionBits]";
+    return 1;
+  }
+
+  int positionBits = args.size() > 3 ? args[3].toInt() : 16;
+  if (positionBits < 1 || positionBits > 16) {
+    qWarning() << "positionBits must be between 1 and 16";
+    return 1;
+  }
+
+  Model model(args[1], Model::Indexed);
+  if (model.getNumTriangles() == 0) {
+    qWarning() << "No triangles in" << args[1];
+    return 1;
+  }
+
+  std::vector<char> encoded =
+      meshcodec::encode(model.getCoords(), model.getTriangleIndices(), positionBits);
+
+  QFile file(args[2]);
+  if (!file.open(QIODevice::WriteOnly) ||
+      file.write(encoded.data(), encoded.size()) != qint64(encoded.size())) {
+    qWarning() << ":: Cannot write compressed mesh:" << args[2];
+    return 1;
+  }
+
+  qint64 rawSize = model.getCoords().size() * sizeof(QVector3D) +
+                   model.getTriangleIndices().size() * sizeof(unsigned);
+  qDebug() << ":: Compressed" << model.getNumTriangles() << "triangles from"
+           << QFileInfo(args[1]).size() << "bytes (" << rawSize << "bytes as binary ) to"
+           << encoded.size() << "bytes";
+  return 0;
+}
@@ -1,40 +1,591 @@
 #include "model.h"
 
+#include <QByteArray>
 #include <QDebug>
 #include <QFile>
 #include <QTextStream>
+#include <QtEndian>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+#include <vector>
+
+#include "meshcodec.h"
+
+namespace {
+// Exact bit pattern of a position, for welding identical vertices
+struct PositionKey {
+  quint32 bits[3];
+
+  explicit PositionKey(const QVector3D& v) {
+    for (int i = 0; i < 3; ++i) {
+      float f = v[i] + 0.0f;  // folds -0 into +0, which compare equal
+      std::memcpy(&bits[i], &f, sizeof(f));
+    }
+  }
+
+  bool operator==(const PositionKey& other) const {
+    return bits[0] == other.bits[0] && bits[1] == other.bits[1] &&
+           bits[2] == other.bits[2];
+  }
+};
+
+struct PositionKeyHash {
+  size_t operator()(const PositionKey& key) const {
+    size_t h = key.bits[0];
+    h = h * 0x9E3779B97F4A7C15ull ^ key.bits[1];
+    h = h * 0x9E3779B97F4A7C15ull ^ key.bits[2];
+    return h ^ (h >> 29);
+  }
+};
+
+// --- Binary PLY
+
+enum class PlyType { Int8, Uint8, Int16, Uint16, Int32, Uint32, Float32, Float64, Invalid };
+
+PlyType plyType(const QByteArray& name) {
+  if (name == "char" || name == "int8") return PlyType::Int8;
+  if (name == "uchar" || name == "uint8") return PlyType::Uint8;
+  if (name == "short" || name == "int16") return PlyType::Int16;
+  if (name == "ushort" || name == "uint16") return PlyType::Uint16;
+  if (name == "int" || name == "int32") return PlyType::Int32;
+  if (name == "uint" || name == "uint32") return PlyType::Uint32;
+  if (name == "float" || name == "float32") return PlyType::Float32;
+  if (name == "double" || name == "float64") return PlyType::Float64;
+  return PlyType::Invalid;
+}
+
+int plySize(PlyType type) {
+  static const int sizes[] = {1, 1, 2, 2, 4, 4, 4, 8, 0};
+  return sizes[int(type)];
+}
+
+bool isInteger(PlyType type) { return type < PlyType::Float32; }
+
+// Reads one value of any type; integers are exact
+double plyValue(const char* p, PlyType type, bool bigEndian) {
+  switch (type) {
+    case PlyType::Int8:
+      return qint8(*p);
+    case PlyType::Uint8:
+      return quint8(*p);
+    case PlyType::Int16:
+      return bigEndian ? qFromBigEndian<qint16>(p) : qFromLittleEndian<qint16>(p);
+    case PlyType::Uint16:
+      return bigEndian ? qFromBigEndian<quint16>(p) : qFromLittleEndian<quint16>(p);
+    case PlyType::Int32:
+      return bigEndian ? qFromBigEndian<qint32>(p) : qFromLittleEndian<qint32>(p);
+    case PlyType::Uint32:
+      return bigEndian ? qFromBigEndian<quint32>(p) : qFromLittleEndian<quint32>(p);
+    case PlyType::Float32: {
+      quint32 bits = bigEndian ? qFromBigEndian<quint32>(p) : qFromLittleEndian<quint32>(p);
+      float value;
+      std::memcpy(&value, &bits, sizeof(value));
+      return value;
+    }
+    case PlyType::Float64: {
+      quint64 bits = bigEndian ? qFromBigEndian<quint64>(p) : qFromLittleEndian<quint64>(p);
+      double value;
+      std::memcpy(&value, &bits, sizeof(value));
+      return value;
+    }
+    default:
+      return 0;
+  }
+}
+
+struct PlyProperty {
+  QByteArray name;
+  PlyType type = PlyType::Invalid;       // of the value, or of the list items
+  PlyType countType = PlyType::Invalid;  // of the list length, for lists
+
+  bool isList() const { return countType != PlyType::Invalid; }
+};
+
+struct PlyElement {
+  QByteArray name;
+  qint64 count = 0;
+  std::vector<PlyProperty> properties;
+};
+
+struct PlyHeader {
+  bool bigEndian = false;
+  std::vector<PlyElement> elements;
+  qint64 size = 0;  // up to and including the end_header line
+};
 
 /**
- * @brief Model::Model Constructs a new model from a Wavefront .obj file.
- * @param filename The filename. Should be a .obj file
+ * @brief parsePlyHeader Reads the elements and properties of a binary PLY
+ * header.
+ * @param data The file.
+ * @param size Size of the file in bytes.
+ * @param header Receives the header.
+ * @return Whether the header is valid and the data binary.
  */
-Model::Model(const QString& filename) {
+bool parsePlyHeader(const char* data, qint64 size, PlyHeader& header) {
+  // Headers are short; do not scan a large file that has no end_header
+  QByteArray text = QByteArray::fromRawData(data, std::min<qint64>(size, 1 << 16));
+  qsizetype headerEnd = text.indexOf("end_header");
+  qsizetype lineEnd = headerEnd < 0 ? -1 : text.indexOf('\n', headerEnd);
+  if (lineEnd < 0) return false;
+  header.size = lineEnd + 1;
+
+  bool binary = false;
+  for (const QByteArray& line : text.left(headerEnd).split('\n')) {
+    QList<QByteArray> tokens = line.simplified().split(' ');
+    const QByteArray& keyword = tokens[0];
+    if (keyword == "format" && tokens.size() >= 2) {
+      // ASCII PLY is not supported
+      binary = tokens[1] == "binary_little_endian" || tokens[1] == "binary_big_endian";
+      header.bigEndian = tokens[1] == "binary_big_endian";
+    } else if (keyword == "element" && tokens.size() >= 3) {
+      PlyElement element;
+      element.name = tokens[1];
+      bool ok = false;
+      element.count = tokens[2].toLongLong(&ok);
+      if (!ok || element.count < 0) return false;
+      header.elements.push_back(element);
+    } else if (keyword == "property" && tokens.size() >= 3) {
+      if (header.elements.empty()) return false;
+      PlyProperty property;
+      if (tokens[1] == "list") {
+        if (tokens.size() < 5) return false;
+        property.countType = plyType(tokens[2]);
+        property.type = plyType(tokens[3]);
+        property.name = tokens[4];
+        if (!isInteger(property.countType)) return false;
+      } else {
+        property.type = plyType(tokens[1]);
+        property.name = tokens[2];
+      }
+      if (property.type == PlyType::Invalid) return false;
+      header.elements.back().properties.push_back(property);
+    }
+    // ply, comment and obj_info lines carry nothing we need
+  }
+  return binary;
+}
+
+/**
+ * @brief skipPlyElement Moves past all records of an element.
+ * @param element The element.
+ * @param p Start of its first record, advanced past the last one.
+ * @param end End of the data.
+ * @param bigEndian Byte order of the data.
+ * @return False if the data ends early.
+ */
+bool skipPlyElement(const PlyElement& element, const char*& p, const char* end,
+                    bool bigEndian) {
+  // Without lists all records have the same size
+  qint64 stride = 0;
+  for (const PlyProperty& property : element.properties) {
+    stride = property.isList() ? -1 : stride + plySize(property.type);
+    if (stride < 0) break;
+  }
+  if (stride >= 0) {
+    if (stride > 0 && (end - p) / stride < element.count) return false;
+    p += stride * element.count;
+    return true;
+  }
+
+  for (qint64 record = 0; record < element.count; ++record) {
+    for (const PlyProperty& property : element.properties) {
+      qint64 count = 1;
+      if (property.isList()) {
+        if (end - p < plySize(property.countType)) return false;
+        count = qint64(plyValue(p, property.countType, bigEndian));
+        p += plySize(property.countType);
+        if (count < 0) return false;
+      }
+      qint64 bytes = count * plySize(property.type);
+      if (end - p < bytes) return false;
+      p += bytes;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief readPlyVertices Reads the x, y and z properties of every vertex.
+ * Packed floats in the byte order of the machine are copied as they are,
+ * in one go if the vertices have no other properties.
+ * @param element The vertex element.
+ * @param p Start of its first record, advanced past the last one.
+ * @param end End of the data.
+ * @param bigEndian Byte order of the data.
+ * @param coords Receives the positions.
+ * @return False if the element has no position or the data ends early.
+ */
+bool readPlyVertices(const PlyElement& element, const char*& p, const char* end,
+                     bool bigEndian, QVector<QVector3D>& coords) {
+  const char* const axisNames[3] = {"x", "y", "z"};
+  int offsets[3] = {-1, -1, -1};
+  PlyType types[3] = {};
+  qint64 stride = 0;
+  for (const PlyProperty& property : element.properties) {
+    if (property.isList()) return false;
+    for (int axis = 0; axis < 3; ++axis) {
+      if (property.name == axisNames[axis]) {
+        offsets[axis] = stride;
+        types[axis] = property.type;
+      }
+    }
+    stride += plySize(property.type);
+  }
+  if (offsets[0] < 0 || offsets[1] < 0 || offsets[2] < 0) return false;
+  if ((end - p) / stride < element.count) return false;
+
+  coords.resize(element.count);
+  QVector3D* out = coords.data();
+  static_assert(sizeof(QVector3D) == 3 * sizeof(float), "QVector3D must be packed");
+  bool packed = types[0] == PlyType::Float32 && types[1] == PlyType::Float32 &&
+                types[2] == PlyType::Float32 && offsets[1] == offsets[0] + 4 &&
+                offsets[2] == offsets[0] + 8;
+  if (packed && bigEndian == (Q_BYTE_ORDER == Q_BIG_ENDIAN)) {
+    if (stride == sizeof(QVector3D)) {
+      std::memcpy(out, p, element.count * sizeof(QVector3D));
+    } else {
+      for (qint64 i = 0; i < element.count; ++i) {
+        std::memcpy(&out[i], p + i * stride + offsets[0], sizeof(QVector3D));
+      }
+    }
+  } else {
+    for (qint64 i = 0; i < element.count; ++i) {
+      const char* record = p + i * stride;
+      out[i] = QVector3D(plyValue(record + offsets[0], types[0], bigEndian),
+                         plyValue(record + offsets[1], types[1], bigEndian),
+                         plyValue(record + offsets[2], types[2], bigEndian));
+    }
+  }
+  p += element.count * stride;
+  return true;
+}
+
+/**
+ * @brief readPlyFaces Reads the vertex indices of every face; polygons are
+ * split into a fan of triangles. Triangles stored as a byte count and three
+ * 32-bit indices in the byte order of the machine are copied as they are.
+ * @param element The face element.
+ * @param p Start of its first record, advanced past the last one.
+ * @param end End of the data.
+ * @param bigEndian Byte order of the data.
+ * @param indices Receives three indices per triangle.
+ * @return False if the element has no index list or the data ends early.
+ */
+bool readPlyFaces(const PlyElement& element, const char*& p, const char* end,
+                  bool bigEndian, QVector<unsigned>& indices) {
+  int list = -1;
+  for (size_t i = 0; i < element.properties.size(); ++i) {
+    const QByteArray& name = element.properties[i].name;
+    if (name == "vertex_indices" || name == "vertex_index") list = i;
+  }
+  if (list < 0) return false;
+  const PlyProperty& corners = element.properties[list];
+  if (!corners.isList() || !isInteger(corners.type)) return false;
+
+  bool copyTriangles = element.properties.size() == 1 &&
+                       plySize(corners.countType) == 1 && plySize(corners.type) == 4 &&
+                       bigEndian == (Q_BYTE_ORDER == Q_BIG_ENDIAN);
+
+  // Every record holds at least the count of each list and the fixed-size
+  // properties, so a count the data cannot hold is rejected before the
+  // indices are allocated
+  qint64 minRecordSize = 0;
+  for (const PlyProperty& property : element.properties) {
+    minRecordSize += plySize(property.isList() ? property.countType : property.type);
+  }
+  if ((end - p) / minRecordSize < element.count) return false;
+
+  // Room for a triangle per face; polygons grow it
+  indices.resize(element.count * 3);
+  qint64 out = 0;
+  std::vector<unsigned> polygon;
+  for (qint64 face = 0; face < element.count; ++face) {
+    if (copyTriangles && end - p >= 13 && quint8(*p) == 3) {
+      std::memcpy(indices.data() + out, p + 1, 3 * sizeof(unsigned));
+      out += 3;
+      p += 13;
+      continue;
+    }
+
+    polygon.clear();
+    for (int i = 0; i < int(element.properties.size()); ++i) {
+      const PlyProperty& property = element.properties[i];
+      qint64 count = 1;
+      if (property.isList()) {
+        if (end - p < plySize(property.countType)) return false;
+        count = qint64(plyValue(p, property.countType, bigEndian));
+        p += plySize(property.countType);
+        if (count < 0) return false;
+      }
+      qint64 bytes = count * plySize(property.type);
+      if (end - p < bytes) return false;
+      if (i == list) {
+        for (qint64 k = 0; k < count; ++k) {
+          // Negative indices wrap around and fail the range check later
+          polygon.push_back(unsigned(qint64(plyValue(p + k * plySize(property.type),
+                                                     property.type, bigEndian))));
+        }
+      }
+      p += bytes;
+    }
+
+    if (polygon.size() < 3) continue;
+    qint64 needed = out + 3 * qint64(polygon.size() - 2) + 3 * (element.count - face - 1);
+    if (needed > indices.size()) indices.resize(needed);
+    for (size_t k = 1; k + 1 < polygon.size(); ++k) {
+      indices[out++] = polygon[0];
+      indices[out++] = polygon[k];
+      indices[out++] = polygon[k + 1];
+    }
+  }
+  indices.resize(out);
+  return true;
+}
+
+}  // namespace
+
+/**
+ * @brief Model::Model Constructs a new model from a Wavefront .obj file, a
+ * binary .ply or .stl file or a compressed .cgmesh file, told apart by their
+ * first bytes.
+ * @param filename The filename. Should be a .obj, .ply, .stl or .cgmesh file
+ * @param keep The representations to keep; the other one is never built or
+ * is released after loading.
+ */
+Model::Model(const QString& filename, Representation keep) {
   qDebug() << ":: Loading model:" << filename;
   QFile file(filename);
   if (file.open(QIODevice::ReadOnly)) {
-    QTextStream in(&file);
-
-    QString line;
-    QStringList tokens;
-
-    while (!in.atEnd()) {
-      line = in.readLine();
-      if (line.startsWith("#")) continue;  // skip comments
-      tokens = line.split(" ", Qt::SkipEmptyParts);
-      // Switch depending on first element
-      if (tokens[0] == "v") {
-        parseVertex(tokens);
-      } else if (tokens[0] == "f") {
-        parseFace(tokens);
-      }
-    }
+    load(file);
     file.close();
+    finish(keep);
+  }
+}
+
+/**
+ * @brief Model::Model Constructs a new model from .obj, binary .ply or .stl,
+ * or .cgmesh data.
+ * @param device An open device to read the data from.
+ * @param keep The representations to keep.
+ */
+Model::Model(QIODevice& device, Representation keep) {
+  load(device);
+  finish(keep);
+}
+
+/**
+ * @brief Model::detectFormat Recognizes the format of the data from its
+ * first bytes, without consuming them. A binary STL file has no magic, but
+ * its size follows from the triangle count in its header.
+ * @param device An open device to read the data from.
+ * @return The format; Obj if it is none of the others.
+ */
+Model::Format Model::detectFormat(QIODevice& device) {
+  QByteArray head = device.peek(84);
+  if (meshcodec::isEncoded(head.constData(), head.size())) {
+    return Compressed;
+  }
+  if (head.startsWith("ply\n") || head.startsWith("ply\r\n")) {
+    return Ply;
+  }
+  if (head.size() == 84 && !device.isSequential()) {
+    quint32 count = qFromLittleEndian<quint32>(head.constData() + 80);
+    if (device.size() == 84 + 50 * qint64(count)) return Stl;
+  }
+  return Obj;
+}
+
+/**
+ * @brief Model::load Reads the data in whichever format it is. The binary
+ * formats are read straight from the mapped file, or read whole if the
+ * device is not a file that can be mapped.
+ * @param device An open device to read the data from.
+ */
+void Model::load(QIODevice& device) {
+  Format format = detectFormat(device);
+  if (format == Obj) {
+    parse(device);
+    return;
+  }
+
+  QFile* file = qobject_cast<QFile*>(&device);
+  uchar* mapped = file ? file->map(0, file->size()) : nullptr;
+  QByteArray contents;
+  const char* data;
+  qint64 size;
+  if (mapped) {
+    data = reinterpret_cast<const char*>(mapped);
+    size = file->size();
+  } else {
+    contents = device.readAll();
+    data = contents.constData();
+    size = contents.size();
+  }
+
+  switch (format) {
+    case Compressed:
+      decode(data, size);
+      break;
+    case Ply:
+      readPly(data, size);
+      break;
+    case Stl:
+      readStl(data, size);
+      break;
+    case Obj:
+      break;
+  }
+
+  if (mapped) file->unmap(mapped);
+}
+
+/**
+ * @brief Model::parse Reads the vertices and faces of .obj data.
+ * @param device An open device to read the data from.
+ */
+void Model::parse(QIODevice& device) {
+  QTextStream in(&device);
+
+  QString line;
+  QStringList tokens;
+
+  while (!in.atEnd()) {
+    line = in.readLine();
+    if (line.startsWith("#")) continue;  // skip comments
+    tokens = line.split(" ", Qt::SkipEmptyParts);
+    if (tokens.isEmpty()) continue;
+    // Switch depending on first element
+    if (tokens[0] == "v") {
+      parseVertex(tokens);
+    } else if (tokens[0] == "f") {
+      parseFace(tokens);
+    }
+  }
+
+  numTriangles = indices.size() / 3;
+}
+
+/**
+ * @brief Model::decode Decodes a compressed mesh, see meshcodec.h. Leaves the
+ * model empty if the data is invalid.
+ * @param data The encoded data.
+ * @param size Size of the data in bytes.
+ */
+void Model::decode(const char* data, qint64 size) {
+  size_t vertexCount, indexCount;
+  bool ok = meshcodec::readCounts(data, size, vertexCount, indexCount);
+  if (ok) {
+    coordsIndexed.resize(vertexCount);
+    indices.resize(indexCount);
+    ok = meshcodec::decode(data, size, coordsIndexed.data(), indices.data());
+  }
+  if (!ok) {
+    qWarning() << ":: Cannot decode compressed mesh";
+    coordsIndexed.clear();
+    indices.clear();
+  }
+
+  numTriangles = indices.size() / 3;
+  alreadyWelded = true;
+}
+
+/**
+ * @brief Model::readPly Reads the vertices and faces of binary PLY data, in
+ * either byte order. Other elements and properties are skipped. Leaves the
+ * model empty if the data is invalid.
+ * @param data The PLY file.
+ * @param size Size of the data in bytes.
+ */
+void Model::readPly(const char* data, qint64 size) {
+  PlyHeader header;
+  bool ok = parsePlyHeader(data, size, header);
+
+  const char* p = data + header.size;
+  const char* end = data + size;
+  for (const PlyElement& element : header.elements) {
+    if (!ok) break;
+    if (element.name == "vertex") {
+      ok = readPlyVertices(element, p, end, header.bigEndian, coordsIndexed);
+    } else if (element.name == "face") {
+      ok = readPlyFaces(element, p, end, header.bigEndian, indices);
+    } else {
+      ok = skipPlyElement(element, p, end, header.bigEndian);
+    }
+  }
+
+  // Every index must refer to a vertex
+  if (ok && !indices.isEmpty()) {
+    ok = *std::max_element(indices.cbegin(), indices.cend()) < unsigned(coordsIndexed.size());
+  }
+  if (!ok) {
+    qWarning() << ":: Cannot read PLY data (only binary PLY is supported)";
+    coordsIndexed.clear();
+    indices.clear();
+  }
+
+  numTriangles = indices.size() / 3;
+}
+
+/**
+ * @brief Model::readStl Reads binary STL data. Every triangle has its own
+ * three vertices, which alignData() welds. The facet normals are ignored.
+ * Leaves the model empty if the data is truncated.
+ * @param data The STL file.
+ * @param size Size of the data in bytes.
+ */
+void Model::readStl(const char* data, qint64 size) {
+  // An 80-byte header, the triangle count, and 50 bytes per triangle: the
+  // normal, three corners and a 16-bit attribute
+  quint32 count = size >= 84 ? qFromLittleEndian<quint32>(data + 80) : 0;
+  if (size < 84 || (size - 84) / 50 < count) {
+    qWarning() << ":: Cannot read STL data";
+    return;
+  }
+
+  coordsIndexed.resize(3 * qsizetype(count));
+  indices.resize(3 * qsizetype(count));
+  std::iota(indices.begin(), indices.end(), 0u);
+
+  QVector3D* out = coordsIndexed.data();
+  const char* triangle = data + 84;
+  for (quint32 t = 0; t < count; ++t, triangle += 50, out += 3) {
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    std::memcpy(out, triangle + 12, 3 * sizeof(QVector3D));
+#else
+    for (int i = 0; i < 9; ++i) {
+      quint32 bits = qFromLittleEndian<quint32>(triangle + 12 + 4 * i);
+      std::memcpy(&out[i / 3][i % 3], &bits, sizeof(float));
+    }
+#endif
+  }
 
-    // create an array version of the data
+  numTriangles = count;
+}
+
+/**
+ * @brief Model::finish Builds the requested representations from the parsed
+ * data.
+ * @param keep The representations to keep; the other one is never built or
+ * is released.
+ */
+void Model::finish(Representation keep) {
+  // create an array version of the data
+  if (keep & Unindexed) {
     unpackIndexes();
+  }
 
+  if (keep & Indexed) {
     // Allign all vertex indices with the right normal/texturecoord indices
-    alignData();
+    if (!alreadyWelded) {
+      alignData();
+    }
+  } else {
+    coordsIndexed = QVector<QVector3D>();
+    indices = QVector<unsigned>();
   }
 }
 
@@ -72,34 +623,31 @@ void Model::parseFace(const QStringList& tokens) {
  * if vertex has multiple normals or texturecoords.
  */
 void Model::alignData() {
+  // New index of every original vertex, assigned on first use
+  std::vector<unsigned> remap(coordsIndexed.size(), UINT_MAX);
+  std::unordered_map<PositionKey, unsigned, PositionKeyHash> welded;
+  welded.reserve(coordsIndexed.size());
+
   QVector<QVector3D> verts;
   verts.reserve(coordsIndexed.size());
 
-  QVector<unsigned> ind;
-  ind.reserve(indices.size());
-
-  unsigned currentIndex = 0;
-
-  for (int i = 0; i != indices.size(); ++i) {
-    QVector3D v = coordsIndexed[indices[i]];
-
-    if (verts.contains(v)) {
-      // Vertex already exists, use that index
-      ind.append(verts.indexOf(v));
-    } else {
-      // Create a new vertex
-      verts.append(v);
-      ind.append(currentIndex);
-      ++currentIndex;
+  for (unsigned& index : indices) {
+    unsigned& newIndex = remap[index];
+    if (newIndex == UINT_MAX) {
+      const QVector3D& v = coordsIndexed[index];
+      auto inserted = welded.emplace(PositionKey(v), verts.size());
+      if (inserted.second) {
+        // Create a new vertex
+        verts.append(v);
+      }
+      // Otherwise the vertex already exists, use that index
+      newIndex = inserted.first->second;
     }
+    index = newIndex;
   }
-  // Remove old data
-  coordsIndexed.clear();
-  indices.clear();
 
-  // Set the new data
-  coordsIndexed = verts;
-  indices = ind;
+  // Replace the old data; the indices were rewritten in place
+  coordsIndexed.swap(verts);
 }
 
 /**
@@ -108,6 +656,7 @@ void Model::alignData() {
  */
 void Model::unpackIndexes() {
   coords.clear();
+  coords.reserve(indices.size());
   for (int i = 0; i != indices.size(); ++i) {
     coords.append(coordsIndexed[indices[i]]);
   }
@@ -118,30 +667,41 @@ void Model::unpackIndexes() {
 /**
  * @brief Model::getCoords Returns the coordinates of the mesh. The coordinates
  * are ordered in such a way that they can be directly used in glDrawArrays.
- * I.e. it contains for every triangle, 3 coordinates.
- * @return A list of coordinates.
+ * I.e. it contains for every triangle, 3 coordinates. Empty unless the
+ * Unindexed representation was kept.
+ * @return A view of the coordinates, valid as long as the model.
  */
-QVector<QVector3D> Model::getMeshCoords() { return coords; }
+Span<const QVector3D> Model::getMeshCoords() const { return coords; }
 
 /**
  * @brief Model::getCoords Returns the unique coordinates of the mesh. These
  * coordinates do not fully describe the triangles in the mesh; only the
  * location of every vertex. I.e. it contains for every triangle, 3 coordinates.
  * Can be used in conjunction with getTriangleIndices if you want to use indexed
- * rendering (optional).
- * @return A list of unique coordinates.
+ * rendering (optional). Empty unless the Indexed representation was kept.
+ * @return A view of the unique coordinates, valid as long as the model.
  */
-QVector<QVector3D> Model::getCoords() { return coordsIndexed; }
+Span<const QVector3D> Model::getCoords() const { return coordsIndexed; }
 
 /**
  * @brief Model::getTriangleIndices Returns a list of indices that describe how
  * the vertices retrieved from getCoords make up the triangles in the mesh.
- * @return A list of indices.
+ * Empty unless the Indexed representation was kept.
+ * @return A view of the indices, valid as long as the model.
  */
-QVector<unsigned> Model::getTriangleIndices() { return indices; }
+Span<const unsigned> Model::getTriangleIndices() const { return indices; }
 
 /**
  * @brief Model::getNumTriangles Retrieves the number of triangles in this mesh.
  * @return The number of triangles in this mesh.
  */
-int Model::getNumTriangles() { return coords.size() / 3; }
+int Model::getNumTriangles() const { return numTriangles; }
+
+/**
+ * @brief Model::buildMeshlets Partitions the welded triangles into meshlets,
+ * each covering a contiguous range of getTriangleIndices().
+ * @return The meshlets of this mesh.
+ */
+std::vector<Meshlet> Model::buildMeshlets() const {
+  return Meshlet::build(getCoords(), getTriangleIndices());
+}
@@ -1,15 +1,23 @@
 #ifndef MODEL_H
 #define MODEL_H
 
+#include <QIODevice>
 #include <QString>
 #include <QStringList>
 #include <QVector2D>
 #include <QVector3D>
 #include <QVector>
 
+#include <vector>
+
+#include "meshlet.h"
+#include "span.h"
+
 /**
  * @brief A simple Model class. Represents a 3D triangle mesh and is able to
- * load this data from a Wavefront .obj file. IMPORTANT: Current only supports
+ * load this data from a Wavefront .obj file, a binary .ply or .stl file, or
+ * a compressed .cgmesh file written by meshpack (see meshcodec.h). The format
+ * is recognized by the first bytes. IMPORTANT: Current only supports
  * TRIANGLE meshes! It will only load in the coordinates; not the normals or
  * texture coordinates.
  *
@@ -18,17 +26,60 @@
  */
 class Model {
  public:
-  Model(const QString& filename);
+  // The representations a Model keeps after loading. Only keeping the one
+  // that is used saves memory for large meshes.
+  enum Representation {
+    Unindexed = 1,  // getMeshCoords()
+    Indexed = 2,    // getCoords() and getTriangleIndices()
+    Both = Unindexed | Indexed,
+  };
+
+  Model(const QString& filename, Representation keep = Both);
+  // Loads any of the formats above from an open device, e.g. a QBuffer with
+  // generated data
+  Model(QIODevice& device, Representation keep = Both);
+
+  // The formats above; detectFormat() recognizes them from the first bytes
+  // of an open device, without consuming them
+  enum Format { Obj, Compressed, Ply, Stl };
+  static Format detectFormat(QIODevice& device);
 
   // Can be used for glDrawArrays()
-  QVector<QVector3D> getMeshCoords();
+  Span<const QVector3D> getMeshCoords() const;
 
   // Can be used for glDrawElements()
-  QVector<QVector3D> getCoords();
-  QVector<unsigned> getTriangleIndices();
-  int getNumTriangles();
+  Span<const QVector3D> getCoords() const;
+  Span<const unsigned> getTriangleIndices() const;
+  int getNumTriangles() const;
+
+  // Clusters of the indexed triangles, see Meshlet. Requires the Indexed
+  // representation.
+  std::vector<Meshlet> buildMeshlets() const;
+
+  // Writes makeVertex(coordinate) for every corner of every triangle to out,
+  // in glDrawArrays() order. out must have room for getNumTriangles() * 3
+  // vertices and may be mapped buffer memory. Requires the Indexed
+  // representation.
+  template <typename VertexType, typename MakeVertex>
+  void buildMeshVertices(VertexType* out, MakeVertex makeVertex) const {
+    for (unsigned index : indices) {
+      *out++ = makeVertex(coordsIndexed[index]);
+    }
+  }
 
  private:
+  // The benchmark runs and times the loading stages one by one
+  friend class ModelBenchmark;
+  Model() = default;
+
+  // Loading stages
+  void load(QIODevice& device);
+  void parse(QIODevice& device);
+  void decode(const char* data, qint64 size);
+  void readPly(const char* data, qint64 size);
+  void readStl(const char* data, qint64 size);
+  void finish(Representation keep);
+
   // OBJ parsing
   void parseVertex(const QStringList& tokens);
   void parseFace(const QStringList& tokens);
@@ -42,6 +93,9 @@ class Model {
   QVector<unsigned> indices;
 
   QVector<QVector3D> coords;
+  int numTriangles = 0;
+  // Decoded meshes were welded before they were encoded
+  bool alreadyWelded = false;
 };
 
 #endif  // MODEL_H
@@ -0,0 +1,192 @@
+#include "renderscaler.h"
+
+#include <QDebug>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// The smoothed time must stay over the budget, or under this fraction of
+// it, for these many frames before the scale changes. Scaling up is slower,
+// because dropping frames is worse than a slightly blurry image.
+const float lowerBand = 0.7f;
+const int framesBeforeDown = 5;
+const int framesBeforeUp = 30;
+
+// Aim a bit under the budget, so small variations do not cross it again
+const float targetFraction = 0.85f;
+
+}  // namespace
+
+/**
+ * @brief RenderScaler::initializeGL Creates the timer queries and the
+ * offscreen framebuffer.
+ * @param resources Resources of the current context.
+ */
+void RenderScaler::initializeGL(GpuResources &resources) {
+  this->resources = &resources;
+  gl = resources.functions();
+  for (GpuHandle &query : queries) {
+    query = resources.createQuery(GpuResources::RenderTargets, "frame timer");
+  }
+  framebuffer = resources.createFramebuffer(GpuResources::RenderTargets, "scaled framebuffer");
+  colourBuffer = resources.createRenderbuffer(GpuResources::RenderTargets, "scaled colour");
+  depthBuffer = resources.createRenderbuffer(GpuResources::RenderTargets, "scaled depth");
+}
+
+/**
+ * @brief RenderScaler::releaseGL Deletes the queries and the framebuffer.
+ */
+void RenderScaler::releaseGL() {
+  if (!gl) return;
+  for (GpuHandle &query : queries) {
+    query.reset();
+  }
+  framebuffer.reset();
+  colourBuffer.reset();
+  depthBuffer.reset();
+  bufferSize = QSize();
+  gl = nullptr;
+}
+
+/**
+ * @brief RenderScaler::resize Reallocates the offscreen framebuffer. It is
+ * only resized with the widget; lower scales render into a part of it.
+ * @param size The full size.
+ */
+void RenderScaler::resize(const QSize &size) {
+  bufferSize = size;
+  resources->renderbufferStorage(colourBuffer, GL_RGBA8, size.width(), size.height());
+  resources->renderbufferStorage(depthBuffer, GL_DEPTH_COMPONENT24, size.width(), size.height());
+
+  GLint bound = 0;
+  gl->glGetIntegerv(GL_FRAMEBUFFER_BINDING, &bound);
+  gl->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.id());
+  gl->glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colourBuffer.id());
+  gl->glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer.id());
+  if (gl->glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    qWarning() << "Render scale framebuffer is incomplete, scaling disabled";
+    enabled = false;
+  }
+  gl->glBindFramebuffer(GL_FRAMEBUFFER, bound);
+}
+
+/**
+ * @brief RenderScaler::begin Starts a frame: starts its timer query and, if
+ * scaling, redirects rendering to the offscreen framebuffer.
+ * @param outputSize Size of the final image in pixels.
+ * @param scaled Whether to render at the current scale. Without it the
+ * frame goes to the bound framebuffer as usual and is only timed.
+ * @return The size the frame is rendered at.
+ */
+QSize RenderScaler::begin(const QSize &outputSize, bool scaled) {
+  if (!gl) return outputSize;
+
+  // All queries still in flight means the GPU is far behind; skip timing
+  timing = !queryPending[nextQuery];
+  if (timing) {
+    gl->glBeginQuery(GL_TIME_ELAPSED, queries[nextQuery].id());
+  }
+
+  frameScaled = scaled && enabled && budgetMilliseconds > 0;
+  if (!frameScaled) {
+    currentScale = 1.0f;
+    return outputSize;
+  }
+
+  if (outputSize != bufferSize) {
+    resize(outputSize);
+    if (!enabled) {
+      frameScaled = false;
+      return outputSize;
+    }
+  }
+  renderSize = QSize(std::max(1, int(std::lround(outputSize.width() * currentScale))),
+                     std::max(1, int(std::lround(outputSize.height() * currentScale))));
+  gl->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.id());
+  gl->glViewport(0, 0, renderSize.width(), renderSize.height());
+  return renderSize;
+}
+
+/**
+ * @brief RenderScaler::end Ends the frame: stretches the scaled image over
+ * the target, collects finished timer queries and adapts the scale.
+ * @param target The framebuffer the frame is shown in, bound afterwards.
+ */
+void RenderScaler::end(GLuint target) {
+  if (!gl) return;
+
+  if (timing) {
+    gl->glEndQuery(GL_TIME_ELAPSED);
+    queryPending[nextQuery] = true;
+    nextQuery = (nextQuery + 1) % queryCount;
+  }
+
+  if (frameScaled) {
+    gl->glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer.id());
+    gl->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+    gl->glBlitFramebuffer(0, 0, renderSize.width(), renderSize.height(), 0, 0,
+                          bufferSize.width(), bufferSize.height(), GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    gl->glBindFramebuffer(GL_FRAMEBUFFER, target);
+    gl->glViewport(0, 0, bufferSize.width(), bufferSize.height());
+  }
+
+  readQueries();
+}
+
+/**
+ * @brief RenderScaler::readQueries Reads the timer queries whose result is
+ * available, oldest first, without waiting for the others.
+ */
+void RenderScaler::readQueries() {
+  for (int n = 0; n < queryCount; n++) {
+    int query = (nextQuery + n) % queryCount;
+    if (!queryPending[query]) continue;
+
+    GLuint available = GL_FALSE;
+    gl->glGetQueryObjectuiv(queries[query].id(), GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) break;
+
+    GLuint64 nanoseconds = 0;
+    gl->glGetQueryObjectui64v(queries[query].id(), GL_QUERY_RESULT, &nanoseconds);
+    queryPending[query] = false;
+    adapt(nanoseconds / 1e6);
+  }
+}
+
+/**
+ * @brief RenderScaler::adapt Feeds one GPU time into the smoothed time, and
+ * changes the scale if it has been outside its band for long enough.
+ * Rendering time is taken to be proportional to the number of pixels.
+ * @param milliseconds GPU time of a frame.
+ */
+void RenderScaler::adapt(double milliseconds) {
+  if (settleFrames > 0) {
+    // Still measured at the previous scale
+    settleFrames--;
+    return;
+  }
+  smoothedMilliseconds = smoothedMilliseconds == 0 ? milliseconds
+                                                   : 0.8 * smoothedMilliseconds + 0.2 * milliseconds;
+  if (!frameScaled) return;
+
+  framesOver = smoothedMilliseconds > budgetMilliseconds ? framesOver + 1 : 0;
+  framesUnder = smoothedMilliseconds < lowerBand * budgetMilliseconds && currentScale < 1
+                    ? framesUnder + 1
+                    : 0;
+  if (framesOver < framesBeforeDown && framesUnder < framesBeforeUp) return;
+
+  float target = currentScale * std::sqrt(targetFraction * budgetMilliseconds / smoothedMilliseconds);
+  // Limit the steps, and round them so tiny changes are ignored
+  target = std::clamp(target, currentScale * 0.7f, currentScale * 1.15f);
+  target = std::clamp(std::round(target * 32) / 32, minimumScale, 1.0f);
+  framesOver = framesUnder = 0;
+  if (target == currentScale) return;
+
+  qDebug() << ":: Render scale" << currentScale << "->" << target << "at"
+           << smoothedMilliseconds << "ms";
+  currentScale = target;
+  smoothedMilliseconds = 0;
+  settleFrames = queryCount;
+}
@@ -0,0 +1,70 @@
+#ifndef RENDERSCALER_H
+#define RENDERSCALER_H
+
+#include <QOpenGLFunctions_3_3_Core>
+#include <QSize>
+
+#include "gpuresources.h"
+
+/**
+ * @brief The RenderScaler class holds a GPU frame-time budget by rendering
+ * the scene at a lower resolution when it gets too heavy.
+ *
+ * The scene is drawn into the lower left part of an offscreen framebuffer
+ * the size of the widget, and that part is stretched over the widget with a
+ * linearly filtered blit. The GPU time of every frame is measured with a
+ * timer query that is read back a few frames later, without waiting. The
+ * scale only changes after the smoothed time has been out of its band for a
+ * number of frames, and not again until the new scale shows in the
+ * measurements, so it does not oscillate.
+ */
+class RenderScaler {
+ public:
+  // Requires a current context
+  void initializeGL(GpuResources &resources);
+  void releaseGL();
+
+  // Times the frame and, if scaled, binds the offscreen framebuffer and sets
+  // the viewport to the scaled size of outputSize; returns that size
+  QSize begin(const QSize &outputSize, bool scaled);
+  // Stretches the rendered part over the framebuffer target, which is bound
+  // afterwards, and adapts the scale to the measured GPU time
+  void end(GLuint target);
+
+  float scale() const { return currentScale; }
+  // Smoothed GPU time of the scene, or 0 before the first measurement
+  double gpuMilliseconds() const { return smoothedMilliseconds; }
+
+  bool enabled = true;
+  // The GPU time per frame to stay under; 0 disables scaling
+  float budgetMilliseconds = 16.0f;
+  float minimumScale = 0.5f;
+
+ private:
+  void resize(const QSize &size);
+  void readQueries();
+  void adapt(double milliseconds);
+
+  QOpenGLFunctions_3_3_Core *gl = nullptr;
+  GpuResources *resources = nullptr;
+  GpuHandle framebuffer;
+  GpuHandle colourBuffer;
+  GpuHandle depthBuffer;
+  QSize bufferSize;
+  QSize renderSize;
+
+  static const int queryCount = 4;
+  GpuHandle queries[queryCount];
+  bool queryPending[queryCount] = {};
+  int nextQuery = 0;
+  bool timing = false;       // the current frame has a query
+  bool frameScaled = false;  // the current frame renders offscreen
+
+  float currentScale = 1.0f;
+  double smoothedMilliseconds = 0;
+  int framesOver = 0;
+  int framesUnder = 0;
+  int settleFrames = 0;  // measurements to skip after a change
+};
+
+#endif  // RENDERSCALER_H
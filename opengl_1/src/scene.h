@@ -0,0 +1,67 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <qopengl.h>
+
+#include <vector>
+
+#include "bounds.h"
+#include "gpuresources.h"
+#include "meshlet.h"
+
+/**
+ * @brief The Scene struct holds the meshes and the objects that instance them.
+ *
+ * Each mesh owns its vao, vbo and ebo (the ebo stays empty for glDrawArrays()
+ * meshes) and has its own vertex and index count, bounds,
+ * shader features and meshlets (empty unless the mesh is indexed),
+ * and each object its own mesh index, position and transformation matrix.
+ * Like before, a mesh or object is represented by the same index across all
+ * of its vectors, which makes it trivial to add more of them.
+ */
+struct Scene {
+    // Per mesh
+    std::vector<GpuHandle> vbos;
+    std::vector<GpuHandle> vaos;
+    std::vector<GpuHandle> ebos;
+    std::vector<int> vertexCounts;
+    std::vector<int> indexCounts;  // 0 for glDrawArrays() meshes
+    std::vector<Bounds> bounds;
+    std::vector<unsigned> shaderFeatures;
+    std::vector<std::vector<Meshlet>> meshlets;
+
+    // Per object
+    std::vector<int> meshes;
+    std::vector<QVector3D> positions;
+    std::vector<QMatrix4x4> transformations;  // updated every frame
+
+    // Shared by all objects, set from the widgets
+    QVector3D rotation;
+    float scale = 1;
+
+    int meshCount() const { return vaos.size(); }
+    int objectCount() const { return meshes.size(); }
+
+    int addMesh() {
+        vbos.emplace_back();
+        vaos.emplace_back();
+        ebos.emplace_back();
+        vertexCounts.push_back(0);
+        indexCounts.push_back(0);
+        bounds.push_back(Bounds());
+        shaderFeatures.push_back(0);
+        meshlets.emplace_back();
+        return meshCount() - 1;
+    }
+
+    int addObject(int mesh, const QVector3D &position) {
+        meshes.push_back(mesh);
+        positions.push_back(position);
+        transformations.push_back(QMatrix4x4());
+        return objectCount() - 1;
+    }
+};
+
+#endif // SCENE_H
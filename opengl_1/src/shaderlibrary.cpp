@@ -0,0 +1,186 @@
+#include "shaderlibrary.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+
+namespace {
+// Must match SHADER_FEATURES in CMakeLists.txt
+const char *const featureNames[ShaderFeatureCount] = {
+    "LIGHTING", "VERTEX_COLOUR", "INSTANCING", "QUANTIZED_INPUT", "CLUSTERED_LIGHTING"};
+}  // namespace
+
+/**
+ * @brief ShaderLibrary::ShaderLibrary Constructs an empty library. Programs
+ * are only linked when they are first requested.
+ * @param parent Parent object.
+ */
+ShaderLibrary::ShaderLibrary(QObject *parent) : QObject(parent) {
+  connect(&watcher, SIGNAL(fileChanged(QString)), this,
+          SLOT(onFileChanged(QString)));
+}
+
+/**
+ * @brief ShaderLibrary::setSourceDirectory Switches to development mode:
+ * variants are composed from the sources in dir and those are watched for
+ * changes.
+ * @param dir Directory containing vertshader.glsl and fragshader.glsl.
+ */
+void ShaderLibrary::setSourceDirectory(const QString &dir) {
+  sourceDir = dir;
+  if (!watcher.files().isEmpty()) {
+    watcher.removePaths(watcher.files());
+  }
+  if (!dir.isEmpty()) {
+    QDir sources(dir);
+    watcher.addPath(sources.filePath("vertshader.glsl"));
+    watcher.addPath(sources.filePath("fragshader.glsl"));
+  }
+}
+
+/**
+ * @brief ShaderLibrary::setResources Accounts for the programs linked from
+ * now on in resources, which must outlive them.
+ * @param gpuResources Resources of the context the programs are linked in.
+ */
+void ShaderLibrary::setResources(GpuResources *gpuResources) {
+  resources = gpuResources;
+}
+
+/**
+ * @brief ShaderLibrary::program Returns the program for a feature mask,
+ * linking it on first use.
+ * @param features Combination of ShaderFeature bits.
+ * @return The linked program, or nullptr if it failed to link. A failed
+ * variant is remembered and not built again until reload().
+ */
+QOpenGLShaderProgram *ShaderLibrary::program(unsigned features) {
+  Q_ASSERT(features < ShaderVariantCount);
+  std::unique_ptr<QOpenGLShaderProgram> &slot = programs[features];
+  if (!slot && !failed[features]) {
+    slot = build(features);
+    failed[features] = !slot;
+    track(features);
+  }
+  return slot.get();
+}
+
+/**
+ * @brief ShaderLibrary::reload Re-links every variant that is in use or
+ * failed to build before. A variant that fails to compile keeps its previous
+ * program, if it had one.
+ *
+ * This runs synchronously on the calling thread, with its context current.
+ */
+void ShaderLibrary::reload() {
+  for (unsigned features = 0; features < ShaderVariantCount; ++features) {
+    if (!programs[features] && !failed[features]) continue;
+    std::unique_ptr<QOpenGLShaderProgram> program = build(features);
+    if (program) {
+      programs[features] = std::move(program);
+      track(features);
+    }
+    failed[features] = !programs[features];
+  }
+}
+
+/**
+ * @brief ShaderLibrary::releaseGL Deletes all programs while their context
+ * is current.
+ */
+void ShaderLibrary::releaseGL() {
+  for (unsigned features = 0; features < ShaderVariantCount; ++features) {
+    programUsage[features].reset();
+    programs[features].reset();
+    failed[features] = false;
+  }
+}
+
+/**
+ * @brief ShaderLibrary::track Accounts for the program of a variant, in
+ * place of its previous one.
+ * @param features Combination of ShaderFeature bits.
+ */
+void ShaderLibrary::track(unsigned features) {
+  programUsage[features].reset();
+  if (resources && programs[features]) {
+    programUsage[features] = resources->trackProgram(
+        programs[features]->programId(), QString("shader variant %1").arg(features));
+  }
+}
+
+/**
+ * @brief ShaderLibrary::build Compiles and links a single variant.
+ *
+ * The shaders are added through the cacheable API, so the linked program
+ * binary (glGetProgramBinary) is stored in the disk cache keyed by a hash of
+ * the sources and the GL renderer/version string. Subsequent launches load
+ * the binary and only fall back to compiling on a cache miss.
+ *
+ * @param features Combination of ShaderFeature bits.
+ * @return The linked program, or nullptr if linking failed.
+ */
+std::unique_ptr<QOpenGLShaderProgram> ShaderLibrary::build(unsigned features) {
+  auto program = std::make_unique<QOpenGLShaderProgram>();
+
+  if (sourceDir.isEmpty()) {
+    QString prefix = QString(":/shaders/variants/variant_%1").arg(features);
+    program->addCacheableShaderFromSourceFile(QOpenGLShader::Vertex,
+                                              prefix + ".vert");
+    program->addCacheableShaderFromSourceFile(QOpenGLShader::Fragment,
+                                              prefix + ".frag");
+  } else {
+    program->addCacheableShaderFromSourceCode(
+        QOpenGLShader::Vertex, composeSource("vertshader.glsl", features));
+    program->addCacheableShaderFromSourceCode(
+        QOpenGLShader::Fragment, composeSource("fragshader.glsl", features));
+  }
+
+  if (!program->link()) {
+    qWarning() << ":: Shader variant" << features
+               << "failed to link:" << program->log();
+    return nullptr;
+  }
+  return program;
+}
+
+/**
+ * @brief ShaderLibrary::composeSource Inserts the feature defines after the
+ * #version line, the same way genvariants.cmake does at build time.
+ * @param filename Shader source in the source directory.
+ * @param features Combination of ShaderFeature bits.
+ * @return The variant source.
+ */
+QString ShaderLibrary::composeSource(const QString &filename,
+                                     unsigned features) {
+  QFile file(QDir(sourceDir).filePath(filename));
+  if (!file.open(QIODevice::ReadOnly)) {
+    qWarning() << ":: Cannot open shader" << file.fileName();
+    return QString();
+  }
+  QString source = QString::fromUtf8(file.readAll());
+
+  QString defines;
+  for (unsigned bit = 0; bit < ShaderFeatureCount; ++bit) {
+    if (features & (1u << bit)) {
+      defines += QString("#define %1 1\n").arg(featureNames[bit]);
+    }
+  }
+
+  int versionEnd = source.indexOf('\n') + 1;
+  source.insert(versionEnd, defines);
+  return source;
+}
+
+/**
+ * @brief ShaderLibrary::onFileChanged Called when a watched source changed.
+ * @param path The file that changed.
+ */
+void ShaderLibrary::onFileChanged(const QString &path) {
+  // Editors often save by replacing the file, which drops it from the watcher.
+  if (!watcher.files().contains(path) && QFile::exists(path)) {
+    watcher.addPath(path);
+  }
+  qDebug() << ":: Shader source changed:" << path;
+  emit sourcesChanged();
+}
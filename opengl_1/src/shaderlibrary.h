@@ -0,0 +1,79 @@
+#ifndef SHADERLIBRARY_H
+#define SHADERLIBRARY_H
+
+#include <QFileSystemWatcher>
+#include <QObject>
+#include <QOpenGLShaderProgram>
+#include <QString>
+
+#include <array>
+#include <memory>
+
+#include "gpuresources.h"
+
+/**
+ * @brief Feature bits selecting a shader variant. The order must match
+ * SHADER_FEATURES in CMakeLists.txt.
+ */
+enum ShaderFeature : unsigned {
+  Lighting = 1u << 0,
+  VertexColour = 1u << 1,
+  Instancing = 1u << 2,
+  QuantizedInput = 1u << 3,
+  ClusteredLighting = 1u << 4,
+};
+
+constexpr unsigned ShaderFeatureCount = 5;
+constexpr unsigned ShaderVariantCount = 1u << ShaderFeatureCount;
+
+/**
+ * @brief The ShaderLibrary class hands out one linked program per feature mask.
+ *
+ * The variants are generated at build time and linked lazily on first use.
+ * When a source directory is set (development mode), the variants are
+ * composed from the sources at runtime instead, and re-linked whenever those
+ * are saved. The re-link is synchronous on the GUI thread, so the frame after
+ * a save stalls for as long as the used variants take to compile.
+ */
+class ShaderLibrary : public QObject {
+  Q_OBJECT
+
+ public:
+  explicit ShaderLibrary(QObject *parent = nullptr);
+
+  void setSourceDirectory(const QString &dir);
+  // Accounts for the linked programs in resources, if set
+  void setResources(GpuResources *resources);
+
+  // Requires a current OpenGL context. Returns nullptr for a variant that
+  // failed to build, without trying again until reload().
+  QOpenGLShaderProgram *program(unsigned features);
+  void reload();
+  // Deletes all programs; they are linked again when requested
+  void releaseGL();
+
+ signals:
+  // Emitted when a shader source changed on disk; call reload() with the
+  // context current to pick up the change.
+  void sourcesChanged();
+
+ private slots:
+  void onFileChanged(const QString &path);
+
+ private:
+  std::unique_ptr<QOpenGLShaderProgram> build(unsigned features);
+  void track(unsigned features);
+  QString composeSource(const QString &filename, unsigned features);
+
+  std::array<std::unique_ptr<QOpenGLShaderProgram>, ShaderVariantCount>
+      programs;
+  std::array<GpuHandle, ShaderVariantCount> programUsage;
+  // Variants that failed to build; not retried until reload()
+  std::array<bool, ShaderVariantCount> failed{};
+  GpuResources *resources = nullptr;
+
+  QString sourceDir;
+  QFileSystemWatcher watcher;
+};
+
+#endif  // SHADERLIBRARY_H
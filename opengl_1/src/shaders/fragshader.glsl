@@ -3,17 +3,77 @@
 // Define constants
 #define M_PI 3.141593
 
+// Feature bits are prepended by the build, see vertshader.glsl.
+
 // Specify the inputs to the fragment shader
 // These must have the same type and name!
 in vec3 vertColor;
+#if defined(LIGHTING) || defined(CLUSTERED_LIGHTING)
+in vec3 vertPosition;
+#endif
 
 // Specify the Uniforms of the fragment shaders
-// uniform vec3 lightPosition; // for example
+#ifdef LIGHTING
+uniform vec3 lightPosition;
+#endif
+#ifdef CLUSTERED_LIGHTING
+// Two texels per point light: eye-space position and radius, then colour
+uniform samplerBuffer lights;
+// Offset and count in lightIndices per cluster, see LightGrid
+uniform usamplerBuffer lightClusters;
+uniform usamplerBuffer lightIndices;
+uniform vec2 clusterTileScale;  // tiles per pixel
+uniform int clusterTilesX;
+uniform int clusterTilesY;
+uniform int clusterSlices;
+uniform float clusterSliceScale;
+uniform float clusterSliceBias;
+#endif
 
 // Specify the output of the fragment shader
 // Usually a vec4 describing a color (Red, Green, Blue, Alpha/Transparency)
 out vec4 fColor;
 
+#ifdef CLUSTERED_LIGHTING
+// Sums the point lights of the cluster this fragment lies in
+vec3 clusteredLight(vec3 normal) {
+  ivec2 tile = min(ivec2(gl_FragCoord.xy * clusterTileScale),
+                   ivec2(clusterTilesX - 1, clusterTilesY - 1));
+  int slice = clamp(int(log(-vertPosition.z) * clusterSliceScale + clusterSliceBias), 0,
+                    clusterSlices - 1);
+  uvec2 cluster = texelFetch(lightClusters, tile.x + clusterTilesX * (tile.y + clusterTilesY * slice)).xy;
+
+  vec3 light = vec3(0.0F);
+  for (uint i = 0u; i < cluster.y; i++) {
+    int index = int(texelFetch(lightIndices, int(cluster.x + i)).x);
+    vec4 positionRadius = texelFetch(lights, 2 * index);
+    vec3 toLight = positionRadius.xyz - vertPosition;
+    float distance = length(toLight);
+    // Falls off smoothly to zero at the radius
+    float falloff = clamp(1.0F - distance / positionRadius.w, 0.0F, 1.0F);
+    light += texelFetch(lights, 2 * index + 1).rgb * falloff * falloff *
+             max(dot(normal, toLight / distance), 0.0F);
+  }
+  return light;
+}
+#endif
+
 void main() {
-  fColor = vec4(vertColor, 1.0F);
+  vec3 color = vertColor;
+#if defined(LIGHTING) || defined(CLUSTERED_LIGHTING)
+  // Flat normal from the screen-space derivatives of the eye-space position
+  vec3 normal = normalize(cross(dFdx(vertPosition), dFdy(vertPosition)));
+  vec3 light = vec3(0.2F);
+#endif
+#ifdef LIGHTING
+  vec3 lightDirection = normalize(lightPosition - vertPosition);
+  light += 0.8F * max(dot(normal, lightDirection), 0.0F);
+#endif
+#ifdef CLUSTERED_LIGHTING
+  light += clusteredLight(normal);
+#endif
+#if defined(LIGHTING) || defined(CLUSTERED_LIGHTING)
+  color *= light;
+#endif
+  fColor = vec4(color, 1.0F);
 }
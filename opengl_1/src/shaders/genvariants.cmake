@@ -0,0 +1,47 @@
+# Generates every permutation of the shader feature bits.
+#
+# Invoked at build time with cmake -P and the following variables:
+#   SOURCE_DIR  directory containing vertshader.glsl and fragshader.glsl
+#   OUTPUT_DIR  directory the variants are written to
+#   FEATURES    comma-separated feature names, bit 0 first
+#
+# For a feature mask N this writes variant_N.vert and variant_N.frag, which are
+# the sources with a #define for every set bit inserted after the #version line.
+
+string(REPLACE "," ";" FEATURES "${FEATURES}")
+list(LENGTH FEATURES featureCount)
+math(EXPR variantCount "(1 << ${featureCount}) - 1")
+
+file(MAKE_DIRECTORY "${OUTPUT_DIR}")
+
+foreach(stage vert frag)
+  file(READ "${SOURCE_DIR}/${stage}shader.glsl" source)
+  string(FIND "${source}" "\n" versionEnd)
+  string(SUBSTRING "${source}" 0 ${versionEnd} versionLine)
+  math(EXPR bodyStart "${versionEnd} + 1")
+  string(SUBSTRING "${source}" ${bodyStart} -1 body)
+
+  foreach(mask RANGE 0 ${variantCount})
+    set(defines "")
+    set(bit 0)
+    foreach(feature ${FEATURES})
+      math(EXPR enabled "(${mask} >> ${bit}) & 1")
+      if(enabled)
+        string(APPEND defines "#define ${feature} 1\n")
+      endif()
+      math(EXPR bit "${bit} + 1")
+    endforeach()
+
+    set(output "${OUTPUT_DIR}/variant_${mask}.${stage}")
+    set(content "${versionLine}\n${defines}${body}")
+    # Only touch files that changed so rcc does not rerun needlessly
+    if(EXISTS "${output}")
+      file(READ "${output}" previous)
+    else()
+      set(previous "")
+    endif()
+    if(NOT previous STREQUAL content)
+      file(WRITE "${output}" "${content}")
+    endif()
+  endforeach()
+endforeach()
@@ -3,22 +3,66 @@
 // Define constants
 #define M_PI 3.141593
 
+// The build prepends a #define for every enabled feature bit right after the
+// #version line (see genvariants.cmake). Available features:
+//   LIGHTING         pass the eye-space position on for diffuse lighting
+//   VERTEX_COLOUR    read a colour attribute instead of the objectColor uniform
+//   INSTANCING       read the model transform from a per-instance attribute
+//   QUANTIZED_INPUT  positions are normalized integers inside the mesh bounds
+//   CLUSTERED_LIGHTING  light with the point lights of the fragment's cluster
+
 // Specify the input locations of attributes
 layout(location = 0) in vec3 vertCoordinates_in;
+#ifdef VERTEX_COLOUR
 layout(location = 1) in vec3 vertColor_in;
+#endif
+#ifdef INSTANCING
+layout(location = 2) in mat4 instanceTransform;  // occupies locations 2-5
+#endif
 
 // Specify the Uniforms of the vertex shader
-// uniform mat4 modelTransform; for example
+#ifndef INSTANCING
 uniform mat4 modelTransform;
+#endif
 uniform mat4 projectionTransform;
+#ifndef VERTEX_COLOUR
+uniform vec3 objectColor;
+#endif
+#ifdef QUANTIZED_INPUT
+uniform vec3 quantizationScale;
+uniform vec3 quantizationOffset;
+#endif
 
 // Specify the output of the vertex stage
+// Depth must match bit for bit between the depth pre-pass and the shading
+// pass, which use different variants.
+invariant gl_Position;
 out vec3 vertColor;
+#if defined(LIGHTING) || defined(CLUSTERED_LIGHTING)
+out vec3 vertPosition;
+#endif
 
 void main() {
+  vec3 position = vertCoordinates_in;
+#ifdef QUANTIZED_INPUT
+  position = position * quantizationScale + quantizationOffset;
+#endif
+
+#ifdef INSTANCING
+  vec4 eyePosition = instanceTransform * vec4(position, 1.0F);
+#else
+  vec4 eyePosition = modelTransform * vec4(position, 1.0F);
+#endif
+
   // gl_Position is the output (a vec4) of the vertex shader
-  // Currently without any transformation
-  gl_Position = projectionTransform * modelTransform * vec4(vertCoordinates_in, 1.0F);
-  vertColor = vertColor_in;
+  gl_Position = projectionTransform * eyePosition;
 
+#ifdef VERTEX_COLOUR
+  vertColor = vertColor_in;
+#else
+  vertColor = objectColor;
+#endif
+#if defined(LIGHTING) || defined(CLUSTERED_LIGHTING)
+  vertPosition = eyePosition.xyz;
+#endif
 }
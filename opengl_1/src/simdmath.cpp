@@ -0,0 +1,495 @@
+#include "simdmath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#define AVX2_TARGET __attribute__((target("avx2,fma")))
+#endif
+
+/**
+ * @brief PositionsSoA::fromInterleaved Splits packed xyz triples into the
+ * component arrays.
+ * @param xyz 3 * n floats.
+ * @param n Number of positions.
+ */
+void PositionsSoA::fromInterleaved(const float *xyz, size_t n) {
+  resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    x[i] = xyz[3 * i];
+    y[i] = xyz[3 * i + 1];
+    z[i] = xyz[3 * i + 2];
+  }
+}
+
+/**
+ * @brief PositionsSoA::toInterleaved Writes the positions as packed xyz
+ * triples.
+ * @param xyz Destination with room for 3 * size() floats.
+ */
+void PositionsSoA::toInterleaved(float *xyz) const {
+  for (size_t i = 0; i < size(); ++i) {
+    xyz[3 * i] = x[i];
+    xyz[3 * i + 1] = y[i];
+    xyz[3 * i + 2] = z[i];
+  }
+}
+
+namespace {
+
+// --- Scalar
+
+void boundsScalar(const PositionsSoA &p, size_t begin, float min[3], float max[3]) {
+  const float *components[3] = {p.x.data(), p.y.data(), p.z.data()};
+  for (int axis = 0; axis < 3; ++axis) {
+    for (size_t i = begin; i < p.size(); ++i) {
+      min[axis] = std::min(min[axis], components[axis][i]);
+      max[axis] = std::max(max[axis], components[axis][i]);
+    }
+  }
+}
+
+void colouredVerticesScalar(const PositionsSoA &p, size_t begin, float *out) {
+  for (size_t i = begin; i < p.size(); ++i) {
+    float *o = out + 6 * i;
+    o[0] = p.x[i];
+    o[1] = p.y[i];
+    o[2] = p.z[i];
+    o[3] = std::fabs(p.x[i]);
+    o[4] = std::fabs(p.y[i]);
+    o[5] = std::fabs(p.z[i]);
+  }
+}
+
+void transformScalar(const float m[16], const PositionsSoA &p, size_t begin, PositionsSoA &out) {
+  for (size_t i = begin; i < p.size(); ++i) {
+    float x = p.x[i], y = p.y[i], z = p.z[i];
+    out.x[i] = m[0] * x + m[4] * y + m[8] * z + m[12];
+    out.y[i] = m[1] * x + m[5] * y + m[9] * z + m[13];
+    out.z[i] = m[2] * x + m[6] * y + m[10] * z + m[14];
+  }
+}
+
+void faceNormalsScalar(const PositionsSoA &p, const unsigned *indices, size_t begin,
+                       size_t triangleCount, PositionsSoA &normals) {
+  for (size_t t = begin; t < triangleCount; ++t) {
+    unsigned a = indices[3 * t], b = indices[3 * t + 1], c = indices[3 * t + 2];
+    float e1x = p.x[b] - p.x[a], e1y = p.y[b] - p.y[a], e1z = p.z[b] - p.z[a];
+    float e2x = p.x[c] - p.x[a], e2y = p.y[c] - p.y[a], e2z = p.z[c] - p.z[a];
+    // The length of the cross product is twice the area: area weighting
+    float nx = e1y * e2z - e1z * e2y;
+    float ny = e1z * e2x - e1x * e2z;
+    float nz = e1x * e2y - e1y * e2x;
+    for (unsigned v : {a, b, c}) {
+      normals.x[v] += nx;
+      normals.y[v] += ny;
+      normals.z[v] += nz;
+    }
+  }
+}
+
+void normalizeScalar(PositionsSoA &v, size_t begin) {
+  for (size_t i = begin; i < v.size(); ++i) {
+    float length = std::sqrt(v.x[i] * v.x[i] + v.y[i] * v.y[i] + v.z[i] * v.z[i]);
+    float inverse = 1 / std::max(length, 1e-30f);
+    v.x[i] *= inverse;
+    v.y[i] *= inverse;
+    v.z[i] *= inverse;
+  }
+}
+
+#ifdef SIMD_X86
+
+// --- SSE2 (always available on x86-64)
+
+float horizontalMin(__m128 v) {
+  alignas(16) float f[4];
+  _mm_store_ps(f, v);
+  return std::min(std::min(f[0], f[1]), std::min(f[2], f[3]));
+}
+
+float horizontalMax(__m128 v) {
+  alignas(16) float f[4];
+  _mm_store_ps(f, v);
+  return std::max(std::max(f[0], f[1]), std::max(f[2], f[3]));
+}
+
+void boundsSse(const PositionsSoA &p, float min[3], float max[3]) {
+  const float *components[3] = {p.x.data(), p.y.data(), p.z.data()};
+  size_t n = p.size() & ~size_t(3);
+  for (int axis = 0; axis < 3; ++axis) {
+    __m128 lo = _mm_set1_ps(min[axis]);
+    __m128 hi = _mm_set1_ps(max[axis]);
+    for (size_t i = 0; i < n; i += 4) {
+      __m128 v = _mm_loadu_ps(components[axis] + i);
+      lo = _mm_min_ps(lo, v);
+      hi = _mm_max_ps(hi, v);
+    }
+    min[axis] = horizontalMin(lo);
+    max[axis] = horizontalMax(hi);
+  }
+  boundsScalar(p, n, min, max);
+}
+
+// Writes 4 interleaved coloured vertices from 4 positions per component
+inline void storeColoured4(float *o, __m128 x, __m128 y, __m128 z) {
+  const __m128 signMask = _mm_set1_ps(-0.0f);
+  __m128 r0 = x, r1 = y, r2 = z, r3 = _mm_andnot_ps(signMask, x);
+  __m128 ay = _mm_andnot_ps(signMask, y);
+  __m128 az = _mm_andnot_ps(signMask, z);
+
+  // r_i becomes {x_i, y_i, z_i, |x_i|}, followed by {|y_i|, |z_i|}
+  _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+  __m128 lo = _mm_unpacklo_ps(ay, az);
+  __m128 hi = _mm_unpackhi_ps(ay, az);
+
+  _mm_storeu_ps(o, r0);
+  _mm_storel_pi(reinterpret_cast<__m64 *>(o + 4), lo);
+  _mm_storeu_ps(o + 6, r1);
+  _mm_storeh_pi(reinterpret_cast<__m64 *>(o + 10), lo);
+  _mm_storeu_ps(o + 12, r2);
+  _mm_storel_pi(reinterpret_cast<__m64 *>(o + 16), hi);
+  _mm_storeu_ps(o + 18, r3);
+  _mm_storeh_pi(reinterpret_cast<__m64 *>(o + 22), hi);
+}
+
+void colouredVerticesSse(const PositionsSoA &p, float *out) {
+  size_t n = p.size() & ~size_t(3);
+  for (size_t i = 0; i < n; i += 4) {
+    storeColoured4(out + 6 * i, _mm_loadu_ps(&p.x[i]), _mm_loadu_ps(&p.y[i]),
+                   _mm_loadu_ps(&p.z[i]));
+  }
+  colouredVerticesScalar(p, n, out);
+}
+
+void transformSse(const float m[16], const PositionsSoA &p, PositionsSoA &out) {
+  size_t n = p.size() & ~size_t(3);
+  __m128 c[16];
+  for (int k = 0; k < 16; ++k) c[k] = _mm_set1_ps(m[k]);
+
+  for (size_t i = 0; i < n; i += 4) {
+    __m128 x = _mm_loadu_ps(&p.x[i]);
+    __m128 y = _mm_loadu_ps(&p.y[i]);
+    __m128 z = _mm_loadu_ps(&p.z[i]);
+    for (int row = 0; row < 3; ++row) {
+      __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c[row], x), _mm_mul_ps(c[4 + row], y)),
+                            _mm_add_ps(_mm_mul_ps(c[8 + row], z), c[12 + row]));
+      float *dst = row == 0 ? &out.x[i] : row == 1 ? &out.y[i] : &out.z[i];
+      _mm_storeu_ps(dst, r);
+    }
+  }
+  transformScalar(m, p, n, out);
+}
+
+// Scatters the face normals of a batch of triangles to their vertices
+inline void scatterNormals(const unsigned *indices, size_t first, size_t count,
+                           const float *nx, const float *ny, const float *nz,
+                           PositionsSoA &normals) {
+  for (size_t k = 0; k < count; ++k) {
+    const unsigned *triangle = indices + 3 * (first + k);
+    for (int corner = 0; corner < 3; ++corner) {
+      unsigned v = triangle[corner];
+      normals.x[v] += nx[k];
+      normals.y[v] += ny[k];
+      normals.z[v] += nz[k];
+    }
+  }
+}
+
+void faceNormalsSse(const PositionsSoA &p, const unsigned *indices, size_t triangleCount,
+                    PositionsSoA &normals) {
+  size_t n = triangleCount & ~size_t(3);
+  alignas(16) float nx[4], ny[4], nz[4];
+
+  for (size_t t = 0; t < n; t += 4) {
+    const unsigned *i = indices + 3 * t;
+    __m128 ax = _mm_setr_ps(p.x[i[0]], p.x[i[3]], p.x[i[6]], p.x[i[9]]);
+    __m128 ay = _mm_setr_ps(p.y[i[0]], p.y[i[3]], p.y[i[6]], p.y[i[9]]);
+    __m128 az = _mm_setr_ps(p.z[i[0]], p.z[i[3]], p.z[i[6]], p.z[i[9]]);
+    __m128 e1x = _mm_sub_ps(_mm_setr_ps(p.x[i[1]], p.x[i[4]], p.x[i[7]], p.x[i[10]]), ax);
+    __m128 e1y = _mm_sub_ps(_mm_setr_ps(p.y[i[1]], p.y[i[4]], p.y[i[7]], p.y[i[10]]), ay);
+    __m128 e1z = _mm_sub_ps(_mm_setr_ps(p.z[i[1]], p.z[i[4]], p.z[i[7]], p.z[i[10]]), az);
+    __m128 e2x = _mm_sub_ps(_mm_setr_ps(p.x[i[2]], p.x[i[5]], p.x[i[8]], p.x[i[11]]), ax);
+    __m128 e2y = _mm_sub_ps(_mm_setr_ps(p.y[i[2]], p.y[i[5]], p.y[i[8]], p.y[i[11]]), ay);
+    __m128 e2z = _mm_sub_ps(_mm_setr_ps(p.z[i[2]], p.z[i[5]], p.z[i[8]], p.z[i[11]]), az);
+
+    _mm_store_ps(nx, _mm_sub_ps(_mm_mul_ps(e1y, e2z), _mm_mul_ps(e1z, e2y)));
+    _mm_store_ps(ny, _mm_sub_ps(_mm_mul_ps(e1z, e2x), _mm_mul_ps(e1x, e2z)));
+    _mm_store_ps(nz, _mm_sub_ps(_mm_mul_ps(e1x, e2y), _mm_mul_ps(e1y, e2x)));
+    scatterNormals(indices, t, 4, nx, ny, nz, normals);
+  }
+  faceNormalsScalar(p, indices, n, triangleCount, normals);
+}
+
+void normalizeSse(PositionsSoA &v) {
+  size_t n = v.size() & ~size_t(3);
+  const __m128 tiny = _mm_set1_ps(1e-30f);
+  const __m128 one = _mm_set1_ps(1.0f);
+  for (size_t i = 0; i < n; i += 4) {
+    __m128 x = _mm_loadu_ps(&v.x[i]);
+    __m128 y = _mm_loadu_ps(&v.y[i]);
+    __m128 z = _mm_loadu_ps(&v.z[i]);
+    __m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+    __m128 inverse = _mm_div_ps(one, _mm_max_ps(_mm_sqrt_ps(lengthSquared), tiny));
+    _mm_storeu_ps(&v.x[i], _mm_mul_ps(x, inverse));
+    _mm_storeu_ps(&v.y[i], _mm_mul_ps(y, inverse));
+    _mm_storeu_ps(&v.z[i], _mm_mul_ps(z, inverse));
+  }
+  normalizeScalar(v, n);
+}
+
+// --- AVX2 + FMA
+
+AVX2_TARGET void boundsAvx2(const PositionsSoA &p, float min[3], float max[3]) {
+  const float *components[3] = {p.x.data(), p.y.data(), p.z.data()};
+  size_t n = p.size() & ~size_t(7);
+  for (int axis = 0; axis < 3; ++axis) {
+    __m256 lo = _mm256_set1_ps(min[axis]);
+    __m256 hi = _mm256_set1_ps(max[axis]);
+    for (size_t i = 0; i < n; i += 8) {
+      __m256 v = _mm256_loadu_ps(components[axis] + i);
+      lo = _mm256_min_ps(lo, v);
+      hi = _mm256_max_ps(hi, v);
+    }
+    min[axis] = horizontalMin(_mm_min_ps(_mm256_castps256_ps128(lo), _mm256_extractf128_ps(lo, 1)));
+    max[axis] = horizontalMax(_mm_max_ps(_mm256_castps256_ps128(hi), _mm256_extractf128_ps(hi, 1)));
+  }
+  boundsScalar(p, n, min, max);
+}
+
+AVX2_TARGET void colouredVerticesAvx2(const PositionsSoA &p, float *out) {
+  size_t n = p.size() & ~size_t(7);
+  for (size_t i = 0; i < n; i += 8) {
+    __m256 x = _mm256_loadu_ps(&p.x[i]);
+    __m256 y = _mm256_loadu_ps(&p.y[i]);
+    __m256 z = _mm256_loadu_ps(&p.z[i]);
+    storeColoured4(out + 6 * i, _mm256_castps256_ps128(x), _mm256_castps256_ps128(y),
+                   _mm256_castps256_ps128(z));
+    storeColoured4(out + 6 * (i + 4), _mm256_extractf128_ps(x, 1), _mm256_extractf128_ps(y, 1),
+                   _mm256_extractf128_ps(z, 1));
+  }
+  colouredVerticesScalar(p, n, out);
+}
+
+AVX2_TARGET void transformAvx2(const float m[16], const PositionsSoA &p, PositionsSoA &out) {
+  size_t n = p.size() & ~size_t(7);
+  __m256 c[16];
+  for (int k = 0; k < 16; ++k) c[k] = _mm256_set1_ps(m[k]);
+
+  for (size_t i = 0; i < n; i += 8) {
+    __m256 x = _mm256_loadu_ps(&p.x[i]);
+    __m256 y = _mm256_loadu_ps(&p.y[i]);
+    __m256 z = _mm256_loadu_ps(&p.z[i]);
+    __m256 ox = _mm256_fmadd_ps(c[0], x, _mm256_fmadd_ps(c[4], y, _mm256_fmadd_ps(c[8], z, c[12])));
+    __m256 oy = _mm256_fmadd_ps(c[1], x, _mm256_fmadd_ps(c[5], y, _mm256_fmadd_ps(c[9], z, c[13])));
+    __m256 oz = _mm256_fmadd_ps(c[2], x, _mm256_fmadd_ps(c[6], y, _mm256_fmadd_ps(c[10], z, c[14])));
+    _mm256_storeu_ps(&out.x[i], ox);
+    _mm256_storeu_ps(&out.y[i], oy);
+    _mm256_storeu_ps(&out.z[i], oz);
+  }
+  transformScalar(m, p, n, out);
+}
+
+AVX2_TARGET void faceNormalsAvx2(const PositionsSoA &p, const unsigned *indices,
+                                 size_t triangleCount, PositionsSoA &normals) {
+  size_t n = triangleCount & ~size_t(7);
+  alignas(32) float nx[8], ny[8], nz[8];
+  const __m256i stride = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+
+  for (size_t t = 0; t < n; t += 8) {
+    const int *i = reinterpret_cast<const int *>(indices + 3 * t);
+    __m256i ia = _mm256_i32gather_epi32(i, stride, 4);
+    __m256i ib = _mm256_i32gather_epi32(i + 1, stride, 4);
+    __m256i ic = _mm256_i32gather_epi32(i + 2, stride, 4);
+
+    __m256 ax = _mm256_i32gather_ps(p.x.data(), ia, 4);
+    __m256 ay = _mm256_i32gather_ps(p.y.data(), ia, 4);
+    __m256 az = _mm256_i32gather_ps(p.z.data(), ia, 4);
+    __m256 e1x = _mm256_sub_ps(_mm256_i32gather_ps(p.x.data(), ib, 4), ax);
+    __m256 e1y = _mm256_sub_ps(_mm256_i32gather_ps(p.y.data(), ib, 4), ay);
+    __m256 e1z = _mm256_sub_ps(_mm256_i32gather_ps(p.z.data(), ib, 4), az);
+    __m256 e2x = _mm256_sub_ps(_mm256_i32gather_ps(p.x.data(), ic, 4), ax);
+    __m256 e2y = _mm256_sub_ps(_mm256_i32gather_ps(p.y.data(), ic, 4), ay);
+    __m256 e2z = _mm256_sub_ps(_mm256_i32gather_ps(p.z.data(), ic, 4), az);
+
+    _mm256_store_ps(nx, _mm256_fmsub_ps(e1y, e2z, _mm256_mul_ps(e1z, e2y)));
+    _mm256_store_ps(ny, _mm256_fmsub_ps(e1z, e2x, _mm256_mul_ps(e1x, e2z)));
+    _mm256_store_ps(nz, _mm256_fmsub_ps(e1x, e2y, _mm256_mul_ps(e1y, e2x)));
+    scatterNormals(indices, t, 8, nx, ny, nz, normals);
+  }
+  faceNormalsScalar(p, indices, n, triangleCount, normals);
+}
+
+AVX2_TARGET void normalizeAvx2(PositionsSoA &v) {
+  size_t n = v.size() & ~size_t(7);
+  const __m256 tiny = _mm256_set1_ps(1e-30f);
+  const __m256 one = _mm256_set1_ps(1.0f);
+  for (size_t i = 0; i < n; i += 8) {
+    __m256 x = _mm256_loadu_ps(&v.x[i]);
+    __m256 y = _mm256_loadu_ps(&v.y[i]);
+    __m256 z = _mm256_loadu_ps(&v.z[i]);
+    __m256 lengthSquared = _mm256_fmadd_ps(x, x, _mm256_fmadd_ps(y, y, _mm256_mul_ps(z, z)));
+    __m256 inverse = _mm256_div_ps(one, _mm256_max_ps(_mm256_sqrt_ps(lengthSquared), tiny));
+    _mm256_storeu_ps(&v.x[i], _mm256_mul_ps(x, inverse));
+    _mm256_storeu_ps(&v.y[i], _mm256_mul_ps(y, inverse));
+    _mm256_storeu_ps(&v.z[i], _mm256_mul_ps(z, inverse));
+  }
+  normalizeScalar(v, n);
+}
+
+#endif  // SIMD_X86
+
+bool isaSupported(simd::Isa isa) {
+  switch (isa) {
+    case simd::Isa::Scalar:
+      return true;
+#ifdef SIMD_X86
+    case simd::Isa::SSE2:
+      return true;
+    case simd::Isa::AVX2:
+      return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+    default:
+      return false;
+  }
+}
+
+simd::Isa &activeIsa() {
+  static simd::Isa isa = isaSupported(simd::Isa::AVX2)   ? simd::Isa::AVX2
+                         : isaSupported(simd::Isa::SSE2) ? simd::Isa::SSE2
+                                                         : simd::Isa::Scalar;
+  return isa;
+}
+
+}  // namespace
+
+namespace simd {
+
+/**
+ * @brief simd::isa Returns the instruction set the kernels currently use.
+ * @return The active instruction set.
+ */
+Isa isa() { return activeIsa(); }
+
+/**
+ * @brief simd::setIsa Forces the kernels to a specific instruction set.
+ * @param isa The instruction set to use.
+ * @return Whether the CPU supports it; if not, nothing changes.
+ */
+bool setIsa(Isa isa) {
+  if (!isaSupported(isa)) return false;
+  activeIsa() = isa;
+  return true;
+}
+
+/**
+ * @brief simd::isaName Returns a readable name of an instruction set.
+ * @param isa The instruction set.
+ * @return Its name.
+ */
+const char *isaName(Isa isa) {
+  switch (isa) {
+    case Isa::SSE2:
+      return "sse2";
+    case Isa::AVX2:
+      return "avx2";
+    default:
+      return "scalar";
+  }
+}
+
+/**
+ * @brief simd::computeBounds Extends an axis-aligned bounding box by a set of
+ * positions.
+ * @param p The positions.
+ * @param min Minimum corner, updated in place.
+ * @param max Maximum corner, updated in place.
+ */
+void computeBounds(const PositionsSoA &p, float min[3], float max[3]) {
+  switch (activeIsa()) {
+#ifdef SIMD_X86
+    case Isa::AVX2:
+      return boundsAvx2(p, min, max);
+    case Isa::SSE2:
+      return boundsSse(p, min, max);
+#endif
+    default:
+      return boundsScalar(p, 0, min, max);
+  }
+}
+
+/**
+ * @brief simd::writeColouredVertices Writes interleaved position and colour
+ * attributes, where the colour is the absolute value of the position.
+ * @param p The positions.
+ * @param out Destination with room for 6 * p.size() floats; may be mapped
+ * buffer memory.
+ */
+void writeColouredVertices(const PositionsSoA &p, float *out) {
+  switch (activeIsa()) {
+#ifdef SIMD_X86
+    case Isa::AVX2:
+      return colouredVerticesAvx2(p, out);
+    case Isa::SSE2:
+      return colouredVerticesSse(p, out);
+#endif
+    default:
+      return colouredVerticesScalar(p, 0, out);
+  }
+}
+
+/**
+ * @brief simd::transformPoints Transforms a batch of points by an affine
+ * matrix.
+ * @param m Column-major 4x4 matrix, e.g. QMatrix4x4::constData().
+ * @param p The points.
+ * @param out The transformed points; may be the same object as p.
+ */
+void transformPoints(const float m[16], const PositionsSoA &p, PositionsSoA &out) {
+  out.resize(p.size());
+  switch (activeIsa()) {
+#ifdef SIMD_X86
+    case Isa::AVX2:
+      return transformAvx2(m, p, out);
+    case Isa::SSE2:
+      return transformSse(m, p, out);
+#endif
+    default:
+      return transformScalar(m, p, 0, out);
+  }
+}
+
+/**
+ * @brief simd::computeNormals Computes smooth vertex normals as the
+ * normalized sum of the area-weighted normals of the adjacent triangles.
+ * @param p The vertex positions.
+ * @param indices Three indices into p per triangle.
+ * @param indexCount Number of indices.
+ * @param normals The vertex normals.
+ */
+void computeNormals(const PositionsSoA &p, const unsigned *indices,
+                    size_t indexCount, PositionsSoA &normals) {
+  normals.x.assign(p.size(), 0);
+  normals.y.assign(p.size(), 0);
+  normals.z.assign(p.size(), 0);
+  size_t triangleCount = indexCount / 3;
+
+  switch (activeIsa()) {
+#ifdef SIMD_X86
+    case Isa::AVX2:
+      faceNormalsAvx2(p, indices, triangleCount, normals);
+      return normalizeAvx2(normals);
+    case Isa::SSE2:
+      faceNormalsSse(p, indices, triangleCount, normals);
+      return normalizeSse(normals);
+#endif
+    default:
+      faceNormalsScalar(p, indices, 0, triangleCount, normals);
+      return normalizeScalar(normals, 0);
+  }
+}
+
+}  // namespace simd
@@ -0,0 +1,61 @@
+#ifndef SIMDMATH_H
+#define SIMDMATH_H
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief Positions (or any 3D vectors) stored as a structure of arrays, so
+ * that consecutive elements of one component can be processed together.
+ */
+struct PositionsSoA {
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+
+  size_t size() const { return x.size(); }
+  void resize(size_t n) {
+    x.resize(n);
+    y.resize(n);
+    z.resize(n);
+  }
+
+  // From and to tightly packed xyz triples, e.g. QVector3D arrays
+  void fromInterleaved(const float *xyz, size_t n);
+  void toInterleaved(float *xyz) const;
+};
+
+/**
+ * @brief CPU-side mesh processing kernels with SSE and AVX2 paths.
+ *
+ * The widest instruction set the CPU supports is picked on first use, with a
+ * scalar fallback on other architectures. setIsa() overrides the choice, which
+ * is mostly useful to compare the paths in benchmarks.
+ */
+namespace simd {
+
+enum class Isa { Scalar, SSE2, AVX2 };
+
+Isa isa();
+bool setIsa(Isa isa);  // false if the CPU does not support it
+const char *isaName(Isa isa);
+
+// Extends the axis-aligned bounds min/max by all positions
+void computeBounds(const PositionsSoA &p, float min[3], float max[3]);
+
+// Writes n interleaved vertices {x, y, z, |x|, |y|, |z|}: the position and
+// the colour derived from it, as used for the knot
+void writeColouredVertices(const PositionsSoA &p, float *out);
+
+// out = m * (p, 1) for an affine, column-major 4x4 matrix (no divide by w).
+// out may alias p.
+void transformPoints(const float m[16], const PositionsSoA &p, PositionsSoA &out);
+
+// Adds the area-weighted face normal of every triangle to its three vertices
+// and normalizes the result. normals is resized to p.size().
+void computeNormals(const PositionsSoA &p, const unsigned *indices,
+                    size_t indexCount, PositionsSoA &normals);
+
+}  // namespace simd
+
+#endif  // SIMDMATH_H
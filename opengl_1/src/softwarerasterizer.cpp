@@ -0,0 +1,547 @@
+#include "softwarerasterizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define RASTER_SSE 1
+#include <immintrin.h>
+#endif
+
+/**
+ * @brief A vertex after the vertex stage.
+ */
+struct SoftwareRasterizer::Vertex {
+  float clip[4];
+  float eye[3];
+  float colour[3];
+};
+
+/**
+ * @brief A triangle set up for rasterization. Every interpolated value is a
+ * plane {d/dx, d/dy, value at the origin} in pixel coordinates.
+ */
+struct SoftwareRasterizer::Triangle {
+  // Edge functions, positive inside; index i is opposite vertex i
+  float edgeA[3];
+  float edgeB[3];
+  float edgeC[3];
+  bool topLeft[3];  // pixels exactly on the edge belong to this triangle
+
+  float depth[3];  // window depth, linear in screen space
+  float invW[3];
+  float attributes[6][3];  // colour and eye position, divided by w
+  float normal[3];         // flat normal in eye space, facing the camera
+
+  int minX, minY, maxX, maxY;  // pixel bounds, inclusive
+  const DrawCall *call;
+};
+
+/**
+ * @brief The triangles set up by one job, binned per tile.
+ */
+struct SoftwareRasterizer::Chunk {
+  std::vector<Triangle> triangles;
+  std::vector<uint32_t> binOffsets;  // per tile, into binTriangles
+  std::vector<uint32_t> binTriangles;
+};
+
+namespace {
+const size_t vertexGrain = 4096;
+const size_t triangleGrain = 4096;
+const float nearEpsilon = 1e-6f;
+
+// 4x4 column-major matrix times (x, y, z, w)
+void transform(const float m[16], const float in[4], float out[4]) {
+  for (int row = 0; row < 4; ++row) {
+    out[row] = m[row] * in[0] + m[4 + row] * in[1] + m[8 + row] * in[2] + m[12 + row] * in[3];
+  }
+}
+
+// RGBA8888 as stored by QImage: red in the lowest byte on little-endian hosts
+uint32_t pack(float r, float g, float b, float a) {
+  auto channel = [](float c) { return uint32_t(std::min(std::max(c, 0.0f), 1.0f) * 255 + 0.5f); };
+  return channel(r) | channel(g) << 8 | channel(b) << 16 | channel(a) << 24;
+}
+
+float snap(float coordinate) {
+  // Snap to 1/16 pixel, so shared edges are evaluated identically
+  return std::round(coordinate * 16) / 16;
+}
+}  // namespace
+
+/**
+ * @brief SoftwareRasterizer::SoftwareRasterizer Constructs a rasterizer
+ * without a frame; call resize() first.
+ * @param jobs The job system to run the stages on.
+ */
+SoftwareRasterizer::SoftwareRasterizer(JobSystem &jobs) : jobs(jobs) {
+  float identity[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+  std::copy(identity, identity + 16, projection);
+}
+
+SoftwareRasterizer::~SoftwareRasterizer() = default;
+
+/**
+ * @brief SoftwareRasterizer::resize Sets the size of the frame. Its contents
+ * are undefined until the next clear().
+ * @param width Width in pixels.
+ * @param height Height in pixels.
+ */
+void SoftwareRasterizer::resize(int width, int height) {
+  frameWidth = std::max(width, 1);
+  frameHeight = std::max(height, 1);
+  tilesX = (frameWidth + tileSize - 1) / tileSize;
+  tilesY = (frameHeight + tileSize - 1) / tileSize;
+  bufferWidth = tilesX * tileSize;
+  colour.resize(size_t(bufferWidth) * tilesY * tileSize);
+  depth.resize(colour.size());
+}
+
+/**
+ * @brief SoftwareRasterizer::clear Clears the colour to the given value and
+ * the depth to the far plane.
+ */
+void SoftwareRasterizer::clear(float red, float green, float blue, float alpha) {
+  std::fill(colour.begin(), colour.end(), pack(red, green, blue, alpha));
+  std::fill(depth.begin(), depth.end(), 1.0f);
+}
+
+/**
+ * @brief SoftwareRasterizer::setProjection Sets the projection of the
+ * following draws.
+ * @param matrix Column-major 4x4 matrix.
+ */
+void SoftwareRasterizer::setProjection(const float matrix[16]) {
+  std::copy(matrix, matrix + 16, projection);
+}
+
+/**
+ * @brief SoftwareRasterizer::draw Queues a draw call.
+ * @param call The mesh and its uniforms.
+ */
+void SoftwareRasterizer::draw(const DrawCall &call) { draws.push_back(call); }
+
+/**
+ * @brief SoftwareRasterizer::flush Renders the queued draws: vertices and
+ * triangle setup per draw, then all tiles at once.
+ */
+void SoftwareRasterizer::flush() {
+  usedChunks = 0;
+  for (const DrawCall &call : draws) {
+    transformVertices(call);
+
+    size_t triangleCount = (call.indices ? call.indexCount : call.vertexCount) / 3;
+    size_t jobCount = (triangleCount + triangleGrain - 1) / triangleGrain;
+    size_t base = usedChunks;
+    usedChunks += jobCount;
+    if (chunks.size() < usedChunks) chunks.resize(usedChunks);
+
+    // One chunk per grain, also when a job is handed a larger range
+    jobs.parallelFor(triangleCount, triangleGrain, [&](size_t begin, size_t end) {
+      for (size_t first = begin; first < end; first += triangleGrain) {
+        Chunk &chunk = chunks[base + first / triangleGrain];
+        setupTriangles(call, first, std::min(end, first + triangleGrain), chunk);
+        binTriangles(chunk);
+      }
+    });
+  }
+
+  jobs.parallelFor(tilesX * tilesY, 1, [this](size_t begin, size_t end) {
+    for (size_t tile = begin; tile < end; ++tile) {
+      rasterizeTile(tile);
+    }
+  });
+  draws.clear();
+}
+
+/**
+ * @brief SoftwareRasterizer::transformVertices The vertex stage: eye and clip
+ * positions and the colour of every vertex.
+ * @param call The draw.
+ */
+void SoftwareRasterizer::transformVertices(const DrawCall &call) {
+  vertices.resize(call.vertexCount);
+  jobs.parallelFor(call.vertexCount, vertexGrain, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      Vertex &v = vertices[i];
+      const float *p = call.positions + i * call.positionStride;
+      float position[4] = {p[0], p[1], p[2], 1};
+      float eye[4];
+      transform(call.modelTransform, position, eye);
+      transform(projection, eye, v.clip);
+      std::copy(eye, eye + 3, v.eye);
+
+      const float *c = call.colours ? call.colours + i * call.colourStride : call.objectColour;
+      std::copy(c, c + 3, v.colour);
+    }
+  });
+}
+
+/**
+ * @brief SoftwareRasterizer::setupTriangles Clips a range of triangles
+ * against the near plane and sets them up.
+ * @param call The draw.
+ * @param begin First triangle.
+ * @param end One past the last triangle.
+ * @param chunk Receives the triangles.
+ */
+void SoftwareRasterizer::setupTriangles(const DrawCall &call, size_t begin, size_t end,
+                                        Chunk &chunk) {
+  chunk.triangles.clear();
+
+  for (size_t t = begin; t < end; ++t) {
+    const Vertex *v[3];
+    for (int k = 0; k < 3; ++k) {
+      size_t index = 3 * t + k;
+      v[k] = &vertices[call.indices ? call.indices[index] : index];
+    }
+
+    // Trivially reject triangles entirely outside one of the side planes
+    bool outside = false;
+    for (int axis = 0; axis < 2 && !outside; ++axis) {
+      outside = (v[0]->clip[axis] > v[0]->clip[3] && v[1]->clip[axis] > v[1]->clip[3] &&
+                 v[2]->clip[axis] > v[2]->clip[3]) ||
+                (v[0]->clip[axis] < -v[0]->clip[3] && v[1]->clip[axis] < -v[1]->clip[3] &&
+                 v[2]->clip[axis] < -v[2]->clip[3]);
+    }
+    if (outside) continue;
+
+    // Distance to the near plane z = -w; positive in front of it
+    float distance[3];
+    int inFront = 0;
+    for (int k = 0; k < 3; ++k) {
+      distance[k] = v[k]->clip[2] + v[k]->clip[3];
+      if (distance[k] >= 0 && v[k]->clip[3] > nearEpsilon) ++inFront;
+    }
+    if (inFront == 3) {
+      addTriangle(call, v, chunk);
+      continue;
+    }
+    if (inFront == 0) continue;
+
+    // Sutherland-Hodgman against the near plane gives at most 4 vertices
+    Vertex clipped[4];
+    int count = 0;
+    for (int k = 0; k < 3; ++k) {
+      const Vertex &a = *v[k];
+      const Vertex &b = *v[(k + 1) % 3];
+      float da = distance[k], db = distance[(k + 1) % 3];
+      if (da >= 0) clipped[count++] = a;
+      if ((da >= 0) != (db >= 0)) {
+        float s = da / (da - db);
+        Vertex &c = clipped[count++];
+        for (int i = 0; i < 4; ++i) c.clip[i] = a.clip[i] + s * (b.clip[i] - a.clip[i]);
+        for (int i = 0; i < 3; ++i) c.eye[i] = a.eye[i] + s * (b.eye[i] - a.eye[i]);
+        for (int i = 0; i < 3; ++i) c.colour[i] = a.colour[i] + s * (b.colour[i] - a.colour[i]);
+      }
+    }
+    for (int k = 1; k + 1 < count; ++k) {
+      const Vertex *fan[3] = {&clipped[0], &clipped[k], &clipped[k + 1]};
+      if (fan[0]->clip[3] > nearEpsilon && fan[1]->clip[3] > nearEpsilon &&
+          fan[2]->clip[3] > nearEpsilon) {
+        addTriangle(call, fan, chunk);
+      }
+    }
+  }
+}
+
+/**
+ * @brief SoftwareRasterizer::addTriangle Projects a triangle that lies in
+ * front of the near plane and computes its edge functions and planes.
+ * Triangles that are culled or cover no pixel centre are dropped.
+ * @param call The draw.
+ * @param v The vertices.
+ * @param chunk Receives the triangle.
+ */
+void SoftwareRasterizer::addTriangle(const DrawCall &call, const Vertex *const v[3],
+                                     Chunk &chunk) {
+  float x[3], y[3], z[3], invW[3];
+  for (int k = 0; k < 3; ++k) {
+    invW[k] = 1 / v[k]->clip[3];
+    x[k] = snap((v[k]->clip[0] * invW[k] * 0.5f + 0.5f) * frameWidth);
+    y[k] = snap((0.5f - v[k]->clip[1] * invW[k] * 0.5f) * frameHeight);
+    z[k] = v[k]->clip[2] * invW[k] * 0.5f + 0.5f;
+  }
+
+  // y points down, so counter-clockwise (front) triangles have negative area
+  float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+  if (area == 0 || (call.cullBackFaces && area > 0)) return;
+  int order[3] = {0, 1, 2};
+  if (area < 0) {
+    std::swap(order[1], order[2]);
+    area = -area;
+  }
+
+  Triangle triangle;
+  triangle.minX = std::max(0, int(std::ceil(std::min({x[0], x[1], x[2]}) - 0.5f)));
+  triangle.minY = std::max(0, int(std::ceil(std::min({y[0], y[1], y[2]}) - 0.5f)));
+  triangle.maxX = std::min(frameWidth - 1, int(std::floor(std::max({x[0], x[1], x[2]}) - 0.5f)));
+  triangle.maxY = std::min(frameHeight - 1, int(std::floor(std::max({y[0], y[1], y[2]}) - 0.5f)));
+  if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) return;
+
+  for (int e = 0; e < 3; ++e) {
+    int i = order[(e + 1) % 3], j = order[(e + 2) % 3];
+    triangle.edgeA[e] = y[i] - y[j];
+    triangle.edgeB[e] = x[j] - x[i];
+    triangle.edgeC[e] = x[i] * y[j] - x[j] * y[i];
+    triangle.topLeft[e] = triangle.edgeA[e] > 0 || (triangle.edgeA[e] == 0 && triangle.edgeB[e] > 0);
+  }
+
+  // A value interpolated with the normalized edge functions as weights
+  auto plane = [&](float out[3], float v0, float v1, float v2) {
+    float value[3] = {v0, v1, v2};
+    out[0] = out[1] = out[2] = 0;
+    for (int e = 0; e < 3; ++e) {
+      float weight = value[order[e]] / area;
+      out[0] += triangle.edgeA[e] * weight;
+      out[1] += triangle.edgeB[e] * weight;
+      out[2] += triangle.edgeC[e] * weight;
+    }
+  };
+  plane(triangle.depth, z[0], z[1], z[2]);
+  plane(triangle.invW, invW[0], invW[1], invW[2]);
+  for (int a = 0; a < 3; ++a) {
+    plane(triangle.attributes[a], v[0]->colour[a] * invW[0], v[1]->colour[a] * invW[1],
+          v[2]->colour[a] * invW[2]);
+    plane(triangle.attributes[3 + a], v[0]->eye[a] * invW[0], v[1]->eye[a] * invW[1],
+          v[2]->eye[a] * invW[2]);
+  }
+
+  // Like the normal from dFdx/dFdy in fragshader.glsl, it faces the camera
+  float e1[3], e2[3];
+  for (int a = 0; a < 3; ++a) {
+    e1[a] = v[1]->eye[a] - v[0]->eye[a];
+    e2[a] = v[2]->eye[a] - v[0]->eye[a];
+  }
+  float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2],
+                e1[0] * e2[1] - e1[1] * e2[0]};
+  float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+  if (n[0] * v[0]->eye[0] + n[1] * v[0]->eye[1] + n[2] * v[0]->eye[2] > 0) length = -length;
+  for (int a = 0; a < 3; ++a) {
+    triangle.normal[a] = length != 0 ? n[a] / length : 0;
+  }
+
+  triangle.call = &call;
+  chunk.triangles.push_back(triangle);
+}
+
+/**
+ * @brief SoftwareRasterizer::binTriangles Sorts the triangles of a chunk by
+ * the tiles their bounds overlap.
+ * @param chunk The chunk.
+ */
+void SoftwareRasterizer::binTriangles(Chunk &chunk) {
+  chunk.binOffsets.assign(tilesX * tilesY + 1, 0);
+
+  // Count, prefix sum, then fill; binOffsets[tile + 1] is the write position
+  for (const Triangle &triangle : chunk.triangles) {
+    for (int ty = triangle.minY / tileSize; ty <= triangle.maxY / tileSize; ++ty) {
+      for (int tx = triangle.minX / tileSize; tx <= triangle.maxX / tileSize; ++tx) {
+        ++chunk.binOffsets[ty * tilesX + tx + 1];
+      }
+    }
+  }
+  for (size_t tile = 1; tile < chunk.binOffsets.size(); ++tile) {
+    chunk.binOffsets[tile] += chunk.binOffsets[tile - 1];
+  }
+  chunk.binTriangles.resize(chunk.binOffsets.back());
+
+  std::vector<uint32_t> cursor(chunk.binOffsets.begin(), chunk.binOffsets.end() - 1);
+  for (size_t i = 0; i < chunk.triangles.size(); ++i) {
+    const Triangle &triangle = chunk.triangles[i];
+    for (int ty = triangle.minY / tileSize; ty <= triangle.maxY / tileSize; ++ty) {
+      for (int tx = triangle.minX / tileSize; tx <= triangle.maxX / tileSize; ++tx) {
+        chunk.binTriangles[cursor[ty * tilesX + tx]++] = i;
+      }
+    }
+  }
+}
+
+/**
+ * @brief SoftwareRasterizer::rasterizeTile Draws every triangle binned to a
+ * tile, in submission order.
+ * @param tile Index of the tile.
+ */
+void SoftwareRasterizer::rasterizeTile(int tile) {
+  int tileX = tile % tilesX, tileY = tile / tilesX;
+  for (size_t c = 0; c < usedChunks; ++c) {
+    const Chunk &chunk = chunks[c];
+    for (uint32_t k = chunk.binOffsets[tile]; k < chunk.binOffsets[tile + 1]; ++k) {
+      rasterize(chunk.triangles[chunk.binTriangles[k]], tileX, tileY);
+    }
+  }
+}
+
+#ifdef RASTER_SSE
+
+/**
+ * @brief SoftwareRasterizer::rasterize Draws the part of a triangle inside a
+ * tile, four pixels at a time.
+ * @param t The triangle.
+ * @param tileX Column of the tile.
+ * @param tileY Row of the tile.
+ */
+void SoftwareRasterizer::rasterize(const Triangle &t, int tileX, int tileY) {
+  // The tile is entirely inside the buffer, so whole groups of 4 are safe
+  int x0 = std::max(t.minX, tileX * tileSize) & ~3;
+  int x1 = std::min(t.maxX, tileX * tileSize + tileSize - 1);
+  int y0 = std::max(t.minY, tileY * tileSize);
+  int y1 = std::min(t.maxY, tileY * tileSize + tileSize - 1);
+
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1);
+  const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+  __m128 topLeft[3];
+  for (int e = 0; e < 3; ++e) {
+    topLeft[e] = _mm_castsi128_ps(_mm_set1_epi32(t.topLeft[e] ? -1 : 0));
+  }
+
+  const DrawCall &call = *t.call;
+  const __m128 light[3] = {_mm_set1_ps(call.lightPosition[0]), _mm_set1_ps(call.lightPosition[1]),
+                           _mm_set1_ps(call.lightPosition[2])};
+  const __m128 normal[3] = {_mm_set1_ps(t.normal[0]), _mm_set1_ps(t.normal[1]),
+                            _mm_set1_ps(t.normal[2])};
+
+  auto evaluate = [](const float plane[3], __m128 x, __m128 y) {
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane[0]), x),
+                                 _mm_mul_ps(_mm_set1_ps(plane[1]), y)),
+                      _mm_set1_ps(plane[2]));
+  };
+
+  for (int py = y0; py <= y1; ++py) {
+    __m128 y = _mm_set1_ps(py + 0.5f);
+    uint32_t *colourRow = &colour[size_t(py) * bufferWidth];
+    float *depthRow = &depth[size_t(py) * bufferWidth];
+
+    for (int px = x0; px <= x1; px += 4) {
+      __m128 x = _mm_add_ps(_mm_set1_ps(float(px)), laneOffsets);
+
+      __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(-1));
+      for (int e = 0; e < 3; ++e) {
+        float edge[3] = {t.edgeA[e], t.edgeB[e], t.edgeC[e]};
+        __m128 w = evaluate(edge, x, y);
+        __m128 inside = _mm_or_ps(_mm_cmpgt_ps(w, zero), _mm_and_ps(_mm_cmpeq_ps(w, zero), topLeft[e]));
+        mask = _mm_and_ps(mask, inside);
+      }
+      if (_mm_movemask_ps(mask) == 0) continue;
+
+      __m128 z = evaluate(t.depth, x, y);
+      __m128 oldDepth = _mm_load_ps(depthRow + px);
+      mask = _mm_and_ps(mask, _mm_cmple_ps(z, oldDepth));
+      if (_mm_movemask_ps(mask) == 0) continue;
+
+      // Perspective-correct attributes
+      __m128 w = _mm_div_ps(one, evaluate(t.invW, x, y));
+      __m128 rgb[3];
+      for (int a = 0; a < 3; ++a) {
+        rgb[a] = _mm_mul_ps(evaluate(t.attributes[a], x, y), w);
+      }
+
+      if (call.lighting) {
+        __m128 toLight[3];
+        __m128 lengthSquared = zero, alignment = zero;
+        for (int a = 0; a < 3; ++a) {
+          __m128 position = _mm_mul_ps(evaluate(t.attributes[3 + a], x, y), w);
+          toLight[a] = _mm_sub_ps(light[a], position);
+          lengthSquared = _mm_add_ps(lengthSquared, _mm_mul_ps(toLight[a], toLight[a]));
+          alignment = _mm_add_ps(alignment, _mm_mul_ps(normal[a], toLight[a]));
+        }
+        __m128 diffuse = _mm_max_ps(_mm_div_ps(alignment, _mm_sqrt_ps(lengthSquared)), zero);
+        __m128 factor = _mm_add_ps(_mm_set1_ps(0.2f), _mm_mul_ps(_mm_set1_ps(0.8f), diffuse));
+        for (int a = 0; a < 3; ++a) {
+          rgb[a] = _mm_mul_ps(rgb[a], factor);
+        }
+      }
+
+      // Pack to RGBA8888 with alpha 1
+      __m128i packed = _mm_set1_epi32(int(0xFF000000u));
+      for (int a = 0; a < 3; ++a) {
+        __m128 clamped = _mm_min_ps(_mm_max_ps(rgb[a], zero), one);
+        __m128i channel = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(clamped, _mm_set1_ps(255)), _mm_set1_ps(0.5f)));
+        packed = _mm_or_si128(packed, _mm_slli_epi32(channel, 8 * a));
+      }
+
+      __m128i maskBits = _mm_castps_si128(mask);
+      __m128i *target = reinterpret_cast<__m128i *>(colourRow + px);
+      __m128i oldColour = _mm_load_si128(target);
+      _mm_store_si128(target, _mm_or_si128(_mm_and_si128(maskBits, packed),
+                                           _mm_andnot_si128(maskBits, oldColour)));
+      _mm_store_ps(depthRow + px, _mm_or_ps(_mm_and_ps(mask, z), _mm_andnot_ps(mask, oldDepth)));
+    }
+  }
+}
+
+#else
+
+/**
+ * @brief SoftwareRasterizer::rasterize Draws the part of a triangle inside a
+ * tile, one pixel at a time.
+ * @param t The triangle.
+ * @param tileX Column of the tile.
+ * @param tileY Row of the tile.
+ */
+void SoftwareRasterizer::rasterize(const Triangle &t, int tileX, int tileY) {
+  int x0 = std::max(t.minX, tileX * tileSize);
+  int x1 = std::min(t.maxX, tileX * tileSize + tileSize - 1);
+  int y0 = std::max(t.minY, tileY * tileSize);
+  int y1 = std::min(t.maxY, tileY * tileSize + tileSize - 1);
+  const DrawCall &call = *t.call;
+
+  auto evaluate = [](const float plane[3], float x, float y) {
+    return plane[0] * x + plane[1] * y + plane[2];
+  };
+
+  for (int py = y0; py <= y1; ++py) {
+    float y = py + 0.5f;
+    for (int px = x0; px <= x1; ++px) {
+      float x = px + 0.5f;
+
+      bool inside = true;
+      for (int e = 0; e < 3 && inside; ++e) {
+        float w = t.edgeA[e] * x + t.edgeB[e] * y + t.edgeC[e];
+        inside = w > 0 || (w == 0 && t.topLeft[e]);
+      }
+      if (!inside) continue;
+
+      size_t pixel = size_t(py) * bufferWidth + px;
+      float z = evaluate(t.depth, x, y);
+      if (!(z <= depth[pixel])) continue;
+
+      float w = 1 / evaluate(t.invW, x, y);
+      float rgb[3];
+      for (int a = 0; a < 3; ++a) {
+        rgb[a] = evaluate(t.attributes[a], x, y) * w;
+      }
+
+      if (call.lighting) {
+        float toLight[3], lengthSquared = 0, alignment = 0;
+        for (int a = 0; a < 3; ++a) {
+          toLight[a] = call.lightPosition[a] - evaluate(t.attributes[3 + a], x, y) * w;
+          lengthSquared += toLight[a] * toLight[a];
+          alignment += t.normal[a] * toLight[a];
+        }
+        float factor = 0.2f + 0.8f * std::max(alignment / std::sqrt(lengthSquared), 0.0f);
+        for (float &channel : rgb) channel *= factor;
+      }
+
+      colour[pixel] = pack(rgb[0], rgb[1], rgb[2], 1);
+      depth[pixel] = z;
+    }
+  }
+}
+
+#endif  // RASTER_SSE
+
+/**
+ * @brief SoftwareRasterizer::toImage Copies the frame into an image.
+ * @return The frame as an RGBA8888 image.
+ */
+QImage SoftwareRasterizer::toImage() const {
+  QImage image(frameWidth, frameHeight, QImage::Format_RGBA8888);
+  for (int y = 0; y < frameHeight; ++y) {
+    std::memcpy(image.scanLine(y), &colour[size_t(y) * bufferWidth], size_t(frameWidth) * 4);
+  }
+  return image;
+}
@@ -0,0 +1,96 @@
+#ifndef SOFTWARERASTERIZER_H
+#define SOFTWARERASTERIZER_H
+
+#include <QImage>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "jobsystem.h"
+
+/**
+ * @brief The SoftwareRasterizer class renders triangle meshes on the CPU, for
+ * hosts without a GPU.
+ *
+ * It takes the same vertex and index data and transforms as the OpenGL path
+ * and shades like vertshader.glsl / fragshader.glsl: per-vertex or object
+ * colour, and optionally the diffuse lighting with the flat normal of each
+ * triangle. The frame is split into tiles. After transforming the vertices
+ * and binning the triangles in parallel, every tile is rasterized by one
+ * thread with SIMD edge functions and a depth buffer, so threads never write
+ * the same pixel.
+ */
+class SoftwareRasterizer {
+ public:
+  /**
+   * @brief A mesh drawn with one set of uniforms, like a glDraw* call.
+   */
+  struct DrawCall {
+    const float *positions = nullptr;  // xyz per vertex
+    size_t positionStride = 3;         // in floats
+    const float *colours = nullptr;    // rgb per vertex, or nullptr
+    size_t colourStride = 3;
+    size_t vertexCount = 0;
+    const unsigned *indices = nullptr;  // nullptr: consecutive triangles
+    size_t indexCount = 0;
+
+    float modelTransform[16];  // column-major, like QMatrix4x4::constData()
+    float objectColour[3] = {1, 1, 1};
+    bool lighting = false;
+    float lightPosition[3] = {0, 0, 0};  // in eye space
+    bool cullBackFaces = false;          // counter-clockwise is front
+  };
+
+  explicit SoftwareRasterizer(JobSystem &jobs = JobSystem::global());
+  ~SoftwareRasterizer();
+
+  void resize(int width, int height);
+  int width() const { return frameWidth; }
+  int height() const { return frameHeight; }
+
+  void clear(float red, float green, float blue, float alpha);
+  void setProjection(const float projection[16]);
+
+  // Queues a draw; the data must stay valid until flush()
+  void draw(const DrawCall &call);
+  // Renders all queued draws
+  void flush();
+
+  QImage toImage() const;
+  // RGBA8888 pixels with rowStride() pixels per row, top row first
+  const uint32_t *pixels() const { return colour.data(); }
+  int rowStride() const { return bufferWidth; }
+
+  static const int tileSize = 64;
+
+ private:
+  struct Vertex;
+  struct Triangle;
+  struct Chunk;
+
+  void transformVertices(const DrawCall &call);
+  void setupTriangles(const DrawCall &call, size_t begin, size_t end, Chunk &chunk);
+  void addTriangle(const DrawCall &call, const Vertex *const v[3], Chunk &chunk);
+  void binTriangles(Chunk &chunk);
+  void rasterizeTile(int tile);
+  void rasterize(const Triangle &triangle, int tileX, int tileY);
+
+  JobSystem &jobs;
+  int frameWidth = 0;
+  int frameHeight = 0;
+  int bufferWidth = 0;  // rounded up to whole tiles
+  int tilesX = 0;
+  int tilesY = 0;
+
+  std::vector<uint32_t> colour;
+  std::vector<float> depth;
+  float projection[16];
+
+  std::vector<DrawCall> draws;
+  std::vector<Vertex> vertices;
+  std::vector<Chunk> chunks;  // reused between frames
+  size_t usedChunks = 0;
+};
+
+#endif  // SOFTWARERASTERIZER_H
@@ -0,0 +1,33 @@
+#ifndef SPAN_H
+#define SPAN_H
+
+#include <cstddef>
+
+/**
+ * @brief Non-owning view of a contiguous array, like C++20's std::span.
+ *
+ * Taking a Span of a const container never detaches or copies it.
+ */
+template <typename T>
+class Span {
+ public:
+  Span() = default;
+  Span(T *data, size_t size) : ptr(data), count(size) {}
+
+  template <typename Container>
+  Span(Container &container) : ptr(container.data()), count(container.size()) {}
+
+  T *data() const { return ptr; }
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+
+  T &operator[](size_t i) const { return ptr[i]; }
+  T *begin() const { return ptr; }
+  T *end() const { return ptr + count; }
+
+ private:
+  T *ptr = nullptr;
+  size_t count = 0;
+};
+
+#endif  // SPAN_H
@@ -0,0 +1,255 @@
+#include "thumbnailrenderer.h"
+
+#include <QDebug>
+
+#include <algorithm>
+#include <cstring>
+
+/**
+ * @brief ThumbnailRenderer::ThumbnailRenderer Constructs a renderer; call
+ * initialize() before anything else.
+ */
+ThumbnailRenderer::ThumbnailRenderer() = default;
+
+/**
+ * @brief ThumbnailRenderer::~ThumbnailRenderer Releases the OpenGL resources
+ * with the context current, if the OpenGL backend was initialized.
+ */
+ThumbnailRenderer::~ThumbnailRenderer() {
+  if (!glInitialized || !context.makeCurrent(&surface)) return;
+
+  shaders.reset();
+  multisampled.reset();
+  resolved.reset();
+  glDeleteVertexArrays(1, &vao);
+  glDeleteBuffers(1, &vbo);
+  glDeleteBuffers(1, &ebo);
+  for (Readback &readback : readbacks) {
+    glDeleteBuffers(1, &readback.pbo);
+  }
+  context.doneCurrent();
+}
+
+/**
+ * @brief ThumbnailRenderer::initialize Creates the offscreen context and the
+ * framebuffers, or the software rasterizer.
+ * @param imageSize Size of the images.
+ * @param renderBackend The backend to render with.
+ * @param samples Number of samples per pixel for antialiasing (OpenGL only).
+ * @return Whether an OpenGL 3.3 core context could be created.
+ */
+bool ThumbnailRenderer::initialize(const QSize &imageSize, Backend renderBackend, int samples) {
+  size = imageSize;
+  backend = renderBackend;
+  if (backend == Backend::Software) {
+    rasterizer = std::make_unique<SoftwareRasterizer>();
+    rasterizer->resize(size.width(), size.height());
+    return true;
+  }
+
+  surface.setFormat(QSurfaceFormat::defaultFormat());
+  surface.create();
+  context.setFormat(QSurfaceFormat::defaultFormat());
+  if (!context.create() || !context.makeCurrent(&surface)) {
+    qWarning() << "Cannot create an offscreen OpenGL context";
+    return false;
+  }
+  if (!initializeOpenGLFunctions()) {
+    qWarning() << "OpenGL 3.3 core is not available";
+    context.doneCurrent();
+    return false;
+  }
+  glInitialized = true;
+
+  QOpenGLFramebufferObjectFormat format;
+  format.setAttachment(QOpenGLFramebufferObject::Depth);
+  format.setSamples(samples);
+  multisampled = std::make_unique<QOpenGLFramebufferObject>(size, format);
+  resolved = std::make_unique<QOpenGLFramebufferObject>(size);
+  shaders = std::make_unique<ShaderLibrary>();
+
+  glGenVertexArrays(1, &vao);
+  glGenBuffers(1, &vbo);
+  glGenBuffers(1, &ebo);
+  glBindVertexArray(vao);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(QVector3D), (void *)0);
+  glEnableVertexAttribArray(0);
+
+  GLsizeiptr imageBytes = GLsizeiptr(size.width()) * size.height() * 4;
+  for (Readback &readback : readbacks) {
+    glGenBuffers(1, &readback.pbo);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER, imageBytes, nullptr, GL_STREAM_READ);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  glEnable(GL_DEPTH_TEST);
+  glDepthFunc(GL_LEQUAL);
+  return true;
+}
+
+/**
+ * @brief ThumbnailRenderer::rendererName Returns the name of the OpenGL
+ * implementation, e.g. to tell a GPU from a software rasterizer.
+ * @return The GL_RENDERER string.
+ */
+QString ThumbnailRenderer::rendererName() {
+  if (backend == Backend::Software) {
+    return QString("software rasterizer");
+  }
+  return reinterpret_cast<const char *>(glGetString(GL_RENDERER));
+}
+
+/**
+ * @brief ThumbnailRenderer::setMesh Uploads an indexed mesh, replacing the
+ * previous one.
+ * @param coords The unique vertex positions.
+ * @param indices Three indices into coords per triangle.
+ * @param bounds Bounds of coords, used to frame the mesh.
+ */
+void ThumbnailRenderer::setMesh(Span<const QVector3D> coords,
+                                Span<const unsigned> indices,
+                                const Bounds &bounds) {
+  if (backend == Backend::Software) {
+    meshCoords = coords;
+    meshIndices = indices;
+  } else {
+    glBindVertexArray(vao);
+    glBufferData(GL_ARRAY_BUFFER, coords.size() * sizeof(QVector3D), coords.data(), GL_STREAM_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STREAM_DRAW);
+  }
+  indexCount = indices.size();
+
+  normalization.setToIdentity();
+  normalization.scale(1 / std::max(bounds.radius(), 1e-6f));
+  normalization.translate(-bounds.center());
+}
+
+/**
+ * @brief ThumbnailRenderer::projection Returns the projection of all views.
+ * The mesh fills the unit sphere, which fits a 45 degree field of view.
+ * @return The projection.
+ */
+QMatrix4x4 ThumbnailRenderer::projection() const {
+  QMatrix4x4 projection;
+  projection.perspective(45, float(size.width()) / size.height(), 0.5f, 10);
+  return projection;
+}
+
+/**
+ * @brief ThumbnailRenderer::viewTransform Returns the model transform of a
+ * view, looking slightly down on the mesh.
+ * @param degrees Rotation around the vertical axis.
+ * @return The transform.
+ */
+QMatrix4x4 ThumbnailRenderer::viewTransform(float degrees) const {
+  QMatrix4x4 model;
+  model.translate(0, 0, -2.8f);
+  model.rotate(20, 1, 0, 0);
+  model.rotate(degrees, 0, 1, 0);
+  return model * normalization;
+}
+
+/**
+ * @brief ThumbnailRenderer::renderView Renders one view of the mesh and
+ * starts reading it back.
+ * @param degrees Rotation around the vertical axis.
+ * @param name Label of the image in takeImages().
+ */
+void ThumbnailRenderer::renderView(float degrees, const QString &name) {
+  if (backend == Backend::Software) {
+    SoftwareRasterizer::DrawCall call;
+    call.positions = reinterpret_cast<const float *>(meshCoords.data());
+    call.vertexCount = meshCoords.size();
+    call.indices = meshIndices.data();
+    call.indexCount = meshIndices.size();
+    QMatrix4x4 model = viewTransform(degrees);
+    std::memcpy(call.modelTransform, model.constData(), sizeof(call.modelTransform));
+    call.objectColour[0] = call.objectColour[1] = call.objectColour[2] = 0.8f;
+    call.lighting = true;
+    call.lightPosition[0] = -2;
+    call.lightPosition[1] = 3;
+    call.lightPosition[2] = 2;
+
+    rasterizer->clear(0, 0, 0, 0);
+    rasterizer->setProjection(projection().constData());
+    rasterizer->draw(call);
+    rasterizer->flush();
+    finished.emplace_back(name, rasterizer->toImage());
+    return;
+  }
+
+  multisampled->bind();
+  glViewport(0, 0, size.width(), size.height());
+  glClearColor(0, 0, 0, 0);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+  QOpenGLShaderProgram *program = shaders->program(Lighting);
+  if (program && indexCount > 0) {
+    program->bind();
+    program->setUniformValue("projectionTransform", projection());
+    program->setUniformValue("modelTransform", viewTransform(degrees));
+    program->setUniformValue("objectColor", QVector3D(0.8f, 0.8f, 0.8f));
+    program->setUniformValue("lightPosition", QVector3D(-2, 3, 2));
+    glBindVertexArray(vao);
+    glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, nullptr);
+  }
+
+  QOpenGLFramebufferObject::blitFramebuffer(resolved.get(), multisampled.get());
+
+  // The buffer used two views ago is free once its pixels are copied out
+  Readback &readback = readbacks[nextReadback];
+  nextReadback = 1 - nextReadback;
+  finishReadback(readback);
+
+  resolved->bind();
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+  glReadPixels(0, 0, size.width(), size.height(), GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  resolved->release();
+  readback.name = name;
+  readback.pending = true;
+}
+
+/**
+ * @brief ThumbnailRenderer::finishReadback Copies a read back image out of
+ * its pixel buffer, waiting for the transfer if needed.
+ * @param readback The readback.
+ */
+void ThumbnailRenderer::finishReadback(Readback &readback) {
+  if (!readback.pending) return;
+  readback.pending = false;
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+  const auto *pixels = static_cast<const uchar *>(glMapBufferRange(
+      GL_PIXEL_PACK_BUFFER, 0, GLsizeiptr(size.width()) * size.height() * 4, GL_MAP_READ_BIT));
+  if (pixels) {
+    // OpenGL stores the bottom row first
+    QImage image(size, QImage::Format_RGBA8888);
+    size_t rowBytes = size_t(size.width()) * 4;
+    for (int y = 0; y < size.height(); ++y) {
+      std::memcpy(image.scanLine(size.height() - 1 - y), pixels + y * rowBytes, rowBytes);
+    }
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    finished.emplace_back(readback.name, std::move(image));
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+/**
+ * @brief ThumbnailRenderer::takeImages Hands out the finished images.
+ * @param flush Also wait for the views whose readback is still in flight.
+ * @return The images with their names, in the order they were rendered.
+ */
+std::vector<std::pair<QString, QImage>> ThumbnailRenderer::takeImages(bool flush) {
+  if (flush) {
+    // The older of the two readbacks is the next one to be reused
+    finishReadback(readbacks[nextReadback]);
+    finishReadback(readbacks[1 - nextReadback]);
+  }
+  std::vector<std::pair<QString, QImage>> images;
+  images.swap(finished);
+  return images;
+}
@@ -0,0 +1,89 @@
+#ifndef THUMBNAILRENDERER_H
+#define THUMBNAILRENDERER_H
+
+#include <QImage>
+#include <QMatrix4x4>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLFunctions_3_3_Core>
+#include <QSize>
+#include <QVector3D>
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "bounds.h"
+#include "shaderlibrary.h"
+#include "softwarerasterizer.h"
+#include "span.h"
+
+/**
+ * @brief The ThumbnailRenderer class renders meshes to images without a
+ * window, for batch previews.
+ *
+ * The OpenGL backend owns its own context on an offscreen surface and renders
+ * into a multisampled framebuffer object. Pixels are read back through a pair
+ * of pixel buffers, so the copy of one view overlaps with rendering the next,
+ * and images come out one view late. The software backend renders with
+ * SoftwareRasterizer instead, for hosts without a GPU.
+ */
+class ThumbnailRenderer : protected QOpenGLFunctions_3_3_Core {
+ public:
+  enum class Backend { OpenGL, Software };
+
+  ThumbnailRenderer();
+  ~ThumbnailRenderer();
+
+  bool initialize(const QSize &size, Backend backend, int samples = 4);
+  QString rendererName();
+
+  // Uploads the mesh that the next views show
+  void setMesh(Span<const QVector3D> coords, Span<const unsigned> indices,
+               const Bounds &bounds);
+
+  // Renders the mesh rotated by degrees around the vertical axis. The image
+  // is returned by a later takeImages(), labelled with name.
+  void renderView(float degrees, const QString &name);
+
+  // Returns the images whose readback finished; flush waits for all of them
+  std::vector<std::pair<QString, QImage>> takeImages(bool flush);
+
+ private:
+  struct Readback {
+    GLuint pbo = 0;
+    QString name;
+    bool pending = false;
+  };
+
+  void finishReadback(Readback &readback);
+  QMatrix4x4 viewTransform(float degrees) const;
+  QMatrix4x4 projection() const;
+
+  QSize size;
+  Backend backend = Backend::OpenGL;
+  // Whether the OpenGL functions were resolved; nothing is deleted otherwise
+  bool glInitialized = false;
+  std::unique_ptr<SoftwareRasterizer> rasterizer;
+  Span<const QVector3D> meshCoords;  // for the software backend
+  Span<const unsigned> meshIndices;
+
+  QOffscreenSurface surface;
+  QOpenGLContext context;
+  std::unique_ptr<QOpenGLFramebufferObject> multisampled;
+  std::unique_ptr<QOpenGLFramebufferObject> resolved;
+  std::unique_ptr<ShaderLibrary> shaders;
+
+  GLuint vao = 0;
+  GLuint vbo = 0;
+  GLuint ebo = 0;
+  GLsizei indexCount = 0;
+  QMatrix4x4 normalization;  // fits the mesh in the unit sphere
+
+  Readback readbacks[2];
+  int nextReadback = 0;
+  std::vector<std::pair<QString, QImage>> finished;
+};
+
+#endif  // THUMBNAILRENDERER_H
@@ -1,5 +1,6 @@
 #include <QDebug>
 
+#include "inputrecorder.h"
 #include "mainview.h"
 
 /**
@@ -7,10 +8,29 @@
  * @param ev Key event.
  */
 void MainView::keyPressEvent(QKeyEvent *ev) {
+  InputRecorder::global().record(InputEvent::key(InputEvent::KeyPress, ev));
   switch (ev->key()) {
     case 'A':
       qDebug() << "A pressed";
       break;
+    case 'P':
+      setDepthPrepass(!depthPrepass);
+      break;
+    case 'O':
+      setOverdrawView(!overdrawView);
+      break;
+    case 'C':
+      setOcclusionCulling(!occlusionCulling);
+      break;
+    case 'M':
+      setMeshletCulling(!planner.meshletCulling);
+      break;
+    case 'R':
+      setDynamicResolution(!renderScaler.enabled);
+      break;
+    case 'G':
+      resources.logUsage();
+      break;
     default:
       // ev->key() is an integer. For alpha numeric characters keys it
       // equivalent with the char value ('A' == 65, '1' == 49) Alternatively,
@@ -28,6 +48,7 @@ void MainView::keyPressEvent(QKeyEvent *ev) {
  * @param ev Key event.
  */
 void MainView::keyReleaseEvent(QKeyEvent *ev) {
+  InputRecorder::global().record(InputEvent::key(InputEvent::KeyRelease, ev));
   switch (ev->key()) {
     case 'A':
       qDebug() << "A released";
@@ -47,6 +68,7 @@ void MainView::keyReleaseEvent(QKeyEvent *ev) {
  * @param ev Mouse events.
  */
 void MainView::mouseDoubleClickEvent(QMouseEvent *ev) {
+  InputRecorder::global().record(InputEvent::mouse(InputEvent::MouseDoubleClick, ev));
   qDebug() << "Mouse double clicked:" << ev->button();
 
   update();
@@ -58,6 +80,7 @@ void MainView::mouseDoubleClickEvent(QMouseEvent *ev) {
  * @param ev Mouse event.
  */
 void MainView::mouseMoveEvent(QMouseEvent *ev) {
+  InputRecorder::global().record(InputEvent::mouse(InputEvent::MouseMove, ev));
   qDebug() << "x" << ev->position().x() << "y" << ev->position().y();
 
   update();
@@ -68,6 +91,7 @@ void MainView::mouseMoveEvent(QMouseEvent *ev) {
  * @param ev Mouse event.
  */
 void MainView::mousePressEvent(QMouseEvent *ev) {
+  InputRecorder::global().record(InputEvent::mouse(InputEvent::MousePress, ev));
   qDebug() << "Mouse button pressed:" << ev->button();
 
   update();
@@ -80,6 +104,7 @@ void MainView::mousePressEvent(QMouseEvent *ev) {
  * @param ev Mouse event.
  */
 void MainView::mouseReleaseEvent(QMouseEvent *ev) {
+  InputRecorder::global().record(InputEvent::mouse(InputEvent::MouseRelease, ev));
   qDebug() << "Mouse button released" << ev->button();
 
   update();
@@ -91,6 +116,7 @@ void MainView::mouseReleaseEvent(QMouseEvent *ev) {
  * @param ev Mouse event.
  */
 void MainView::wheelEvent(QWheelEvent *ev) {
+  InputRecorder::global().record(InputEvent::wheel(ev));
   // Implement something
   qDebug() << "Mouse wheel:" << ev->angleDelta();
 